@@ -16,7 +16,8 @@
 
 /**
  * @file CTBFileOutputStream.cpp
- * @brief This defines the `CTBFileOutputStream` class
+ * @brief This defines the `CTBFileOutputStream`, `CTBStdOutputStream` and
+ * `CTBMemoryOutputStream` classes
  */
 
 #include "CTBFileOutputStream.hpp"
@@ -41,3 +42,14 @@ ctb::CTBStdOutputStream::write(const void *ptr, uint32_t size) {
   mstream.write((const char *)ptr, size);
   return size;
 }
+
+/**
+ * @details 
+ * Appends a sequence of memory pointed by ptr to the buffer.
+ */
+uint32_t
+ctb::CTBMemoryOutputStream::write(const void *ptr, uint32_t size) {
+  const unsigned char *bytes = (const unsigned char *) ptr;
+  mBuffer.insert(mBuffer.end(), bytes, bytes + size);
+  return size;
+}
@@ -19,16 +19,19 @@
 
 /**
  * @file CTBFileOutputStream.hpp
- * @brief This declares and defines the `CTBFileOutputStream` and `CTBStdOutputStream` classes
+ * @brief This declares and defines the `CTBFileOutputStream`, `CTBStdOutputStream`
+ * and `CTBMemoryOutputStream` classes
  */
 
 #include <stdio.h>
 #include <ostream>
+#include <vector>
 #include "CTBOutputStream.hpp"
 
 namespace ctb {
   class CTBFileOutputStream;
   class CTBStdOutputStream;
+  class CTBMemoryOutputStream;
 }
 
 /// Implements CTBOutputStream for `FILE*` objects
@@ -57,4 +60,39 @@ protected:
   std::ostream &mstream;
 };
 
+/**
+ * @brief Implements CTBOutputStream for uncompressed data in a buffer
+ *
+ * The buffer keeps its memory when the stream is reset, so one stream can
+ * hold tile after tile without allocating.
+ */
+class CTB_DLL ctb::CTBMemoryOutputStream : public ctb::CTBOutputStream {
+public:
+
+  /// Writes a sequence of memory pointed by ptr into the stream
+  virtual uint32_t write(const void *ptr, uint32_t size);
+
+  /// Discard the data written
+  inline void
+  reset() {
+    mBuffer.clear();
+  }
+
+  /// The bytes written
+  inline const unsigned char *
+  data() const {
+    return mBuffer.data();
+  }
+
+  /// The number of bytes written
+  inline size_t
+  size() const {
+    return mBuffer.size();
+  }
+
+protected:
+  /// The bytes written
+  std::vector<unsigned char> mBuffer;
+};
+
 #endif /* CTBFILEOUTPUTSTREAM_HPP */
@@ -23,6 +23,12 @@
 #include <string.h>
 #include <mutex>
 
+#ifdef _WIN32
+#include <windows.h>            // for CreateHardLinkA
+#else
+#include <unistd.h>             // for link and symlink
+#endif
+
 #include "../deps/concat.hpp"
 #include "cpl_vsi.h"
 #include "CTBException.hpp"
@@ -90,6 +96,30 @@ fileExists(const std::string& filename) {
   return VSIStatExL(filename.c_str(), &statbuf, VSI_STAT_EXISTS_FLAG) == 0;
 }
 
+/// Copy a file
+static bool
+copyFile(const std::string &source, const std::string &destination) {
+  VSILFILE *in = VSIFOpenL(source.c_str(), "rb");
+  if (in == NULL) {
+    return false;
+  }
+  VSILFILE *out = VSIFOpenL(destination.c_str(), "wb");
+  if (out == NULL) {
+    VSIFCloseL(in);
+    return false;
+  }
+
+  unsigned char buffer[65536];
+  size_t count;
+  bool copied = true;
+  while (copied && (count = VSIFReadL(buffer, 1, sizeof(buffer), in)) > 0) {
+    copied = VSIFWriteL(buffer, 1, count, out) == count;
+  }
+  VSIFCloseL(in);
+  VSIFCloseL(out);
+  return copied;
+}
+
 
 /**
  * @details 
@@ -135,6 +165,14 @@ ctb::CTBFileTileSerializer::serializeTile(const ctb::GDALTile *tile, GDALDriver
 bool
 ctb::CTBFileTileSerializer::serializeTile(const ctb::TerrainTile *tile) {
   const TileCoordinate *coordinate = tile;
+
+  if (mDuplicate != DuplicateWrite) {
+    CTBMemoryOutputStream ostream;
+    tile->writeFile(ostream);
+    writeTile(*coordinate, "terrain", ostream.data(), ostream.size(), true);
+    return true;
+  }
+
   const string filename = getTileFilename(tile, moutputDir, "terrain");
   const string temp_filename = concat(filename, ".tmp");
 
@@ -155,6 +193,14 @@ ctb::CTBFileTileSerializer::serializeTile(const ctb::TerrainTile *tile) {
 bool
 ctb::CTBFileTileSerializer::serializeTile(const ctb::MeshTile *tile, bool writeVertexNormals) {
   const TileCoordinate *coordinate = tile;
+
+  if (mDuplicate != DuplicateWrite) {
+    CTBMemoryOutputStream ostream;
+    tile->writeFile(ostream, writeVertexNormals);
+    writeTile(*coordinate, "terrain", ostream.data(), ostream.size(), true);
+    return true;
+  }
+
   const string filename = getTileFilename(coordinate, moutputDir, "terrain");
   const string temp_filename = concat(filename, ".tmp");
 
@@ -167,3 +213,122 @@ ctb::CTBFileTileSerializer::serializeTile(const ctb::MeshTile *tile, bool writeV
   }
   return true;
 }
+
+/**
+ * @details 
+ * Serialize the image of a tile to the Directory store
+ */
+bool
+ctb::CTBFileTileSerializer::serializeImage(const ctb::TileCoordinate &coordinate, const unsigned char *data, size_t size, const char *extension) {
+  writeTile(coordinate, extension, data, size, false);
+  return true;
+}
+
+/**
+ * @details The hash of the bytes of the tile, before any compression, is
+ * looked up among those of the tiles recently written.  A tile found there is
+ * linked to or copied from the file of that tile, otherwise it is written and
+ * its hash added to the table, dropping the hash used least recently if the
+ * table is full.
+ */
+void
+ctb::CTBFileTileSerializer::writeTile(const ctb::TileCoordinate &coordinate, const char *extension, const unsigned char *data, size_t size, bool compress) {
+  const string filename = getTileFilename(&coordinate, moutputDir, extension);
+  const string temp_filename = concat(filename, ".tmp");
+  ContentHash hash;
+  bool duplicated = false;
+
+  if (mDuplicate != DuplicateWrite) {
+    string source;
+    hash = ContentHash(data, size);
+    {
+      lock_guard<std::mutex> lock(mHashMutex);
+      auto found = mHashIndex.find(hash);
+      if (found != mHashIndex.end()) {
+        mHashes.splice(mHashes.begin(), mHashes, found->second);
+        source = found->second->second;
+      }
+    }
+    duplicated = !source.empty() && source != filename && writeDuplicate(source, temp_filename);
+  }
+
+  if (!duplicated) {
+    if (compress) {
+      CTBZFileOutputStream ostream(temp_filename.c_str());
+      ostream.write(data, (uint32_t) size);
+      ostream.close();
+    } else {
+      VSILFILE *fp = VSIFOpenL(temp_filename.c_str(), "wb");
+      if (fp == NULL) {
+        throw CTBException("Could not create the image file");
+      }
+      const size_t written = VSIFWriteL(data, 1, size, fp);
+      VSIFCloseL(fp);
+      if (written != size) {
+        throw CTBException("Could not write the image file");
+      }
+    }
+  }
+
+  if (VSIRename(temp_filename.c_str(), filename.c_str()) != 0) {
+    throw CTBException("Could not rename temporary file");
+  }
+
+  if (duplicated) {
+    // Renaming a hard link over another link to the same file, as when tiling
+    // again, leaves the temporary link in place
+    if (mDuplicate == DuplicateHardLink) VSIUnlink(temp_filename.c_str());
+    return;
+  }
+
+  if (mDuplicate != DuplicateWrite) {
+    lock_guard<std::mutex> lock(mHashMutex);
+    auto found = mHashIndex.find(hash);
+    if (found != mHashIndex.end()) {
+      // The tile could not be linked to the file of the hash, so takes its place
+      found->second->second = filename;
+      mHashes.splice(mHashes.begin(), mHashes, found->second);
+    } else {
+      mHashes.emplace_front(hash, filename);
+      mHashIndex[hash] = mHashes.begin();
+      if (mHashes.size() > mHashCount) {
+        mHashIndex.erase(mHashes.back().first);
+        mHashes.pop_back();
+      }
+    }
+  }
+}
+
+/**
+ * @details Symbolic links point to the source by a path relative to the
+ * directory of the tile, so the output directory can be moved.  They are not
+ * made on Windows, where they require privileges, so the tiles are written in
+ * full instead.
+ */
+bool
+ctb::CTBFileTileSerializer::writeDuplicate(const string &source, const string &temp_filename) {
+  switch (mDuplicate) {
+  case DuplicateHardLink:
+#ifdef _WIN32
+    return CreateHardLinkA(temp_filename.c_str(), source.c_str(), NULL) != 0;
+#else
+    return link(source.c_str(), temp_filename.c_str()) == 0;
+#endif
+
+  case DuplicateSymbolicLink: {
+#ifdef _WIN32
+    return false;
+#else
+    // Both tiles are in a `{zoom}/{x}` directory of the output directory
+    const string target = concat("..", osDirSep, "..", osDirSep, source.substr(moutputDir.size()));
+    return symlink(target.c_str(), temp_filename.c_str()) == 0;
+#endif
+  }
+
+  case DuplicateCopy:
+    return copyFile(source, temp_filename);
+
+  default:
+    return false;
+  }
+}
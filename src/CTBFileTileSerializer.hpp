@@ -22,10 +22,15 @@
  * @brief This declares and defines the `CTBFileTileSerializer` class
  */
 
+#include <list>
+#include <mutex>
 #include <string>
+#include <unordered_map>
 
+#include "ContentHash.hpp"
 #include "TileCoordinate.hpp"
 #include "GDALSerializer.hpp"
+#include "ImageSerializer.hpp"
 #include "TerrainSerializer.hpp"
 #include "MeshSerializer.hpp"
 
@@ -33,15 +38,36 @@ namespace ctb {
   class CTBFileTileSerializer;
 }
 
-/// Implements a serializer of `Tile`s based in a directory of files
+/**
+ * @brief Implements a serializer of `Tile`s based in a directory of files
+ *
+ * The serializer can keep a table of the hashes of the tiles it has recently
+ * written, so that a tile identical to one of them, such as a flat tile of
+ * the sea, is made a link to the file already written, or a copy of it,
+ * instead of being compressed and written again.  A tile whose link cannot be
+ * made, for instance as the file already has as many hard links as the
+ * filesystem allows, is written in full and replaces the file in the table.
+ */
 class CTB_DLL ctb::CTBFileTileSerializer : 
   public ctb::GDALSerializer,
   public ctb::TerrainSerializer, 
-  public ctb::MeshSerializer {
+  public ctb::MeshSerializer,
+  public ctb::ImageSerializer {
 public:
-  CTBFileTileSerializer(const std::string &outputDir, bool resume):
+
+  /// How a tile identical to a tile already written is stored
+  enum Duplicate {
+    DuplicateWrite,             ///< Write the tile in full
+    DuplicateHardLink,          ///< Hard link the tile to the file already written
+    DuplicateSymbolicLink,      ///< Link the tile to the file already written by a relative path
+    DuplicateCopy               ///< Copy the file already written, without compressing the tile again
+  };
+
+  CTBFileTileSerializer(const std::string &outputDir, bool resume, Duplicate duplicate = DuplicateWrite, size_t hashCount = 16384):
     moutputDir(outputDir), 
-    mresume(resume) {}
+    mresume(resume),
+    mDuplicate(duplicate),
+    mHashCount(hashCount) {}
 
   /// Start a new serialization task
   virtual void startSerialization() {};
@@ -55,6 +81,8 @@ public:
   virtual bool serializeTile(const ctb::TerrainTile *tile);
   /// Serialize a MeshTile to the store
   virtual bool serializeTile(const ctb::MeshTile *tile, bool writeVertexNormals = false);
+  /// Serialize the image of a tile to the store
+  virtual bool serializeImage(const ctb::TileCoordinate &coordinate, const unsigned char *data, size_t size, const char *extension);
 
   /// Serialization finished, releases any resources loaded
   virtual void endSerialization() {};
@@ -65,10 +93,31 @@ public:
   getTileFilename(const TileCoordinate *coord, const std::string dirname, const char *extension);
 
 protected:
+
+  /// Write the bytes of a tile, or link it to an identical tile already written
+  void
+  writeTile(const ctb::TileCoordinate &coordinate, const char *extension, const unsigned char *data, size_t size, bool compress);
+
+  /// Create a temporary file linking to or copying a tile already written
+  bool
+  writeDuplicate(const std::string &source, const std::string &temp_filename);
+
   /// The target directory where serializing
   std::string moutputDir;
   /// Do not overwrite existing files
   bool mresume;
+
+  /// How identical tiles are stored
+  Duplicate mDuplicate;
+  /// The maximum number of hashes of the tiles recently written
+  size_t mHashCount;
+
+  /// The hashes and filenames of the tiles recently written, the latest first
+  std::list<std::pair<ContentHash, std::string>> mHashes;
+  /// The position in the list of each hash
+  std::unordered_map<ContentHash, std::list<std::pair<ContentHash, std::string>>::iterator> mHashIndex;
+  /// Guards the hashes of the tiles recently written
+  std::mutex mHashMutex;
 };
 
 #endif /* CTBFILETILESERIALIZER_HPP */
@@ -28,25 +28,26 @@
 #include "cpl_vsi.h"
 #include "CTBException.hpp"
 #include "CTBMBTileSerializer.hpp"
+#include "ContentHash.hpp"
 #include "CTBFileOutputStream.hpp"
 #include "CTBZOutputStream.hpp"
 
 using namespace std;
 using namespace ctb;
 
-ctb::CTBMBTileSerializer::CTBMBTileSerializer(const std::string &outputDir, const std::string &datasetName, bool resume) :
+ctb::CTBMBTileSerializer::CTBMBTileSerializer(const std::string &outputDir, const std::string &datasetName, bool resume, bool deduplicate) :
   moutputDir(outputDir),
   mresume(resume) {
  
   dbPath = outputDir + datasetName + ".mbtiles";
 
   if (mresume) {
-    mbTiles = unique_ptr<MbTilesDb>(new MbTilesDb(dbPath));
+    mbTiles = unique_ptr<MbTilesDb>(new MbTilesDb(dbPath, deduplicate));
     mbTiles->loadRenderedTiles(renderedTiles);
   }
   else {
     VSIUnlink(dbPath.c_str());
-    mbTiles = unique_ptr<MbTilesDb>(new MbTilesDb(dbPath));
+    mbTiles = unique_ptr<MbTilesDb>(new MbTilesDb(dbPath, deduplicate));
   }
 }
 
@@ -109,6 +110,44 @@ ctb::CTBMBTileSerializer::checkIfAlreadyRendered(const TileCoordinate& coord) {
   return alreadyRendered;
 }
 
+/**
+ * @details
+ * The tile is identified by the hash of its content, so an image already
+ * stored is neither compressed nor written again.  A new image is compressed
+ * outside the lock, so the workers compress their tiles concurrently.  The
+ * database throws if the image cannot be stored, before the tile is mapped.
+ */
+bool
+ctb::CTBMBTileSerializer::writeDeduplicated(const TileCoordinate &coordinate, const unsigned char *data, size_t size, bool compress) {
+  const std::string tileId = ContentHash(data, size).hex();
+
+  {
+    std::lock_guard<std::mutex> lock(mDeduplicatedMutex);
+    if (mbTiles->hasImage(tileId)) {
+      mbTiles->writeMap(coordinate.zoom, coordinate.x, coordinate.y, tileId);
+      return true;
+    }
+  }
+
+  std::string compressed;
+  if (compress) {
+    CTBZOutputStream stream;
+    stream.write(data, (uint32_t) size);
+    compressed = stream.str();
+  }
+
+  std::lock_guard<std::mutex> lock(mDeduplicatedMutex);
+  if (!mbTiles->hasImage(tileId)) {
+    if (compress) {
+      mbTiles->writeImage(tileId, compressed.c_str(), (int) compressed.size());
+    } else {
+      mbTiles->writeImage(tileId, (const char *) data, (int) size);
+    }
+  }
+  mbTiles->writeMap(coordinate.zoom, coordinate.x, coordinate.y, tileId);
+  return true;
+}
+
 /**
  * @details
  * Serialize a TerrainTile to the gzip os
@@ -116,6 +155,14 @@ ctb::CTBMBTileSerializer::checkIfAlreadyRendered(const TileCoordinate& coord) {
 bool
 ctb::CTBMBTileSerializer::serializeTile(const ctb::TerrainTile *tile) {
   const TileCoordinate *coordinate = tile;
+
+  // Identical tiles are recognised by their content before compression
+  if (mbTiles->isDeduplicated()) {
+    CTBMemoryOutputStream stream;
+    tile->writeFile(stream);
+    return writeDeduplicated(*coordinate, stream.data(), stream.size(), true);
+  }
+
   static std::mutex mutex;
   std::lock_guard<std::mutex> lock(mutex);
 
@@ -139,6 +186,14 @@ bool
 ctb::CTBMBTileSerializer::serializeTile(const ctb::MeshTile *tile, bool writeVertexNormals) {
   
   const TileCoordinate *coordinate = tile;
+
+  // Identical tiles are recognised by their content before compression
+  if (mbTiles->isDeduplicated()) {
+    CTBMemoryOutputStream stream;
+    tile->writeFile(stream, writeVertexNormals);
+    return writeDeduplicated(*coordinate, stream.data(), stream.size(), true);
+  }
+
   static std::mutex mutex;
   std::lock_guard<std::mutex> lock(mutex);
 
@@ -153,3 +208,25 @@ ctb::CTBMBTileSerializer::serializeTile(const ctb::MeshTile *tile, bool writeVer
   //recordValidPoint(*coordinate);
   return true;
 }
+
+/**
+ * @details
+ * Serialize the image of a tile, which is already compressed, as it is.  The
+ * tiles of an MBTiles file have no file names, so the extension is not used.
+ */
+bool
+ctb::CTBMBTileSerializer::serializeImage(const ctb::TileCoordinate &coordinate, const unsigned char *data, size_t size, const char *) {
+  if (mbTiles->isDeduplicated()) {
+    return writeDeduplicated(coordinate, data, size, false);
+  }
+
+  static std::mutex mutex;
+  std::lock_guard<std::mutex> lock(mutex);
+
+  mbTiles->writeTile(
+    coordinate.zoom, coordinate.x, coordinate.y,
+    (const char *) data,
+    (int) size);
+
+  return true;
+}
@@ -22,13 +22,15 @@
   * @brief This declares and defines the `CTBFileTileSerializer` class
   */
 
+#include <mutex>
 #include <string>
 #include <unordered_set>
 #include <vector>
 
-#include "MBTilesDb.hpp"
+#include "MbTilesDb.hpp"
 #include "TileCoordinate.hpp"
 #include "GDALSerializer.hpp"
+#include "ImageSerializer.hpp"
 #include "TerrainSerializer.hpp"
 #include "MeshSerializer.hpp"
 
@@ -39,9 +41,11 @@ namespace ctb {
 /// Implements a serializer of `Tile`s based in a directory of files
 class CTB_DLL ctb::CTBMBTileSerializer :
 	public ctb::TerrainSerializer,
-	public ctb::MeshSerializer {
+	public ctb::MeshSerializer,
+	public ctb::ImageSerializer {
 public:
-	CTBMBTileSerializer(const std::string &outputDir, const std::string &datasetName, bool resume);  
+	/// Instantiate a serializer, storing identical tiles once if deduplicating
+	CTBMBTileSerializer(const std::string &outputDir, const std::string &datasetName, bool resume, bool deduplicate = false);
 
 	/// Start a new serialization task
 	virtual void startSerialization() {};
@@ -53,6 +57,8 @@ public:
 	virtual bool serializeTile(const ctb::TerrainTile *tile);
 	/// Serialize a MeshTile to the store
 	virtual bool serializeTile(const ctb::MeshTile *tile, bool writeVertexNormals = false);
+	/// Serialize the image of a tile to the store
+	virtual bool serializeImage(const ctb::TileCoordinate &coordinate, const unsigned char *data, size_t size, const char *extension);
 
 	/// Serialization finished, releases any resources loaded
 	virtual void endSerialization() {};  
@@ -68,6 +74,12 @@ protected:
 
   bool checkIfAlreadyRendered(const TileCoordinate & coord);
 
+  /// Write a tile to a deduplicated database, given its content before any compression
+  bool writeDeduplicated(const TileCoordinate &coordinate, const unsigned char *data, size_t size, bool compress);
+
+  /// Serialises the writes of a deduplicated database
+  std::mutex mDeduplicatedMutex;
+
 	/// sql db
   std::unique_ptr<MbTilesDb> mbTiles;
 
@@ -16,7 +16,8 @@
 
 /**
  * @file CTBZOutputStream.cpp
- * @brief This defines the `CTBZOutputStream` and `CTBZFileOutputStream` classes
+ * @brief This defines the `CTBZOutputStream`, `CTBZFileOutputStream` and
+ * `CTBZMemoryOutputStream` classes
  */
 
 #include "CTBException.hpp"
@@ -90,3 +91,68 @@ size_t ctb::CTBZOutputStream::size()
 {
   return outputBuffer.str().size(); 
 }
+
+/// The first size of the buffer of a `CTBZMemoryOutputStream`
+static const size_t MEMORY_STREAM_BUFFER_SIZE = 16 * 1024;
+
+ctb::CTBZMemoryOutputStream::CTBZMemoryOutputStream(int level):
+  mBuffer(MEMORY_STREAM_BUFFER_SIZE),
+  mSize(0)
+{
+  mStream.zalloc = Z_NULL;
+  mStream.zfree = Z_NULL;
+  mStream.opaque = Z_NULL;
+
+  // A window of 15 bits plus 16 writes a gzip header and trailer
+  if (deflateInit2(&mStream, level, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+    throw CTBException("Failed to initialise the gzip stream");
+  }
+}
+
+ctb::CTBZMemoryOutputStream::~CTBZMemoryOutputStream() {
+  deflateEnd(&mStream);
+}
+
+/**
+ * @details The buffer is doubled whenever zlib fills it.
+ */
+void
+ctb::CTBZMemoryOutputStream::deflateInput(int flush) {
+  int status;
+
+  do {
+    if (mSize == mBuffer.size()) {
+      mBuffer.resize(mBuffer.size() * 2);
+    }
+    mStream.next_out = mBuffer.data() + mSize;
+    mStream.avail_out = (uInt) (mBuffer.size() - mSize);
+
+    status = deflate(&mStream, flush);
+    if (status == Z_STREAM_ERROR) {
+      throw CTBException("Failed to compress the data");
+    }
+    mSize = mBuffer.size() - mStream.avail_out;
+  } while (mStream.avail_out == 0 || (flush == Z_FINISH && status != Z_STREAM_END));
+}
+
+uint32_t
+ctb::CTBZMemoryOutputStream::write(const void *ptr, uint32_t size) {
+  mStream.next_in = (Bytef *) ptr;
+  mStream.avail_in = size;
+  deflateInput(Z_NO_FLUSH);
+
+  return size;
+}
+
+void
+ctb::CTBZMemoryOutputStream::finish() {
+  mStream.next_in = Z_NULL;
+  mStream.avail_in = 0;
+  deflateInput(Z_FINISH);
+}
+
+void
+ctb::CTBZMemoryOutputStream::reset() {
+  deflateReset(&mStream);
+  mSize = 0;
+}
@@ -23,6 +23,7 @@
  */
 
 #include <sstream>
+#include <vector>
 #include "zlib.h"
 #include "zstr.hpp"
 #include "CTBOutputStream.hpp"
@@ -30,6 +31,7 @@
 namespace ctb {
   class CTBZFileOutputStream;
   class CTBZOutputStream;
+  class CTBZMemoryOutputStream;
 }
 
 /// Implements CTBOutputStream for `GZFILE` object
@@ -64,4 +66,52 @@ protected:
   gzFile fp;
 };
 
+/**
+ * @brief Implements CTBOutputStream for gzipped data in a buffer
+ *
+ * The data is compressed into a buffer owned by the stream, which keeps its
+ * memory when the stream is reset, so one stream can encode tile after tile
+ * without allocating.  The bytes are complete once `finish` is called.
+ */
+class CTB_DLL ctb::CTBZMemoryOutputStream : public ctb::CTBOutputStream {
+public:
+  CTBZMemoryOutputStream(int level = Z_DEFAULT_COMPRESSION);
+ ~CTBZMemoryOutputStream();
+
+  /// Writes a sequence of memory pointed by ptr into the stream
+  virtual uint32_t write(const void *ptr, uint32_t size);
+
+  /// Complete the gzip data
+  void finish();
+
+  /// Discard the data to start a new gzip stream
+  void reset();
+
+  /// The compressed bytes
+  inline const unsigned char *
+  data() const {
+    return mBuffer.data();
+  }
+
+  /// The number of compressed bytes
+  inline size_t
+  size() const {
+    return mSize;
+  }
+
+protected:
+  /// Compress the pending input with a zlib flush mode
+  void deflateInput(int flush);
+
+  /// The zlib stream
+  z_stream mStream;
+  /// The buffer of compressed bytes and the number used
+  std::vector<unsigned char> mBuffer;
+  size_t mSize;
+
+  // The zlib stream points into itself, so it is not copied
+  CTBZMemoryOutputStream(const CTBZMemoryOutputStream &) = delete;
+  CTBZMemoryOutputStream &operator=(const CTBZMemoryOutputStream &) = delete;
+};
+
 #endif /* CTBZOUTPUTSTREAM_HPP */
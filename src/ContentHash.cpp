@@ -0,0 +1,114 @@
+/*******************************************************************************
+ * Copyright 2018 GeoData <geodata@soton.ac.uk>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not
+ * use this file except in compliance with the License.  You may obtain a copy
+ * of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ *******************************************************************************/
+
+/**
+ * @file ContentHash.cpp
+ * @brief This defines the `ContentHash` class
+ */
+
+#include <cstdio>
+#include <cstring>
+
+#include "ContentHash.hpp"
+
+using namespace ctb;
+
+static inline uint64_t
+rotl(uint64_t x, int r) {
+  return (x << r) | (x >> (64 - r));
+}
+
+/// Mix the bits of a 64 bit word
+static inline uint64_t
+fmix(uint64_t k) {
+  k ^= k >> 33;
+  k *= 0xff51afd7ed558ccdULL;
+  k ^= k >> 33;
+  k *= 0xc4ceb9fe1a85ec53ULL;
+  k ^= k >> 33;
+  return k;
+}
+
+/// Read a little endian 64 bit word
+static inline uint64_t
+readWord(const unsigned char *bytes) {
+  uint64_t word = 0;
+  for (int i = 7; i >= 0; i--) {
+    word = (word << 8) | bytes[i];
+  }
+  return word;
+}
+
+/**
+ * @details The bytes are hashed in blocks of 16 bytes followed by the tail,
+ * as in the reference implementation with a seed of `0`.
+ */
+ctb::ContentHash::ContentHash(const void *data, size_t size) {
+  static const uint64_t c1 = 0x87c37b91114253d5ULL,
+    c2 = 0x4cf5ad432745937fULL;
+
+  const unsigned char *bytes = (const unsigned char *) data;
+  const size_t blockCount = size / 16;
+  uint64_t h1 = 0, h2 = 0;
+
+  for (size_t i = 0; i < blockCount; i++) {
+    uint64_t k1 = readWord(bytes + i * 16),
+      k2 = readWord(bytes + i * 16 + 8);
+
+    k1 *= c1; k1 = rotl(k1, 31); k1 *= c2; h1 ^= k1;
+    h1 = rotl(h1, 27); h1 += h2; h1 = h1 * 5 + 0x52dce729;
+
+    k2 *= c2; k2 = rotl(k2, 33); k2 *= c1; h2 ^= k2;
+    h2 = rotl(h2, 31); h2 += h1; h2 = h2 * 5 + 0x38495ab5;
+  }
+
+  // The remaining bytes, the first eight in `k1`
+  const unsigned char *tail = bytes + blockCount * 16;
+  const size_t rest = size & 15;
+  uint64_t k1 = 0, k2 = 0;
+
+  for (size_t i = rest; i > 8; i--) {
+    k2 ^= (uint64_t) tail[i - 1] << ((i - 9) * 8);
+  }
+  if (rest > 8) {
+    k2 *= c2; k2 = rotl(k2, 33); k2 *= c1; h2 ^= k2;
+  }
+  for (size_t i = (rest < 8) ? rest : 8; i > 0; i--) {
+    k1 ^= (uint64_t) tail[i - 1] << ((i - 1) * 8);
+  }
+  if (rest > 0) {
+    k1 *= c1; k1 = rotl(k1, 31); k1 *= c2; h1 ^= k1;
+  }
+
+  h1 ^= (uint64_t) size;
+  h2 ^= (uint64_t) size;
+  h1 += h2;
+  h2 += h1;
+  h1 = fmix(h1);
+  h2 = fmix(h2);
+  h1 += h2;
+  h2 += h1;
+
+  mHigh = h1;
+  mLow = h2;
+}
+
+std::string
+ctb::ContentHash::hex() const {
+  char digits[33];
+  snprintf(digits, sizeof(digits), "%016llx%016llx", (unsigned long long) mHigh, (unsigned long long) mLow);
+  return std::string(digits);
+}
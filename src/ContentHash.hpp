@@ -0,0 +1,88 @@
+#ifndef CONTENTHASH_HPP
+#define CONTENTHASH_HPP
+
+/*******************************************************************************
+ * Copyright 2018 GeoData <geodata@soton.ac.uk>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not
+ * use this file except in compliance with the License.  You may obtain a copy
+ * of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ *******************************************************************************/
+
+/**
+ * @file ContentHash.hpp
+ * @brief This declares the `ContentHash` class
+ */
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+
+#include "config.hpp"
+
+namespace ctb {
+  class ContentHash;
+}
+
+/**
+ * @brief A 128 bit hash identifying the content of a tile
+ *
+ * This is the x64 128 bit variant of MurmurHash3, which hashes several bytes
+ * per cycle, so identical tiles can be recognised by their hash alone: with
+ * 128 bits a collision between the tiles of even the largest tilesets is
+ * vanishingly unlikely.  It is not a cryptographic hash.
+ */
+class CTB_DLL ctb::ContentHash {
+public:
+
+  /// The hash of no bytes
+  ContentHash():
+    mHigh(0),
+    mLow(0)
+  {}
+
+  /// Hash a sequence of bytes
+  ContentHash(const void *data, size_t size);
+
+  /// The hash as 32 hexadecimal digits
+  std::string
+  hex() const;
+
+  inline bool
+  operator==(const ContentHash &other) const {
+    return mHigh == other.mHigh && mLow == other.mLow;
+  }
+
+  inline bool
+  operator!=(const ContentHash &other) const {
+    return !(*this == other);
+  }
+
+  /// Hash the hash into a `size_t`, as for a `std::unordered_map` key
+  inline size_t
+  value() const {
+    return (size_t) (mHigh ^ mLow);
+  }
+
+protected:
+  uint64_t mHigh, mLow;
+};
+
+namespace std {
+  template<> struct hash<ctb::ContentHash> {
+    size_t operator()(const ctb::ContentHash &hash) const {
+      return hash.value();
+    }
+  };
+}
+
+#endif /* CONTENTHASH_HPP */
@@ -0,0 +1,294 @@
+/*******************************************************************************
+ * Copyright 2018 GeoData <geodata@soton.ac.uk>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not
+ * use this file except in compliance with the License.  You may obtain a copy
+ * of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ *******************************************************************************/
+
+/**
+ * @file CoverageIndex.cpp
+ * @brief This defines the `CoverageIndex` class
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include "gdal_priv.h"
+
+#include "CTBException.hpp"
+#include "CoverageIndex.hpp"
+#include "HeightKernels.hpp"
+#include "TerrainTiler.hpp"
+#include "TileAvailability.hpp"
+
+using namespace ctb;
+
+/**
+ * @brief Read a band of a raster replacing nodata with `NaN`
+ */
+static void
+readIndexRaster(GDALTile *rasterTile, int width, int height, std::vector<float> &heights) {
+  GDALRasterBand *heightsBand = rasterTile->dataset->GetRasterBand(1);
+
+  heights.resize((size_t) width * height);
+  if (heightsBand->RasterIO(GF_Read, 0, 0, width, height,
+                            (void *) heights.data(), width, height, GDT_Float32,
+                            0, 0) != CE_None) {
+    throw CTBException("Could not read the coverage index from raster");
+  }
+
+  int bGotNoData = FALSE;
+  float noDataValue = (float) heightsBand->GetNoDataValue(&bGotNoData);
+  if (!bGotNoData) noDataValue = -32768;
+
+  HeightKernels::replaceNoData(heights.data(), heights.size(), noDataValue, std::numeric_limits<float>::quiet_NaN());
+}
+
+/**
+ * @details The index zoom level is the deepest one, not deeper than the
+ * maximum zoom level of the tiler, whose tiles covering the dataset hold no
+ * more than `maxPixels` pixels.  The dataset is warped twice over that area,
+ * with the `min` and `max` resampling algorithms.
+ */
+CoverageIndex::CoverageIndex(const GDALTiler &tiler, unsigned int maxPixels):
+  mTileSize(tiler.grid().tileSize())
+{
+  const Grid &grid = tiler.grid();
+
+  // Find the deepest zoom level fitting in the pixel budget
+  mZoom = tiler.maxZoomLevel();
+  TileBounds bounds = tiler.tileBoundsForZoom(mZoom);
+  while (mZoom > 0 &&
+         (double) (bounds.getWidth() + 1) * (bounds.getHeight() + 1) * mTileSize * mTileSize > maxPixels) {
+    bounds = tiler.tileBoundsForZoom(--mZoom);
+  }
+
+  mOrigin = TileCoordinate(mZoom, bounds.getMinX(), bounds.getMinY());
+  mWidth = (bounds.getWidth() + 1) * mTileSize;
+  mHeight = (bounds.getHeight() + 1) * mTileSize;
+
+  // The geo transform of the index raster
+  const double resolution = grid.resolution(mZoom);
+  const CRSBounds upperLeft = grid.tileBounds(TileCoordinate(mZoom, bounds.getMinX(), bounds.getMaxY()));
+  double adfGeoTransform[6] = { upperLeft.getMinX(), resolution, 0, upperLeft.getMaxY(), 0, -resolution };
+
+  // Warp the height band once for each end of the height range
+  TilerOptions options = tiler.options;
+  options.coverage.reset();
+  options.maskBand = 0;
+
+  const GDALResampleAlg algorithms[2] = { GRA_Min, GRA_Max };
+  std::vector<float> *targets[2] = { &mMinHeights, &mMaxHeights };
+
+  for (int i = 0; i < 2; i++) {
+    options.resampleAlg = algorithms[i];
+
+    const TerrainTiler indexTiler(tiler.dataset(), grid, options);
+    GDALTile *rasterTile = static_cast<const GDALTiler &>(indexTiler).createRasterTile(tiler.dataset(), adfGeoTransform, mWidth, mHeight);
+
+    try {
+      readIndexRaster(rasterTile, mWidth, mHeight, *targets[i]);
+    } catch (CTBException &e) {
+      delete rasterTile;
+      throw;
+    }
+    delete rasterTile;
+  }
+
+  // Summarise the pixels of each tile at the index zoom level
+  const Cell empty = { 0, std::numeric_limits<float>::max(), -std::numeric_limits<float>::max() };
+  const i_tile columns = bounds.getWidth() + 1;
+
+  mLevels.reserve(mZoom + 1);
+  mLevels.push_back(Level());
+  Level &level = mLevels.back();
+  level.bounds = bounds;
+  level.cells.resize((size_t) columns * (bounds.getHeight() + 1), empty);
+
+  const float noData = std::numeric_limits<float>::quiet_NaN();
+  for (int row = 0; row < mHeight; row++) {
+    const i_tile tileY = (mHeight - 1 - row) / mTileSize; // the rows are from the north
+
+    for (i_tile tileX = 0; tileX < columns; tileX++) {
+      const size_t index = (size_t) row * mWidth + tileX * mTileSize;
+      const HeightKernels::Range minRange = HeightKernels::heightRange(&mMinHeights[index], mTileSize, noData);
+      if (minRange.valid == 0) continue;
+
+      const HeightKernels::Range maxRange = HeightKernels::heightRange(&mMaxHeights[index], mTileSize, noData);
+      Cell &cell = level.cells[(size_t) tileY * columns + tileX];
+      cell.valid += minRange.valid;
+      cell.minHeight = std::min(cell.minHeight, minRange.minHeight);
+      cell.maxHeight = std::max(cell.maxHeight, maxRange.maxHeight);
+    }
+  }
+
+  // Merge the children of each tile up to zoom level 0
+  for (i_zoom zoom = mZoom; zoom > 0; zoom--) {
+    mLevels.push_back(Level()); // the capacity is reserved so `child` stays valid
+    const Level &child = mLevels[mLevels.size() - 2];
+    const TileBounds &childBounds = child.bounds;
+    const i_tile childColumns = childBounds.getWidth() + 1;
+
+    Level &parent = mLevels.back();
+    parent.bounds = TileBounds(childBounds.getMinX() >> 1, childBounds.getMinY() >> 1,
+                               childBounds.getMaxX() >> 1, childBounds.getMaxY() >> 1);
+    const i_tile parentColumns = parent.bounds.getWidth() + 1;
+    parent.cells.resize((size_t) parentColumns * (parent.bounds.getHeight() + 1), empty);
+
+    for (i_tile y = childBounds.getMinY(); y <= childBounds.getMaxY(); y++) {
+      for (i_tile x = childBounds.getMinX(); x <= childBounds.getMaxX(); x++) {
+        const Cell &cell = child.cells[(size_t) (y - childBounds.getMinY()) * childColumns + (x - childBounds.getMinX())];
+        const size_t index = (size_t) ((y >> 1) - parent.bounds.getMinY()) * parentColumns + ((x >> 1) - parent.bounds.getMinX());
+
+        mergeCell(parent.cells[index], cell);
+      }
+    }
+  }
+}
+
+void
+CoverageIndex::mergeCell(Cell &cell, const Cell &other) {
+  if (other.valid == 0) return;
+
+  cell.valid += other.valid;
+  cell.minHeight = std::min(cell.minHeight, other.minHeight);
+  cell.maxHeight = std::max(cell.maxHeight, other.maxHeight);
+}
+
+double
+CoverageIndex::pixelRange(const TileCoordinate &coord, int &startCol, int &endCol, int &startRow, int &endRow) const {
+  // The size of the tile in index pixels
+  const double size = std::ldexp((double) mTileSize, mZoom - coord.zoom);
+
+  // The pixel columns from the west, and rows from the south, of the index
+  const double west = std::floor(coord.x * size) - (double) mOrigin.x * mTileSize,
+    east = std::ceil((coord.x + 1) * size) - (double) mOrigin.x * mTileSize,
+    south = std::floor(coord.y * size) - (double) mOrigin.y * mTileSize,
+    north = std::ceil((coord.y + 1) * size) - (double) mOrigin.y * mTileSize;
+
+  if (east <= 0 || west >= mWidth || north <= 0 || south >= mHeight) {
+    return 0;
+  }
+
+  startCol = (int) std::max(west, 0.0);
+  endCol = (int) std::min(east, (double) mWidth);
+  startRow = mHeight - (int) std::min(north, (double) mHeight);
+  endRow = mHeight - (int) std::max(south, 0.0);
+
+  return (east - west) * (north - south);
+}
+
+CoverageIndex::Stats
+CoverageIndex::stats(const TileCoordinate &coord) const {
+  Stats stats;
+
+  // Tiles up to the index zoom level are summarised by the cells
+  if (coord.zoom <= mZoom) {
+    const Level &level = mLevels[mZoom - coord.zoom];
+    const TileBounds &bounds = level.bounds;
+
+    if (coord.x < bounds.getMinX() || coord.x > bounds.getMaxX() ||
+        coord.y < bounds.getMinY() || coord.y > bounds.getMaxY()) {
+      return stats;
+    }
+
+    const Cell &cell = level.cells[(size_t) (coord.y - bounds.getMinY()) * (bounds.getWidth() + 1) + (coord.x - bounds.getMinX())];
+    if (cell.valid > 0) {
+      const double size = std::ldexp((double) mTileSize, mZoom - coord.zoom);
+      stats.validFraction = cell.valid / (size * size);
+      stats.minHeight = cell.minHeight;
+      stats.maxHeight = cell.maxHeight;
+    }
+    return stats;
+  }
+
+  // Deeper tiles are summarised from the pixels they overlap
+  int startCol, endCol, startRow, endRow;
+  const double pixels = pixelRange(coord, startCol, endCol, startRow, endRow);
+  unsigned int valid = 0;
+
+  if (pixels == 0) {
+    return stats;
+  }
+
+  for (int row = startRow; row < endRow; row++) {
+    for (int col = startCol; col < endCol; col++) {
+      const size_t index = (size_t) row * mWidth + col;
+      if (std::isnan(mMinHeights[index])) continue;
+
+      if (valid++ == 0) {
+        stats.minHeight = mMinHeights[index];
+        stats.maxHeight = mMaxHeights[index];
+      } else {
+        stats.minHeight = std::min(stats.minHeight, mMinHeights[index]);
+        stats.maxHeight = std::max(stats.maxHeight, mMaxHeights[index]);
+      }
+    }
+  }
+
+  if (valid > 0) {
+    stats.validFraction = valid / pixels;
+  }
+  return stats;
+}
+
+/**
+ * @details Tiles are added in the order of a `GridIterator`, column by column.
+ * Below the index zoom level each run of pixels with data in a column of the
+ * index adds the rectangle of the tiles it overlaps.
+ */
+void
+CoverageIndex::addAvailability(TileAvailability &availability, i_zoom zoom) const {
+  if (zoom <= mZoom) {
+    const Level &level = mLevels[mZoom - zoom];
+    const TileBounds &bounds = level.bounds;
+    const i_tile columns = bounds.getWidth() + 1;
+
+    for (i_tile x = bounds.getMinX(); x <= bounds.getMaxX(); x++) {
+      for (i_tile y = bounds.getMinY(); y <= bounds.getMaxY(); y++) {
+        if (level.cells[(size_t) (y - bounds.getMinY()) * columns + (x - bounds.getMinX())].valid > 0) {
+          availability.add(TileCoordinate(zoom, x, y));
+        }
+      }
+    }
+    return;
+  }
+
+  // The number of tiles per index pixel
+  const double scale = std::ldexp(1.0, zoom - mZoom) / mTileSize;
+  const double originX = (double) mOrigin.x * mTileSize,
+    originY = (double) mOrigin.y * mTileSize;
+
+  for (int col = 0; col < mWidth; col++) {
+    const i_tile startX = (i_tile) std::floor((originX + col) * scale),
+      endX = (i_tile) std::ceil((originX + col + 1) * scale) - 1;
+
+    // Walk the pixels of the column from the south
+    int row = mHeight - 1;
+    while (row >= 0) {
+      if (std::isnan(mMinHeights[(size_t) row * mWidth + col])) {
+        row--;
+        continue;
+      }
+
+      const int south = mHeight - 1 - row;
+      while (row >= 0 && !std::isnan(mMinHeights[(size_t) row * mWidth + col])) row--;
+      const int north = mHeight - 1 - row; // exclusive
+
+      const i_tile startY = (i_tile) std::floor((originY + south) * scale),
+        endY = (i_tile) std::ceil((originY + north) * scale) - 1;
+
+      availability.add(zoom, TileBounds(startX, startY, endX, endY));
+    }
+  }
+}
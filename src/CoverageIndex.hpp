@@ -0,0 +1,141 @@
+#ifndef COVERAGEINDEX_HPP
+#define COVERAGEINDEX_HPP
+
+/*******************************************************************************
+ * Copyright 2018 GeoData <geodata@soton.ac.uk>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not
+ * use this file except in compliance with the License.  You may obtain a copy
+ * of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ *******************************************************************************/
+
+/**
+ * @file CoverageIndex.hpp
+ * @brief This declares the `CoverageIndex` class
+ */
+
+#include <vector>
+
+#include "config.hpp"
+#include "types.hpp"
+#include "TileCoordinate.hpp"
+
+namespace ctb {
+  class CoverageIndex;
+  class GDALTiler;              // forward declaration
+  class TileAvailability;       // forward declaration
+}
+
+/**
+ * @brief An index of the valid data of a GDAL dataset in tile space
+ *
+ * The index is built from a single coarse warp of the whole dataset onto the
+ * pixels of the deepest zoom level of the tiler grid whose extent fits within
+ * a pixel budget.  The warp reads the full resolution source, as averaged
+ * overviews would narrow the height range, and nodata is skipped by the `min`
+ * and `max` resampling so a pixel is valid if any source pixel below it is.  The pixels are summarised per tile
+ * for that zoom level and every coarser one, while deeper tiles are looked up
+ * from the pixels they overlap.
+ *
+ * The index is conservative: a tile reported as having no data is certain to
+ * be nodata throughout, whereas a tile with data may still only have data in
+ * part of its extent.
+ */
+class CTB_DLL ctb::CoverageIndex {
+public:
+
+  /// The data summary of a tile
+  struct Stats {
+    /// The fraction of the index pixels covered by the tile that have data
+    double validFraction = 0;
+    /// The lowest height of the tile, only set if it has data
+    float minHeight = 0;
+    /// The highest height of the tile, only set if it has data
+    float maxHeight = 0;
+
+    /// Does the tile have any data?
+    inline bool
+    hasData() const {
+      return validFraction > 0;
+    }
+  };
+
+  /// Build the index of the dataset of a tiler
+  CoverageIndex(const GDALTiler &tiler, unsigned int maxPixels = 1 << 22);
+
+  /// Get the zoom level of the index pixels
+  inline i_zoom
+  zoom() const {
+    return mZoom;
+  }
+
+  /// Get the data summary of a tile
+  Stats
+  stats(const TileCoordinate &coord) const;
+
+  /// Does a tile have any data?
+  inline bool
+  hasData(const TileCoordinate &coord) const {
+    return stats(coord).hasData();
+  }
+
+  /// Record the tiles of a zoom level which have data as available
+  void
+  addAvailability(TileAvailability &availability, i_zoom zoom) const;
+
+protected:
+
+  /// The summary of the pixels of a tile
+  struct Cell {
+    unsigned int valid;         ///< The number of pixels with data
+    float minHeight, maxHeight; ///< The height range of those pixels
+  };
+
+  /// The cells of the tiles of a zoom level
+  struct Level {
+    TileBounds bounds;          ///< The tiles covered by the level
+    std::vector<Cell> cells;    ///< The cells in row order from `minY`
+  };
+
+  /**
+   * @brief Get the index pixels covered by a tile deeper than the index zoom level
+   *
+   * The columns and rows are clipped to the index raster and the end values
+   * are exclusive.  This returns the number of pixels covered by the tile
+   * before clipping, or `0` if the tile lies outside the index.
+   */
+  double
+  pixelRange(const TileCoordinate &coord, int &startCol, int &endCol, int &startRow, int &endRow) const;
+
+  /// Merge a cell into another
+  static void
+  mergeCell(Cell &cell, const Cell &other);
+
+  /// The zoom level of the index pixels
+  i_zoom mZoom;
+
+  /// The size of a tile in pixels
+  i_tile mTileSize;
+
+  /// The lower left tile of the index raster
+  TileCoordinate mOrigin;
+
+  /// The size of the index raster in pixels
+  int mWidth, mHeight;
+
+  /// The lowest and highest heights of each pixel, `NaN` where there is no data
+  std::vector<float> mMinHeights, mMaxHeights;
+
+  /// The tile summaries from the index zoom level (first) up to zoom level `0`
+  std::vector<Level> mLevels;
+};
+
+#endif /* COVERAGEINDEX_HPP */
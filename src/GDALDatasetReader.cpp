@@ -19,11 +19,20 @@
  * @brief This defines the `GDALDatasetReader` class
  */
 
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <cstdint>
+#include <iterator>
+
 #include "gdal_priv.h"
 #include "gdalwarper.h"
 
 #include "CTBException.hpp"
+#include "CoverageIndex.hpp"
 #include "GDALDatasetReader.hpp"
+#include "OverviewCache.hpp"
+#include "SourceMosaic.hpp"
 #include "TerrainTiler.hpp"
 
 using namespace ctb;
@@ -34,13 +43,13 @@ using namespace ctb;
  * This method uses `GDALRasterBand::RasterIO` function.
  */
 float *
-ctb::GDALDatasetReader::readRasterHeights(const GDALTiler &tiler, GDALDataset *dataset, const TileCoordinate &coord, ctb::i_tile tileSizeX, ctb::i_tile tileSizeY) {
+ctb::GDALDatasetReader::readRasterHeights(const GDALTiler &tiler, GDALDataset *dataset, const TileCoordinate &coord, ctb::i_tile tileSizeX, ctb::i_tile tileSizeY, unsigned char *rasterMask) {
   GDALTile *rasterTile = createRasterTile(tiler, dataset, coord); // the raster associated with this tile coordinate
 
   const ctb::i_tile TILE_CELL_SIZE = tileSizeX * tileSizeY;
   float *rasterHeights = (float *)CPLCalloc(TILE_CELL_SIZE, sizeof(float));
 
-  GDALRasterBand *heightsBand = rasterTile->dataset->GetRasterBand(1);
+  GDALRasterBand *heightsBand = getHeightsBand(tiler, rasterTile);
 
   if (heightsBand->RasterIO(GF_Read, 0, 0, tileSizeX, tileSizeY,
                             (void *) rasterHeights, tileSizeX, tileSizeY, GDT_Float32,
@@ -51,15 +60,103 @@ ctb::GDALDatasetReader::readRasterHeights(const GDALTiler &tiler, GDALDataset *d
     throw CTBException("Could not read heights from raster");
   }
   delete rasterTile;
+
+  if (rasterMask) {
+    try {
+      readRasterMask(tiler, dataset, coord, rasterMask);
+    } catch (CTBException &e) {
+      CPLFree(rasterHeights);
+      throw;
+    }
+  }
+  return rasterHeights;
+}
+
+/**
+ * @details The heights are read into a new array by `readRasterHeightsInto`,
+ * to be freed by the caller with `CPLFree`.
+ */
+float *
+ctb::GDALDatasetReader::readRasterHeights(GDALDataset *dataset, const TileCoordinate &coord, ctb::i_tile tileSizeX, ctb::i_tile tileSizeY, unsigned char *rasterMask) {
+  float *rasterHeights = (float *)CPLMalloc((size_t) tileSizeX * tileSizeY * sizeof(float));
+
+  try {
+    readRasterHeightsInto(dataset, coord, tileSizeX, tileSizeY, rasterHeights, rasterMask);
+  } catch (CTBException &e) {
+    CPLFree(rasterHeights);
+    throw;
+  }
   return rasterHeights;
 }
 
+GDALRasterBand *
+ctb::GDALDatasetReader::getHeightsBand(const GDALTiler &tiler, GDALTile *rasterTile) {
+  return rasterTile->dataset->GetRasterBand(tiler.rasterTileBand(tiler.options.heightBand));
+}
+
+GDALRasterBand *
+ctb::GDALDatasetReader::getHeightsBand(const GDALTiler &tiler) {
+  return tiler.dataset()->GetRasterBand(tiler.options.heightBand);
+}
+
+std::vector<int>
+ctb::GDALDatasetReader::getWarpBands(const GDALTiler &tiler, GDALDataset *dataset) {
+  return tiler.warpBands(dataset);
+}
+
+/**
+ * @details
+ * The mask band is warped on its own, as `MASK_SIZE * MASK_SIZE` pixels
+ * centred in the bounds of the tile rather than on the height samples, and
+ * with the mode of the source pixels: averaging the mask values as the
+ * heights are would turn the coast into a band of arbitrary values.
+ */
+void
+ctb::GDALDatasetReader::readRasterMask(const GDALTiler &tiler, GDALDataset *dataset, const TileCoordinate &coord, unsigned char *rasterMask) {
+  const int maskBand = tiler.options.maskBand;
+
+  if (maskBand < 1 || maskBand > dataset->GetRasterCount()) {
+    throw CTBException("The water mask band is not present in the GDAL dataset");
+  }
+
+  const CRSBounds bounds = tiler.grid().tileBounds(coord);
+  const double resolution = bounds.getWidth() / MASK_SIZE;
+  double adfGeoTransform[6] = { bounds.getMinX(), resolution, 0, bounds.getMaxY(), 0, -resolution };
+
+  GDALTile *maskTile = tiler.createRasterTile(dataset, adfGeoTransform, MASK_SIZE, MASK_SIZE, std::vector<int>(1, maskBand), GRA_Mode);
+
+  if (maskTile->dataset->GetRasterBand(1)->RasterIO(GF_Read, 0, 0, MASK_SIZE, MASK_SIZE,
+                                                    (void *) rasterMask, MASK_SIZE, MASK_SIZE, GDT_Byte,
+                                                    0, 0) != CE_None) {
+    delete maskTile;
+    throw CTBException("Could not read water mask from raster");
+  }
+  delete maskTile;
+
+  // Any non-zero value is water
+  for (unsigned int i = 0; i < MASK_SIZE * MASK_SIZE; i++) {
+    if (rasterMask[i]) rasterMask[i] = 255;
+  }
+}
+
 /// Create a raster tile from a tile coordinate
 GDALTile *
 ctb::GDALDatasetReader::createRasterTile(const GDALTiler &tiler, GDALDataset *dataset, const TileCoordinate &coord) {
   return tiler.createRasterTile(dataset, coord);
 }
 
+/// Create a raster of any size from a geo transform
+GDALTile *
+ctb::GDALDatasetReader::createRasterTile(const GDALTiler &tiler, GDALDataset *dataset, double (&adfGeoTransform)[6], int xSize, int ySize) {
+  return tiler.createRasterTile(dataset, adfGeoTransform, xSize, ySize);
+}
+
+/// Create a raster of any size from some bands of a dataset
+GDALTile *
+ctb::GDALDatasetReader::createRasterTile(const GDALTiler &tiler, GDALDataset *dataset, double (&adfGeoTransform)[6], int xSize, int ySize, const std::vector<int> &bands) {
+  return tiler.createRasterTile(dataset, adfGeoTransform, xSize, ySize, bands);
+}
+
 /// Create a VTR raster overview from a GDALDataset
 GDALDataset *
 ctb::GDALDatasetReader::createOverview(const GDALTiler &tiler, GDALDataset *dataset, const TileCoordinate &coord, int overviewIndex) {
@@ -91,14 +188,11 @@ ctb::GDALDatasetReaderWithOverviews::~GDALDatasetReaderWithOverviews() {
   reset();
 }
 
-/// Read a region of raster heights into an array for the specified Dataset and Coordinate
-float *
-ctb::GDALDatasetReaderWithOverviews::readRasterHeights(GDALDataset *dataset, const TileCoordinate &coord, ctb::i_tile tileSizeX, ctb::i_tile tileSizeY) {
+/// Read a region of raster heights into an array of the caller for the specified Dataset and Coordinate
+void
+ctb::GDALDatasetReaderWithOverviews::readRasterHeightsInto(GDALDataset *dataset, const TileCoordinate &coord, ctb::i_tile tileSizeX, ctb::i_tile tileSizeY, float *rasterHeights, unsigned char *rasterMask) {
   GDALDataset *mainDataset = dataset;
 
-  const ctb::i_tile TILE_CELL_SIZE = tileSizeX * tileSizeY;
-  float *rasterHeights = (float *)CPLCalloc(TILE_CELL_SIZE, sizeof(float));
-
   // Replace GDAL Dataset by last valid Overview.
   for (int i = mOverviews.size() - 1; i >= 0; --i) {
     if (mOverviews[i]) {
@@ -107,12 +201,18 @@ ctb::GDALDatasetReaderWithOverviews::readRasterHeights(GDALDataset *dataset, con
     }
   }
 
+  // Otherwise use a shared overview at the resolution of the tile
+  if (dataset == mainDataset) {
+    GDALDataset *poOverview = getCachedOverview(dataset, coord);
+    if (poOverview) dataset = poOverview;
+  }
+
   // Extract the raster data, using overviews when necessary
   bool rasterOk = false;
   while (!rasterOk) {
     GDALTile *rasterTile = createRasterTile(poTiler, dataset, coord); // the raster associated with this tile coordinate
 
-    GDALRasterBand *heightsBand = rasterTile->dataset->GetRasterBand(1);
+    GDALRasterBand *heightsBand = getHeightsBand(poTiler, rasterTile);
 
     if (heightsBand->RasterIO(GF_Read, 0, 0, tileSizeX, tileSizeY,
                               (void *) rasterHeights, tileSizeX, tileSizeY, GDT_Float32,
@@ -125,7 +225,6 @@ ctb::GDALDatasetReaderWithOverviews::readRasterHeights(GDALDataset *dataset, con
       }
       else {
         delete rasterTile;
-        CPLFree(rasterHeights);
         throw CTBException("Could not create an overview of current GDAL dataset");
       }
     }
@@ -137,10 +236,46 @@ ctb::GDALDatasetReaderWithOverviews::readRasterHeights(GDALDataset *dataset, con
 
   // Everything ok?
   if (!rasterOk) {
-    CPLFree(rasterHeights);
     throw CTBException("Could not read heights from raster");
   }
-  return rasterHeights;
+
+  // The overviews only hold the heights
+  if (rasterMask) {
+    readRasterMask(poTiler, mainDataset, coord, rasterMask);
+  }
+}
+
+/**
+ * @details The reduction factor is the largest power of two not exceeding the
+ * ratio of the tile resolution to the source resolution, so the overview is
+ * never coarser than the tile.  Sources with their own overviews are left to
+ * GDAL.  A handle is opened once per factor, including a `NULL` one when the
+ * cache cannot provide the overview, so it is not requested again.
+ */
+GDALDataset *
+ctb::GDALDatasetReaderWithOverviews::getCachedOverview(GDALDataset *dataset, const TileCoordinate &coord) {
+  if (dataset != poTiler.dataset() || dataset->GetRasterBand(1)->GetOverviewCount() > 0) {
+    return NULL;
+  }
+
+  const double ratio = poTiler.grid().resolution(coord.zoom) / poTiler.resolution();
+  int factor = 1;
+  while (factor * 2 <= ratio) factor *= 2;
+
+  if (factor < 2) {
+    return NULL;
+  }
+
+  std::map<int, GDALDataset *>::const_iterator it = mCachedOverviews.find(factor);
+  if (it != mCachedOverviews.end()) {
+    return it->second;
+  }
+
+  const std::string filename = OverviewCache::getOverview(dataset, getWarpBands(poTiler, dataset), factor);
+  GDALDataset *poOverview = filename.empty() ? NULL : (GDALDataset *) GDALOpen(filename.c_str(), GA_ReadOnly);
+
+  mCachedOverviews[factor] = poOverview;
+  return poOverview;
 }
 
 /// Releases all overviews
@@ -153,4 +288,459 @@ ctb::GDALDatasetReaderWithOverviews::reset() {
     GDALClose(poOverview);
   }
   mOverviews.clear();
+
+  for (std::map<int, GDALDataset *>::iterator it = mCachedOverviews.begin(); it != mCachedOverviews.end(); ++it) {
+    if (it->second) GDALClose(it->second);
+  }
+  mCachedOverviews.clear();
+}
+
+/**
+ * @details The levels are only recorded for a terrain or mesh tiler whose
+ * dataset needs no reprojection and has a north up geo transform.
+ */
+ctb::GDALDatasetReaderAligned::GDALDatasetReaderAligned(const GDALTiler &tiler):
+  GDALDatasetReaderWithOverviews(tiler),
+  mNoDataValue(-32768)
+{
+  GDALDataset *dataset = tiler.dataset();
+  double adfGeoTransform[6];
+
+  if (dynamic_cast<const TerrainTiler *>(&tiler) == NULL || tiler.requiresReprojection() ||
+      dataset->GetGeoTransform(adfGeoTransform) != CE_None ||
+      adfGeoTransform[2] != 0 || adfGeoTransform[4] != 0 || adfGeoTransform[1] != -adfGeoTransform[5]) {
+    return;
+  }
+
+  GDALRasterBand *heightsBand = getHeightsBand(tiler);
+  if (heightsBand == NULL) {
+    return;
+  }
+
+  int bGotNoData = FALSE;
+  const double noDataValue = heightsBand->GetNoDataValue(&bGotNoData);
+  if (bGotNoData) mNoDataValue = noDataValue;
+
+  Level level = { heightsBand, adfGeoTransform[0], adfGeoTransform[3], adfGeoTransform[1] };
+  mLevels.push_back(level);
+
+  for (int i = 0; i < heightsBand->GetOverviewCount(); i++) {
+    level.band = heightsBand->GetOverview(i);
+    level.resolution = adfGeoTransform[1] * dataset->GetRasterXSize() / level.band->GetXSize();
+    mLevels.push_back(level);
+  }
+}
+
+/**
+ * @details A level matches if its resolution is that of the samples and the
+ * samples fall on its pixel centres, within a thousandth of a pixel.
+ */
+bool
+ctb::GDALDatasetReaderAligned::findAlignedLevel(const TileCoordinate &coord, ctb::i_tile tileSizeX, const Level *&level, int &col, int &row) const {
+  const TerrainTiler &tiler = static_cast<const TerrainTiler &>(poTiler);
+
+  if (tileSizeX != tiler.grid().tileSize()) {
+    return false;
+  }
+
+  double resolution;
+  const CRSBounds bounds = tiler.sampleBounds(coord, resolution);
+
+  for (size_t i = 0; i < mLevels.size(); i++) {
+    if (std::fabs(mLevels[i].resolution / resolution - 1) > 1e-6) continue;
+
+    const double x = (bounds.getMinX() - mLevels[i].west) / resolution,
+      y = (mLevels[i].north - bounds.getMaxY()) / resolution;
+
+    if (std::fabs(x - std::round(x)) > 1e-3 || std::fabs(y - std::round(y)) > 1e-3) {
+      return false;
+    }
+
+    level = &mLevels[i];
+    col = (int) std::round(x);
+    row = (int) std::round(y);
+    return true;
+  }
+  return false;
+}
+
+/**
+ * @details The samples outside the level are set to the nodata value of the
+ * heights, as a warp would.
+ */
+void
+ctb::GDALDatasetReaderAligned::readRasterHeightsInto(GDALDataset *dataset, const TileCoordinate &coord, ctb::i_tile tileSizeX, ctb::i_tile tileSizeY, float *rasterHeights, unsigned char *rasterMask) {
+  const Level *level;
+  int col, row;
+
+  if (dataset != poTiler.dataset() || !findAlignedLevel(coord, tileSizeX, level, col, row)) {
+    GDALDatasetReaderWithOverviews::readRasterHeightsInto(dataset, coord, tileSizeX, tileSizeY, rasterHeights, rasterMask);
+    return;
+  }
+
+  const ctb::i_tile TILE_CELL_SIZE = tileSizeX * tileSizeY;
+  std::fill(rasterHeights, rasterHeights + TILE_CELL_SIZE, (float) mNoDataValue);
+
+  // Clip the samples to the level
+  const int startCol = std::max(col, 0),
+    startRow = std::max(row, 0),
+    endCol = std::min(col + (int) tileSizeX, level->band->GetXSize()),
+    endRow = std::min(row + (int) tileSizeY, level->band->GetYSize());
+
+  if (startCol < endCol && startRow < endRow) {
+    float *target = rasterHeights + (size_t) (startRow - row) * tileSizeX + (startCol - col);
+
+    if (level->band->RasterIO(GF_Read, startCol, startRow, endCol - startCol, endRow - startRow,
+                              (void *) target, endCol - startCol, endRow - startRow, GDT_Float32,
+                              sizeof(float), (GSpacing) tileSizeX * sizeof(float)) != CE_None) {
+      throw CTBException("Could not read heights from raster");
+    }
+  }
+
+  if (rasterMask) {
+    readRasterMask(poTiler, dataset, coord, rasterMask);
+  }
+}
+
+/// The most height samples warped at once by a `GDALDatasetReaderStreaming`
+static const size_t STREAMING_MAX_SAMPLES = 1 << 22;
+
+/**
+ * @details A strip holds as many tiles as fit in `STREAMING_MAX_SAMPLES`
+ * samples, and at least one.
+ */
+ctb::GDALDatasetReaderStreaming::GDALDatasetReaderStreaming(const TerrainTiler &tiler, ctb::i_zoom zoom):
+  GDALDatasetReaderWithOverviews(tiler),
+  mZoom(zoom),
+  mBounds(tiler.tileBoundsForZoom(zoom)),
+  mRow(0),
+  mStrip(0),
+  mHasStrip(false),
+  mWidth(0)
+{
+  if (!tiler.sharesEdgeSamples()) {
+    throw CTBException("Only the tiles sharing their edge samples can be streamed");
+  }
+
+  const size_t tileSize = tiler.grid().tileSize();
+  mStripTiles = std::max<size_t>((STREAMING_MAX_SAMPLES / tileSize - 1) / (tileSize - 1), 1);
+}
+
+/**
+ * @details Neighbouring tiles share their edge samples, so a strip of `N`
+ * tiles is warped as `N * (tileSize - 1) + 1` samples wide with the samples of
+ * each tile laid out as by `TerrainTiler::terrainTileBounds`.
+ */
+void
+ctb::GDALDatasetReaderStreaming::warpStrip(GDALDataset *dataset, ctb::i_tile y, size_t strip) {
+  const TerrainTiler &tiler = static_cast<const TerrainTiler &>(poTiler);
+  const i_tile tileSize = tiler.grid().tileSize();
+  const i_tile minX = mBounds.getMinX() + strip * mStripTiles;
+  const size_t tiles = std::min<size_t>(mStripTiles, mBounds.getMaxX() - minX + 1);
+
+  double resolution;
+  const CRSBounds bounds = tiler.terrainTileBounds(TileCoordinate(mZoom, minX, y), resolution);
+  double adfGeoTransform[6] = { bounds.getMinX(), resolution, 0, bounds.getMaxY(), 0, -resolution };
+
+  // The warp takes the width as an `int`
+  const int64_t width = (int64_t) tiles * (tileSize - 1) + 1;
+  if (width > INT_MAX || (uint64_t) width * tileSize > SIZE_MAX / sizeof(float)) {
+    throw CTBException("The strip of tiles is too wide to be warped at once");
+  }
+
+  mHasStrip = false;
+  mWidth = (size_t) width;
+  mHeights.resize(mWidth * tileSize);
+
+  GDALTile *rasterTile = createRasterTile(poTiler, dataset, adfGeoTransform, (int) mWidth, tileSize);
+  GDALRasterBand *heightsBand = getHeightsBand(poTiler, rasterTile);
+
+  if (heightsBand->RasterIO(GF_Read, 0, 0, (int) mWidth, tileSize,
+                            (void *) mHeights.data(), (int) mWidth, tileSize, GDT_Float32,
+                            0, 0) != CE_None) {
+    delete rasterTile;
+    throw CTBException("Could not read heights from raster");
+  }
+  delete rasterTile;
+
+  mRow = y;
+  mStrip = strip;
+  mHasStrip = true;
+}
+
+/**
+ * @details The water mask is not on the lattice of the heights, so it is
+ * warped for each tile by `readRasterMask`.
+ */
+void
+ctb::GDALDatasetReaderStreaming::readRasterHeightsInto(GDALDataset *dataset, const TileCoordinate &coord, ctb::i_tile tileSizeX, ctb::i_tile tileSizeY, float *rasterHeights, unsigned char *rasterMask) {
+  const i_tile tileSize = poTiler.grid().tileSize();
+
+  if (coord.zoom != mZoom || dataset != poTiler.dataset() ||
+      tileSizeX != tileSize || tileSizeY != tileSize ||
+      coord.x < mBounds.getMinX() || coord.x > mBounds.getMaxX()) {
+    GDALDatasetReaderWithOverviews::readRasterHeightsInto(dataset, coord, tileSizeX, tileSizeY, rasterHeights, rasterMask);
+    return;
+  }
+
+  const size_t index = coord.x - mBounds.getMinX(),
+    strip = index / mStripTiles;
+  if (!mHasStrip || coord.y != mRow || strip != mStrip) {
+    warpStrip(dataset, coord.y, strip);
+  }
+
+  const size_t col = (index - strip * mStripTiles) * (tileSize - 1);
+
+  for (i_tile row = 0; row < tileSize; row++) {
+    std::copy_n(mHeights.begin() + row * mWidth + col, tileSize, rasterHeights + row * tileSize);
+  }
+
+  if (rasterMask) {
+    readRasterMask(poTiler, dataset, coord, rasterMask);
+  }
+}
+
+ctb::GDALDatasetReaderMosaic::GDALDatasetReaderMosaic(const TerrainTiler &tiler, SourceMosaic &mosaic):
+  poTiler(tiler),
+  mMosaic(mosaic),
+  mNoDataValue(-32768)
+{
+  int bGotNoData = FALSE;
+  const double noDataValue = getHeightsBand(tiler)->GetNoDataValue(&bGotNoData);
+  if (bGotNoData) mNoDataValue = (float) noDataValue;
+}
+
+/**
+ * @details The samples are laid out as by `TerrainTiler::sampleBounds`.
+ * The sources are read in the order chosen by `SourceMosaic::select` for the
+ * resolution of the zoom level.  A sample is taken from a source unless the
+ * source has its nodata value there.  Each pixel of the water mask is taken
+ * from the source of the height sample nearest to it, warped as by
+ * `readRasterMask`.  Samples no source covers are set to the nodata value of
+ * the mosaic, and their mask pixels to land.
+ */
+void
+ctb::GDALDatasetReaderMosaic::readRasterHeightsInto(GDALDataset *, const TileCoordinate &coord, ctb::i_tile tileSizeX, ctb::i_tile tileSizeY, float *rasterHeights, unsigned char *rasterMask) {
+  double resolution;
+  const CRSBounds bounds = poTiler.sampleBounds(coord, resolution);
+  double adfGeoTransform[6] = { bounds.getMinX(), resolution, 0, bounds.getMaxY(), 0, -resolution };
+
+  const size_t sampleCount = (size_t) tileSizeX * tileSizeY;
+  const std::vector<int> bands = getWarpBands(poTiler, poTiler.dataset());
+  size_t remaining = sampleCount;
+
+  const std::vector<size_t> sources = mMosaic.select(bounds, poTiler.grid().resolution(coord.zoom));
+
+  std::fill(rasterHeights, rasterHeights + sampleCount, mNoDataValue);
+  mSourceHeights.resize(sampleCount);
+  mSampleSource.assign(sampleCount, sources.size());
+  if (rasterMask) std::fill(rasterMask, rasterMask + MASK_SIZE * MASK_SIZE, 0);
+
+  for (size_t i = 0; i < sources.size() && remaining; i++) {
+    GDALDataset *poSource = mMosaic.acquire(sources[i]);
+    GDALTile *rasterTile = NULL;
+    double noDataValue = -32768;
+
+    try {
+      rasterTile = createRasterTile(poTiler, poSource, adfGeoTransform, tileSizeX, tileSizeY, bands);
+      GDALRasterBand *heightsBand = getHeightsBand(poTiler, rasterTile);
+
+      int bGotNoData = FALSE;
+      const double bandNoDataValue = heightsBand->GetNoDataValue(&bGotNoData);
+      if (bGotNoData) noDataValue = bandNoDataValue;
+
+      if (heightsBand->RasterIO(GF_Read, 0, 0, tileSizeX, tileSizeY,
+                                (void *) mSourceHeights.data(), tileSizeX, tileSizeY, GDT_Float32,
+                                0, 0) != CE_None) {
+        throw CTBException("Could not read heights from raster");
+      }
+      delete rasterTile;
+      rasterTile = NULL;
+
+      // Fill the samples this source has data for, a nodata value of `NaN` matching any `NaN`
+      const float sourceNoData = (float) noDataValue;
+      const bool noDataIsNaN = std::isnan(sourceNoData);
+      size_t filled = 0;
+      for (size_t j = 0; j < sampleCount; j++) {
+        const float height = mSourceHeights[j];
+        if (mSampleSource[j] < sources.size() || (noDataIsNaN ? std::isnan(height) : height == sourceNoData)) continue;
+
+        rasterHeights[j] = height;
+        mSampleSource[j] = i;
+        filled++;
+      }
+      remaining -= filled;
+
+      if (rasterMask && filled) {
+        mSourceMask.resize(MASK_SIZE * MASK_SIZE);
+        readRasterMask(poTiler, poSource, coord, mSourceMask.data());
+
+        for (unsigned int y = 0; y < MASK_SIZE; y++) {
+          const size_t row = (2 * y + 1) * tileSizeY / (2 * MASK_SIZE);
+
+          for (unsigned int x = 0; x < MASK_SIZE; x++) {
+            const size_t sample = (2 * x + 1) * tileSizeX / (2 * MASK_SIZE);
+            if (mSampleSource[row * tileSizeX + sample] == i) {
+              rasterMask[y * MASK_SIZE + x] = mSourceMask[y * MASK_SIZE + x];
+            }
+          }
+        }
+      }
+    } catch (CTBException &e) {
+      delete rasterTile;
+      mMosaic.release(sources[i], poSource);
+      throw;
+    }
+    mMosaic.release(sources[i], poSource);
+  }
+}
+
+/// The number of tiles kept by a `GDALDatasetReaderFilled`
+static const size_t FILLED_READER_TILES = 16;
+
+ctb::GDALDatasetReaderFilled::GDALDatasetReaderFilled(const TerrainTiler &tiler, GDALDatasetReader &reader, int distance):
+  poTiler(tiler),
+  mReader(reader),
+  mDistance(distance),
+  mNoDataValue(-32768)
+{
+  if (distance < 0 || distance >= (int) tiler.grid().tileSize()) {
+    throw CTBException("The nodata fill distance must be positive and less than the tile size");
+  }
+
+  int bGotNoData = FALSE;
+  const double noDataValue = getHeightsBand(tiler)->GetNoDataValue(&bGotNoData);
+  if (bGotNoData) mNoDataValue = (float) noDataValue;
+  mNoDataIsNaN = std::isnan(mNoDataValue);
+}
+
+const std::vector<float> &
+ctb::GDALDatasetReaderFilled::readApronTile(GDALDataset *dataset, const TileCoordinate &coord) {
+  for (auto it = mTiles.begin(); it != mTiles.end(); ++it) {
+    if (it->first == coord) {
+      mTiles.splice(mTiles.begin(), mTiles, it);
+      return mTiles.front().second;
+    }
+  }
+
+  // Reuse the least recently used tile once the cache is full
+  if (mTiles.size() < FILLED_READER_TILES) {
+    mTiles.push_front(std::make_pair(coord, std::vector<float>()));
+  } else {
+    mTiles.splice(mTiles.begin(), mTiles, std::prev(mTiles.end()));
+    mTiles.front().first = coord;
+  }
+
+  const i_tile tileSize = poTiler.grid().tileSize();
+  const TileBounds extent = poTiler.grid().getTileExtent(coord.zoom);
+  std::vector<float> &heights = mTiles.front().second;
+  heights.assign((size_t) tileSize * tileSize, mNoDataValue);
+
+  // Tiles without data in the coverage index are not read
+  const std::shared_ptr<const CoverageIndex> &coverage = poTiler.tilerOptions().coverage;
+  if (coord.x <= extent.getMaxX() && coord.y <= extent.getMaxY() && poTiler.bounds().overlaps(poTiler.grid().tileBounds(coord)) &&
+      (!coverage || coverage->hasData(coord))) {
+    try {
+      mReader.readRasterHeightsInto(dataset, coord, tileSize, tileSize, heights.data());
+    } catch (CTBException &e) {
+      mTiles.pop_front();
+      throw;
+    }
+  }
+
+  return heights;
+}
+
+/**
+ * @details The apron is laid out as the square of the tile and its
+ * neighbours, `3 * (tileSize - 1) + 1` samples wide when they share their
+ * edge samples and `3 * tileSize` otherwise, as elevation images do.  A
+ * hole is given the average of the valid samples within the distance weighted
+ * by the inverse of their squared distance, reading only the samples of the
+ * source so the result does not depend on the order the holes are filled in.
+ */
+void
+ctb::GDALDatasetReaderFilled::readRasterHeightsInto(GDALDataset *dataset, const TileCoordinate &coord, ctb::i_tile tileSizeX, ctb::i_tile tileSizeY, float *rasterHeights, unsigned char *rasterMask) {
+  const i_tile tileSize = poTiler.grid().tileSize();
+  mReader.readRasterHeightsInto(dataset, coord, tileSizeX, tileSizeY, rasterHeights, rasterMask);
+
+  if (mDistance == 0 || tileSizeX != tileSize || tileSizeY != tileSize ||
+      std::none_of(rasterHeights, rasterHeights + tileSize * tileSize, [this](float height) { return isNoData(height); })) {
+    return;
+  }
+
+  const bool empty = std::all_of(rasterHeights, rasterHeights + tileSize * tileSize, [this](float height) { return isNoData(height); });
+
+  // An empty tile with no data around it in the coverage index stays empty
+  const std::shared_ptr<const CoverageIndex> &coverage = poTiler.tilerOptions().coverage;
+  if (empty && coverage) {
+    bool dataAround = false;
+    for (int dy = -1; dy <= 1 && !dataAround; dy++) {
+      for (int dx = -1; dx <= 1 && !dataAround; dx++) {
+        if ((!dx && !dy) || (dx < 0 && coord.x == 0) || (dy < 0 && coord.y == 0)) continue;
+        dataAround = coverage->hasData(TileCoordinate(coord.zoom, coord.x + dx, coord.y + dy));
+      }
+    }
+    if (!dataAround) return;
+  }
+
+  // Assemble the apron, the rows from the north
+  const size_t step = poTiler.sharesEdgeSamples() ? tileSize - 1 : tileSize,
+    width = 2 * step + tileSize;
+  std::vector<float> &apron = mApron;
+  apron.assign(width * width, mNoDataValue);
+
+  for (int dy = -1; dy <= 1; dy++) {
+    for (int dx = -1; dx <= 1; dx++) {
+      const float *heights = rasterHeights;
+
+      if (dx || dy) {
+        if ((dx < 0 && coord.x == 0) || (dy < 0 && coord.y == 0)) continue;
+        heights = readApronTile(dataset, TileCoordinate(coord.zoom, coord.x + dx, coord.y + dy)).data();
+      }
+
+      const size_t col = (dx + 1) * step, row = (1 - dy) * step;
+      for (i_tile i = 0; i < tileSize; i++) {
+        std::copy_n(heights + i * tileSize, tileSize, apron.begin() + (row + i) * width + col);
+      }
+    }
+  }
+
+  // An empty tile with no valid sample within the distance of its edges stays empty
+  if (empty) {
+    const size_t start = step - mDistance, end = step + tileSize + mDistance;
+    bool dataAround = false;
+    for (size_t row = start; row < end && !dataAround; row++) {
+      const float *first = apron.data() + row * width;
+      dataAround = std::any_of(first + start, first + end, [this](float height) { return !isNoData(height); });
+    }
+    if (!dataAround) return;
+  }
+
+  // Fill the holes of the tile
+  const int distance2 = mDistance * mDistance;
+  for (i_tile i = 0; i < tileSize; i++) {
+    for (i_tile j = 0; j < tileSize; j++) {
+      float &height = rasterHeights[i * tileSize + j];
+      if (!isNoData(height)) continue;
+
+      const int row = i + step, col = j + step;
+      double sum = 0, weights = 0;
+
+      for (int di = -mDistance; di <= mDistance; di++) {
+        for (int dj = -mDistance; dj <= mDistance; dj++) {
+          const int d2 = di * di + dj * dj;
+          if (d2 == 0 || d2 > distance2) continue;
+
+          const float sample = apron[(row + di) * width + col + dj];
+          if (isNoData(sample)) continue;
+
+          sum += sample / (double) d2;
+          weights += 1 / (double) d2;
+        }
+      }
+
+      if (weights > 0) height = (float) (sum / weights);
+    }
+  }
 }
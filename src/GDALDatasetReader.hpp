@@ -22,8 +22,11 @@
  * @brief This declares the `GDALDatasetReader` class
  */
 
+#include <list>
+#include <map>
 #include <string>
 #include <vector>
+#include <cmath>
 #include "gdalwarper.h"
 
 #include "TileCoordinate.hpp"
@@ -32,6 +35,12 @@
 namespace ctb {
   class GDALDatasetReader;
   class GDALDatasetReaderWithOverviews;
+  class GDALDatasetReaderAligned;
+  class GDALDatasetReaderStreaming;
+  class GDALDatasetReaderMosaic;
+  class GDALDatasetReaderFilled;
+  class SourceMosaic;           // forward declaration
+  class TerrainTiler;           // forward declaration
 }
 
 /**
@@ -45,19 +54,60 @@ namespace ctb {
  */
 class CTB_DLL ctb::GDALDatasetReader {
 public:
-  /// Read a region of raster heights into an array for the specified Dataset and Coordinate
+  virtual ~GDALDatasetReader() {}
+
+  /**
+   * @brief Read a region of raster heights into an array for the specified Dataset and Coordinate
+   *
+   * If `rasterMask` is set the water mask band of the tiler options is warped
+   * over the bounds of the tile into it, as `MASK_SIZE * MASK_SIZE` values of
+   * `0` (land) or `255` (water).
+   */
   static float *
-  readRasterHeights(const GDALTiler &tiler, GDALDataset *dataset, const TileCoordinate &coord, ctb::i_tile tileSizeX, ctb::i_tile tileSizeY);
+  readRasterHeights(const GDALTiler &tiler, GDALDataset *dataset, const TileCoordinate &coord, ctb::i_tile tileSizeX, ctb::i_tile tileSizeY, unsigned char *rasterMask = NULL);
 
-  /// Read a region of raster heights into an array for the specified Dataset and Coordinate
+  /// Read a region of raster heights (and optionally the water mask) into an array for the specified Dataset and Coordinate
   virtual float *
-  readRasterHeights(GDALDataset *dataset, const TileCoordinate &coord, ctb::i_tile tileSizeX, ctb::i_tile tileSizeY) = 0;
+  readRasterHeights(GDALDataset *dataset, const TileCoordinate &coord, ctb::i_tile tileSizeX, ctb::i_tile tileSizeY, unsigned char *rasterMask = NULL);
+
+  /**
+   * @brief Read a region of raster heights (and optionally the water mask) into an array of the caller
+   *
+   * The array holds `tileSizeX * tileSizeY` heights, so a buffer can be
+   * reused from one tile to the next.
+   */
+  virtual void
+  readRasterHeightsInto(GDALDataset *dataset, const TileCoordinate &coord, ctb::i_tile tileSizeX, ctb::i_tile tileSizeY, float *rasterHeights, unsigned char *rasterMask = NULL) = 0;
 
 protected:
+  /// Get the band of a raster tile holding the heights
+  static GDALRasterBand *
+  getHeightsBand(const GDALTiler &tiler, GDALTile *rasterTile);
+
+  /// Get the band of the dataset of a tiler holding the heights
+  static GDALRasterBand *
+  getHeightsBand(const GDALTiler &tiler);
+
+  /// Get the source bands warped by a tiler
+  static std::vector<int>
+  getWarpBands(const GDALTiler &tiler, GDALDataset *dataset);
+
+  /// Warp the water mask band of a dataset over the bounds of a tile
+  static void
+  readRasterMask(const GDALTiler &tiler, GDALDataset *dataset, const TileCoordinate &coord, unsigned char *rasterMask);
+
   /// Create a raster tile from a tile coordinate
   static GDALTile *
   createRasterTile(const GDALTiler &tiler, GDALDataset *dataset, const TileCoordinate &coord);
 
+  /// Create a raster of any size from a geo transform
+  static GDALTile *
+  createRasterTile(const GDALTiler &tiler, GDALDataset *dataset, double (&adfGeoTransform)[6], int xSize, int ySize);
+
+  /// Create a raster of any size from some bands of a dataset
+  static GDALTile *
+  createRasterTile(const GDALTiler &tiler, GDALDataset *dataset, double (&adfGeoTransform)[6], int xSize, int ySize, const std::vector<int> &bands);
+
   /// Create a VTR raster overview from a GDALDataset
   static GDALDataset *
   createOverview(const GDALTiler &tiler, GDALDataset *dataset, const TileCoordinate &coord, int overviewIndex);
@@ -68,6 +118,11 @@ protected:
  * 
  * This class creates Overviews to avoid 'Integer overflow' errors when extracting 
  * raster data.
+ *
+ * When the source dataset has no overviews of its own, tiles much coarser
+ * than the source are read from the reduced resolution copies of the shared
+ * `OverviewCache`, picked from the ratio of the tile and source resolutions.
+ * The overviews created after a failed read are kept as a fallback.
  */
 class CTB_DLL ctb::GDALDatasetReaderWithOverviews : public ctb::GDALDatasetReader {
 public:
@@ -80,14 +135,18 @@ public:
   /// The destructor
   ~GDALDatasetReaderWithOverviews();
 
-  /// Read a region of raster heights into an array for the specified Dataset and Coordinate
-  virtual float *
-  readRasterHeights(GDALDataset *dataset, const TileCoordinate &coord, ctb::i_tile tileSizeX, ctb::i_tile tileSizeY) override;
+  /// Read a region of raster heights into an array of the caller for the specified Dataset and Coordinate
+  virtual void
+  readRasterHeightsInto(GDALDataset *dataset, const TileCoordinate &coord, ctb::i_tile tileSizeX, ctb::i_tile tileSizeY, float *rasterHeights, unsigned char *rasterMask = NULL) override;
 
   /// Releases all overviews
   void reset();
 
 protected:
+  /// Get a handle on the cached overview matching the resolution of a tile, if any
+  GDALDataset *
+  getCachedOverview(GDALDataset *dataset, const TileCoordinate &coord);
+
   /// The tiler to use
   const GDALTiler &poTiler;
 
@@ -95,6 +154,192 @@ protected:
   std::vector<GDALDataset *> mOverviews;
   /// Current VRT Overview
   int mOverviewIndex;
+  /// Handles on the cached overviews, by reduction factor
+  std::map<int, GDALDataset *> mCachedOverviews;
+};
+
+/**
+ * @brief Implements a GDALDatasetReader that reads aligned datasets without warping
+ *
+ * A dataset prepared by `ctb-prepare` is in the coordinate reference system
+ * of the grid, and its pixels and overviews line up with the height samples
+ * of the terrain and mesh tiles.  The heights of a tile are then read from
+ * the matching level straight into the array, which for an uncompressed
+ * GeoTIFF is a copy from the file mapped in memory.  Any other tile or
+ * dataset is read as by `GDALDatasetReaderWithOverviews`.
+ */
+class CTB_DLL ctb::GDALDatasetReaderAligned : public ctb::GDALDatasetReaderWithOverviews {
+public:
+
+  /// Instantiate a GDALDatasetReaderAligned
+  GDALDatasetReaderAligned(const GDALTiler &tiler);
+
+  /// Read a region of raster heights into an array of the caller for the specified Dataset and Coordinate
+  virtual void
+  readRasterHeightsInto(GDALDataset *dataset, const TileCoordinate &coord, ctb::i_tile tileSizeX, ctb::i_tile tileSizeY, float *rasterHeights, unsigned char *rasterMask = NULL) override;
+
+protected:
+  /// The heights band of the dataset or of one of its overviews
+  struct Level {
+    GDALRasterBand *band;
+    double west, north;         ///< The upper left corner
+    double resolution;          ///< The pixel size
+  };
+
+  /**
+   * @brief Find the level whose pixels are the height samples of a tile
+   *
+   * This sets the level and the upper left pixel of the samples, which may
+   * lie outside the level, and returns `false` if no level matches.
+   */
+  bool
+  findAlignedLevel(const TileCoordinate &coord, ctb::i_tile tileSizeX, const Level *&level, int &col, int &row) const;
+
+  /// The levels from the finest, empty if the dataset cannot be read directly
+  std::vector<Level> mLevels;
+
+  /// The value of the heights outside the dataset
+  double mNoDataValue;
+};
+
+/**
+ * @brief Implements a GDALDatasetReader that warps a strip of a row of tiles at a time
+ *
+ * The tiles of one zoom level are read from a single warp of a strip of the
+ * row of tiles they belong to, which is kept until a tile of another strip
+ * is requested.  Requesting the tiles a row at a time from the north reads
+ * the source from top to bottom, which suits sources that only read
+ * efficiently in that order, while the memory used is bounded by one strip,
+ * however wide the zoom level.  Tiles of other zoom levels are read as by
+ * `GDALDatasetReaderWithOverviews`.
+ */
+class CTB_DLL ctb::GDALDatasetReaderStreaming : public ctb::GDALDatasetReaderWithOverviews {
+public:
+
+  /// Instantiate a GDALDatasetReaderStreaming for a zoom level
+  GDALDatasetReaderStreaming(const TerrainTiler &tiler, ctb::i_zoom zoom);
+
+  /// Read a region of raster heights into an array of the caller for the specified Dataset and Coordinate
+  virtual void
+  readRasterHeightsInto(GDALDataset *dataset, const TileCoordinate &coord, ctb::i_tile tileSizeX, ctb::i_tile tileSizeY, float *rasterHeights, unsigned char *rasterMask = NULL) override;
+
+protected:
+  /// Warp a strip of the row of tiles of the zoom level at a `y` coordinate
+  void
+  warpStrip(GDALDataset *dataset, ctb::i_tile y, size_t strip);
+
+  /// The zoom level of the rows
+  ctb::i_zoom mZoom;
+  /// The tiles of the zoom level
+  TileBounds mBounds;
+
+  /// The number of tiles of a strip
+  size_t mStripTiles;
+
+  /// The `y` coordinate of the row of the current strip
+  ctb::i_tile mRow;
+  /// The index of the current strip in its row
+  size_t mStrip;
+  /// Has a strip been warped?
+  bool mHasStrip;
+  /// The width of the strip in samples
+  size_t mWidth;
+  /// The heights of the strip
+  std::vector<float> mHeights;
+};
+
+/**
+ * @brief Implements a GDALDatasetReader that reads the sources of a mosaic
+ *
+ * The dataset of the tiler only describes the extent of the mosaic.  The
+ * heights of a tile are warped from each source whose footprint intersects
+ * the tile, from the source best matching the resolution of the tile, filling
+ * the samples left as nodata by the sources before it, until every sample has
+ * a value.  The sources are warped with the bands the tiler warps from its
+ * dataset, so the sources must have the same layout of bands as the first
+ * source.
+ */
+class CTB_DLL ctb::GDALDatasetReaderMosaic : public ctb::GDALDatasetReader {
+public:
+
+  /// Instantiate a GDALDatasetReaderMosaic
+  GDALDatasetReaderMosaic(const TerrainTiler &tiler, SourceMosaic &mosaic);
+
+  /// Read a region of raster heights into an array of the caller for the specified Dataset and Coordinate
+  virtual void
+  readRasterHeightsInto(GDALDataset *dataset, const TileCoordinate &coord, ctb::i_tile tileSizeX, ctb::i_tile tileSizeY, float *rasterHeights, unsigned char *rasterMask = NULL) override;
+
+protected:
+  /// The tiler to use
+  const TerrainTiler &poTiler;
+
+  /// The sources of the heights
+  SourceMosaic &mMosaic;
+
+  /// The value of the heights without any source
+  float mNoDataValue;
+
+  /// The heights and water mask read from a source, kept from tile to tile
+  std::vector<float> mSourceHeights;
+  std::vector<unsigned char> mSourceMask;
+  /// The index in the selected sources of the source of each sample, past the end if none
+  std::vector<size_t> mSampleSource;
+};
+
+/**
+ * @brief Implements a GDALDatasetReader that fills nodata holes in the heights
+ *
+ * The heights are read by another reader.  When a terrain or mesh tile has
+ * nodata samples, the eight tiles around it are read as well to form an apron,
+ * and each hole is filled by inverse distance weighting of the valid samples
+ * within a maximum distance.  Holes further than that from any valid sample
+ * are left as nodata.  As the apron covers the maximum distance, a sample on
+ * the edge shared by two tiles is filled with the same value in both.
+ *
+ * The last tiles read are kept, so tiles iterated next to each other share
+ * most of their apron.  Tiles without data in the coverage index of the tiler
+ * are not read, and a tile without any valid sample is left alone when no
+ * valid sample lies within the maximum distance of it.
+ */
+class CTB_DLL ctb::GDALDatasetReaderFilled : public ctb::GDALDatasetReader {
+public:
+
+  /// Instantiate a GDALDatasetReaderFilled with a distance in samples, at most the tile size less one
+  GDALDatasetReaderFilled(const TerrainTiler &tiler, GDALDatasetReader &reader, int distance);
+
+  /// Read a region of raster heights into an array of the caller for the specified Dataset and Coordinate
+  virtual void
+  readRasterHeightsInto(GDALDataset *dataset, const TileCoordinate &coord, ctb::i_tile tileSizeX, ctb::i_tile tileSizeY, float *rasterHeights, unsigned char *rasterMask = NULL) override;
+
+protected:
+  /// Get the heights of a tile around the one being filled, nodata outside the dataset
+  const std::vector<float> &
+  readApronTile(GDALDataset *dataset, const TileCoordinate &coord);
+
+  /// Is a height nodata?
+  inline bool
+  isNoData(float height) const {
+    return mNoDataIsNaN ? std::isnan(height) : height == mNoDataValue;
+  }
+
+  /// The tiler to use
+  const TerrainTiler &poTiler;
+
+  /// The reader of the heights
+  GDALDatasetReader &mReader;
+
+  /// The maximum distance of the filled samples to valid ones, in samples
+  int mDistance;
+
+  /// The value of the holes
+  float mNoDataValue;
+  bool mNoDataIsNaN;
+
+  /// The heights of the last tiles read, most recently used first
+  std::list<std::pair<TileCoordinate, std::vector<float> > > mTiles;
+
+  /// The apron of the tile being filled
+  std::vector<float> mApron;
 };
 
 #endif /* GDALDATASETREADER_HPP */
@@ -0,0 +1,236 @@
+/*******************************************************************************
+ * Copyright 2018 GeoData <geodata@soton.ac.uk>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not
+ * use this file except in compliance with the License.  You may obtain a copy
+ * of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ *******************************************************************************/
+
+/**
+ * @file GDALTileEncoder.cpp
+ * @brief This defines the `GDALTileEncoder` class
+ */
+
+#include <stdlib.h>             // for atoi
+#include <string.h>             // for strcmp
+
+#include "cpl_conv.h"
+#include "cpl_error.h"
+#include "cpl_vsi.h"
+#include "ogr_spatialref.h"
+
+#include "CTBException.hpp"
+#include "GDALTileEncoder.hpp"
+
+using namespace ctb;
+
+/**
+ * @details A PNG encoder is used when the creation options are those the PNG
+ * encoder understands, that is `ZLEVEL` at most.  As with the GDAL driver,
+ * each row takes the filter best suited to it.
+ */
+ctb::GDALTileEncoder::GDALTileEncoder(GDALDriver *driver, const CPLStringList &creationOptions):
+  mDriver(driver),
+  mCreationOptions(creationOptions),
+  mData(NULL),
+  mSize(0)
+{
+  if (!canEncode(driver, creationOptions)) {
+    throw CTBException("The GDAL driver must support virtual IO and write single files to encode tiles in memory");
+  }
+
+  if (strcmp(driver->GetDescription(), "PNG") == 0) {
+    const char *zlevel = mCreationOptions.FetchNameValue("ZLEVEL");
+    const int optionCount = mCreationOptions.size() - (zlevel ? 1 : 0);
+
+    if (optionCount == 0) {
+      mPng.reset(new PngEncoder(PngEncoder::FilterAdaptive, zlevel ? atoi(zlevel) : 6));
+    }
+  }
+
+  // Each encoder copies its tiles to its own directory in memory
+  mDirname = CPLSPrintf("/vsimem/ctb-tile-%p", (void *) this);
+  mFilename = tileFilename(driver, mDirname);
+}
+
+ctb::GDALTileEncoder::~GDALTileEncoder() {
+  VSIRmdirRecursive(mDirname.c_str());
+}
+
+/**
+ * @details The sidecar files of a driver depend on its creation options, such
+ * as `WORLDFILE`, and on the format, such as the `.hdr` file of `ENVI`.  They
+ * are found by copying a georeferenced dataset of one pixel in memory with the
+ * driver.  A driver which cannot copy that dataset is not used to encode
+ * tiles in memory either.
+ */
+bool
+ctb::GDALTileEncoder::canEncode(GDALDriver *driver, const CPLStringList &creationOptions) {
+  if (driver == NULL || driver->pfnCreateCopy == NULL) {
+    return false;
+  }
+
+  const char *virtualIO = driver->GetMetadataItem(GDAL_DCAP_VIRTUALIO);
+  if (virtualIO == NULL || !CPLTestBool(virtualIO)) {
+    return false;
+  }
+
+  GDALDriver *memDriver = GetGDALDriverManager()->GetDriverByName("MEM");
+  if (memDriver == NULL) {
+    return false;
+  }
+  GDALDataset *poSrcDS = memDriver->Create("", 1, 1, 1, GDT_Byte, NULL);
+  if (poSrcDS == NULL) {
+    return false;
+  }
+
+  OGRSpatialReference srs;
+  char *wkt = NULL;
+  srs.SetWellKnownGeogCS("WGS84");
+  srs.exportToWkt(&wkt);
+  double adfGeoTransform[6] = { 0, 1, 0, 0, 0, -1 };
+  poSrcDS->SetGeoTransform(adfGeoTransform);
+  poSrcDS->SetProjection(wkt);
+  CPLFree(wkt);
+
+  const std::string dirname = CPLSPrintf("/vsimem/ctb-probe-%p", (void *) poSrcDS),
+    filename = tileFilename(driver, dirname);
+
+  CPLPushErrorHandler(CPLQuietErrorHandler);
+  CPLStringList options(creationOptions);
+  GDALDataset *poDstDS = driver->CreateCopy(filename.c_str(), poSrcDS, FALSE, options.List(), NULL, NULL);
+  CPLPopErrorHandler();
+  GDALClose(poSrcDS);
+
+  bool singleFile = false;
+  if (poDstDS != NULL) {
+    GDALClose(poDstDS);
+    singleFile = sidecarFiles(dirname, filename).empty();
+  }
+  VSIRmdirRecursive(dirname.c_str());
+
+  return singleFile;
+}
+
+std::vector<std::string>
+ctb::GDALTileEncoder::sidecarFiles(const std::string &dirname, const std::string &filename) {
+  const std::string basename = CPLGetFilename(filename.c_str()),
+    auxname = basename + ".aux.xml";
+  std::vector<std::string> sidecars;
+
+  char **papszFiles = VSIReadDir(dirname.c_str());
+  for (char **papszFile = papszFiles; papszFile && *papszFile; ++papszFile) {
+    if (strcmp(*papszFile, ".") == 0 || strcmp(*papszFile, "..") == 0 ||
+        basename == *papszFile || auxname == *papszFile) {
+      continue;
+    }
+    sidecars.push_back(*papszFile);
+  }
+  CSLDestroy(papszFiles);
+
+  return sidecars;
+}
+
+std::string
+ctb::GDALTileEncoder::tileFilename(GDALDriver *driver, const std::string &dirname) {
+  const char *extension = driver->GetMetadataItem(GDAL_DMD_EXTENSION);
+  std::string filename = dirname + "/tile";
+
+  if (extension != NULL && strlen(extension) > 0) {
+    filename += ".";
+    filename += extension;
+  }
+  return filename;
+}
+
+void
+ctb::GDALTileEncoder::encode(const GDALTile &tile) {
+  if (mPng && encodePng(tile)) {
+    mData = mPng->data();
+    mSize = mPng->size();
+    return;
+  }
+
+  encodeCopy(tile);
+  mData = mCopy.data();
+  mSize = mCopy.size();
+}
+
+/**
+ * @details A grey or RGB tile whose bands all have a nodata value within the
+ * range of a byte has that colour made transparent, as by the GDAL driver.
+ */
+bool
+ctb::GDALTileEncoder::encodePng(const GDALTile &tile) {
+  GDALDataset *dataset = tile.dataset;
+  const int bandCount = dataset->GetRasterCount(),
+    width = dataset->GetRasterXSize(),
+    height = dataset->GetRasterYSize();
+
+  if (bandCount < 1 || bandCount > 4) {
+    return false;
+  }
+
+  unsigned char transparent[3];
+  bool hasTransparent = (bandCount == 1 || bandCount == 3);
+  for (int i = 0; i < bandCount; i++) {
+    GDALRasterBand *band = dataset->GetRasterBand(i + 1);
+    if (band->GetRasterDataType() != GDT_Byte || band->GetColorTable() != NULL) {
+      return false;
+    }
+
+    int hasNoData = FALSE;
+    const double noData = band->GetNoDataValue(&hasNoData);
+    if (hasTransparent && hasNoData && noData >= 0 && noData <= 255) {
+      transparent[i] = (unsigned char) noData;
+    } else {
+      hasTransparent = false;
+    }
+  }
+
+  // Read the pixels of all the bands interleaved, as the image stores them
+  mPixels.resize((size_t) width * height * bandCount);
+  if (dataset->RasterIO(GF_Read, 0, 0, width, height, mPixels.data(), width, height, GDT_Byte,
+                        bandCount, NULL, bandCount, (GSpacing) width * bandCount, 1) != CE_None) {
+    throw CTBException("Could not read the pixels of the tile");
+  }
+
+  mPng->encode(mPixels.data(), width, height, bandCount, hasTransparent ? transparent : NULL);
+  return true;
+}
+
+void
+ctb::GDALTileEncoder::encodeCopy(const GDALTile &tile) {
+  GDALDataset *poDstDS = mDriver->CreateCopy(mFilename.c_str(), tile.dataset, FALSE, mCreationOptions.List(), NULL, NULL);
+  if (poDstDS == NULL) {
+    VSIRmdirRecursive(mDirname.c_str());
+    throw CTBException("Could not create GDAL tile");
+  }
+  GDALClose(poDstDS);
+
+  // A tile is a single file, so a sidecar file would be lost
+  const std::vector<std::string> sidecars = sidecarFiles(mDirname, mFilename);
+  if (!sidecars.empty()) {
+    VSIRmdirRecursive(mDirname.c_str());
+    throw CTBException(("The GDAL driver wrote the sidecar file " + sidecars[0] + ", which cannot be encoded in memory").c_str());
+  }
+
+  vsi_l_offset length = 0;
+  const GByte *buffer = VSIGetMemFileBuffer(mFilename.c_str(), &length, FALSE);
+  if (buffer == NULL) {
+    VSIRmdirRecursive(mDirname.c_str());
+    throw CTBException("Could not read the GDAL tile from memory");
+  }
+  mCopy.assign(buffer, buffer + length);
+
+  // Discard the file along with any sidecar files
+  VSIRmdirRecursive(mDirname.c_str());
+}
@@ -0,0 +1,133 @@
+#ifndef GDALTILEENCODER_HPP
+#define GDALTILEENCODER_HPP
+
+/*******************************************************************************
+ * Copyright 2018 GeoData <geodata@soton.ac.uk>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not
+ * use this file except in compliance with the License.  You may obtain a copy
+ * of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ *******************************************************************************/
+
+/**
+ * @file GDALTileEncoder.hpp
+ * @brief This declares the `GDALTileEncoder` class
+ */
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "gdal_priv.h"
+#include "cpl_string.h"
+
+#include "config.hpp"
+#include "GDALTile.hpp"
+#include "PngEncoder.hpp"
+
+namespace ctb {
+  class GDALTileEncoder;
+}
+
+/**
+ * @brief Encode `GDALTile`s in the format of a GDAL driver in memory
+ *
+ * This produces the bytes of the file a driver would create from a tile,
+ * without going through the filesystem, so they can be passed to an
+ * `ImageSerializer` or the sink of a `TileProducer`.
+ *
+ * PNG tiles of one to four `Byte` bands without a colour table, created with
+ * no other creation option than `ZLEVEL`, have their pixels read from the tile
+ * in a single request and are written by a `PngEncoder`.  Any other tile is
+ * copied by the driver to a file in memory, which requires a driver supporting
+ * virtual IO and writing the tile as a single file; other drivers, such as
+ * `ENVI` or any driver asked for a world file, must still create their tiles
+ * as files through a `GDALSerializer`.  The `.aux.xml` files holding the
+ * metadata GDAL could not store in a tile are discarded.
+ *
+ * The encoder keeps its buffers from one tile to the next, so each thread
+ * should have its own.
+ */
+class CTB_DLL ctb::GDALTileEncoder {
+public:
+
+  /// Instantiate an encoder for a driver able to encode its tiles in memory
+  GDALTileEncoder(GDALDriver *driver, const CPLStringList &creationOptions = CPLStringList());
+
+  ~GDALTileEncoder();
+
+  /**
+   * @brief Can the tiles of a driver be encoded in memory with some creation options?
+   *
+   * The driver must support virtual IO, and copying a small dataset with it
+   * must not write any file beside the tile but an `.aux.xml` file.
+   */
+  static bool
+  canEncode(GDALDriver *driver, const CPLStringList &creationOptions = CPLStringList());
+
+  /// Encode a tile as the image of the encoder
+  void
+  encode(const GDALTile &tile);
+
+  /// The bytes of the last tile encoded
+  inline const unsigned char *
+  data() const {
+    return mData;
+  }
+
+  /// The number of bytes of the last tile encoded
+  inline size_t
+  size() const {
+    return mSize;
+  }
+
+protected:
+
+  /// Encode a tile with the PNG encoder, returning `false` if it cannot
+  bool
+  encodePng(const GDALTile &tile);
+
+  /// Encode a tile by copying it with the driver to a file in memory
+  void
+  encodeCopy(const GDALTile &tile);
+
+  /// Get the files other than a tile and its `.aux.xml` file in a directory in memory
+  static std::vector<std::string>
+  sidecarFiles(const std::string &dirname, const std::string &filename);
+
+  /// Get the name in memory of the tiles of a driver in a directory
+  static std::string
+  tileFilename(GDALDriver *driver, const std::string &dirname);
+
+  /// The driver of the format of the tiles
+  GDALDriver *mDriver;
+  /// The creation options of the driver
+  CPLStringList mCreationOptions;
+
+  /// The encoder of PNG tiles, if the tiles can be PNG encoded directly
+  std::unique_ptr<PngEncoder> mPng;
+  /// The interleaved pixels of a PNG tile
+  std::vector<unsigned char> mPixels;
+
+  /// The directory in memory of the copies of the tiles, and their filename
+  std::string mDirname, mFilename;
+  /// The bytes of the last copy
+  std::vector<unsigned char> mCopy;
+
+  /// The bytes of the last tile encoded
+  const unsigned char *mData;
+  size_t mSize;
+
+  GDALTileEncoder(const GDALTileEncoder &) = delete;
+  GDALTileEncoder &operator=(const GDALTileEncoder &) = delete;
+};
+
+#endif /* GDALTILEENCODER_HPP */
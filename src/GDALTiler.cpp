@@ -32,6 +32,9 @@
 #include "config.hpp"
 #include "CTBException.hpp"
 #include "GDALTiler.hpp"
+#include "CoverageIndex.hpp"
+#include "HeightKernels.hpp"
+#include "SourceMosaic.hpp"
 
 #include "gdaloverviewdataset.cpp"
 
@@ -131,6 +134,7 @@ GDALTiler::GDALTiler(GDALDataset *poDataset, const Grid &grid, const TilerOption
 GDALTiler::GDALTiler(const GDALTiler &other):
   mGrid(other.mGrid),
   poDataset(other.poDataset),
+  options(other.options),
   mBounds(other.mBounds),
   mResolution(other.mResolution),
   crsWKT(other.crsWKT)
@@ -143,6 +147,7 @@ GDALTiler::GDALTiler(const GDALTiler &other):
 GDALTiler::GDALTiler(GDALTiler &other):
   mGrid(other.mGrid),
   poDataset(other.poDataset),
+  options(other.options),
   mBounds(other.mBounds),
   mResolution(other.mResolution),
   crsWKT(other.crsWKT)
@@ -163,6 +168,7 @@ GDALTiler::operator=(const GDALTiler &other) {
     poDataset->Reference();     // increase the refcount of the dataset
   }
 
+  options = other.options;
   mBounds = other.mBounds;
   mResolution = other.mResolution;
   crsWKT = other.crsWKT;
@@ -274,6 +280,54 @@ getOverviewDataset(GDALDatasetH hSrcDS, GDALTransformerFunc pfnTransformer, void
  */
 GDALTile *
 GDALTiler::createRasterTile(GDALDataset *dataset, double (&adfGeoTransform)[6]) const {
+  return createRasterTile(dataset, adfGeoTransform, mGrid.tileSize(), mGrid.tileSize());
+}
+
+/**
+ * @details By default every band of the dataset is warped.
+ */
+std::vector<int>
+GDALTiler::warpBands(GDALDataset *dataset) const {
+  std::vector<int> bands(dataset->GetRasterCount());
+
+  for (size_t i = 0; i < bands.size(); i++) {
+    bands[i] = i + 1;
+  }
+  return bands;
+}
+
+int
+GDALTiler::rasterTileBand(int sourceBand) const {
+  const std::vector<int> bands = warpBands(poDataset);
+
+  for (size_t i = 0; i < bands.size(); i++) {
+    if (bands[i] == sourceBand) return i + 1;
+  }
+  return 0;
+}
+
+/**
+ * @details The VRT is created as for a tile but with `xSize * ySize` pixels,
+ * so an area larger than a tile can be read in a single warp.
+ */
+GDALTile *
+GDALTiler::createRasterTile(GDALDataset *dataset, double (&adfGeoTransform)[6], int xSize, int ySize) const {
+  if (dataset == NULL) {
+    throw CTBException("No GDAL dataset is set");
+  }
+  return createRasterTile(dataset, adfGeoTransform, xSize, ySize, warpBands(dataset));
+}
+
+GDALTile *
+GDALTiler::createRasterTile(GDALDataset *dataset, double (&adfGeoTransform)[6], int xSize, int ySize, const std::vector<int> &bands) const {
+  return createRasterTile(dataset, adfGeoTransform, xSize, ySize, bands, options.resampleAlg);
+}
+
+/**
+ * @details The raster holds the bands in the order given, numbered from `1`.
+ */
+GDALTile *
+GDALTiler::createRasterTile(GDALDataset *dataset, double (&adfGeoTransform)[6], int xSize, int ySize, const std::vector<int> &bands, GDALResampleAlg resampleAlg) const {
   if (dataset == NULL) {
     throw CTBException("No GDAL dataset is set");
   }
@@ -292,19 +346,30 @@ GDALTiler::createRasterTile(GDALDataset *dataset, double (&adfGeoTransform)[6])
   if (!strlen(pszSrcWKT))
     throw CTBException("The source dataset no longer has a spatial reference system assigned");
 
-  // Populate the SRS WKT strings if we need to reproject
-  if (requiresReprojection()) {
-    pszGridWKT = crsWKT.c_str();
+  // Populate the SRS WKT strings if we need to reproject.  A dataset other
+  // than the one being tiled, such as a source of a mosaic, may be in any SRS.
+  std::string gridWKT = crsWKT;
+  if (gridWKT.empty() && dataset != poDataset) {
+    char *srsWKT = NULL;
+    if (mGrid.getSRS().exportToWkt(&srsWKT) != OGRERR_NONE) {
+      CPLFree(srsWKT);
+      throw CTBException("Could not create grid WKT string");
+    }
+    gridWKT = srsWKT;
+    CPLFree(srsWKT);
+  }
+  if (!gridWKT.empty()) {
+    pszGridWKT = gridWKT.c_str();
     transformOptions.SetNameValue("SRC_SRS", pszSrcWKT);
     transformOptions.SetNameValue("DST_SRS", pszGridWKT);
   }
 
   // Set the warp options
   GDALWarpOptions *psWarpOptions = GDALCreateWarpOptions();
-  psWarpOptions->eResampleAlg = options.resampleAlg;
+  psWarpOptions->eResampleAlg = resampleAlg;
   psWarpOptions->dfWarpMemoryLimit = options.warpMemoryLimit;
   psWarpOptions->hSrcDS = hSrcDS;
-  psWarpOptions->nBandCount = poDataset->GetRasterCount();
+  psWarpOptions->nBandCount = bands.size();
   psWarpOptions->panSrcBands =
     (int *) CPLMalloc(sizeof(int) * psWarpOptions->nBandCount );
   psWarpOptions->panDstBands =
@@ -321,7 +386,7 @@ GDALTiler::createRasterTile(GDALDataset *dataset, double (&adfGeoTransform)[6])
 
   for (short unsigned int i = 0; i < psWarpOptions->nBandCount; ++i) {
     int bGotNoData = FALSE;
-    double noDataValue = poDataset->GetRasterBand(i + 1)->GetNoDataValue(&bGotNoData);
+    double noDataValue = dataset->GetRasterBand(bands[i])->GetNoDataValue(&bGotNoData);
     if (!bGotNoData) noDataValue = -32768;
 
     psWarpOptions->padfSrcNoDataReal[i] = noDataValue;
@@ -329,7 +394,8 @@ GDALTiler::createRasterTile(GDALDataset *dataset, double (&adfGeoTransform)[6])
     psWarpOptions->padfDstNoDataReal[i] = noDataValue;
     psWarpOptions->padfDstNoDataImag[i] = 0;
     
-    psWarpOptions->panDstBands[i] = psWarpOptions->panSrcBands[i] = i + 1;
+    psWarpOptions->panSrcBands[i] = bands[i];
+    psWarpOptions->panDstBands[i] = i + 1;
   }
 
   // Create the image to image transformer
@@ -340,8 +406,11 @@ GDALTiler::createRasterTile(GDALDataset *dataset, double (&adfGeoTransform)[6])
   }
 
   // Try and get an overview from the source dataset that corresponds more
-  // closely to the resolution of this tile.
-  GDALDatasetH hWrkSrcDS = getOverviewDataset(hSrcDS, GDALGenImgProjTransform, transformerArg);
+  // closely to the resolution of this tile.  Overviews may have averaged the
+  // pixels, so the `min` and `max` algorithms always read the full resolution.
+  GDALDatasetH hWrkSrcDS = (resampleAlg == GRA_Min || resampleAlg == GRA_Max)
+    ? NULL
+    : getOverviewDataset(hSrcDS, GDALGenImgProjTransform, transformerArg);
   if (hWrkSrcDS == NULL) {
     hWrkSrcDS = psWarpOptions->hSrcDS = hSrcDS;
   } else {
@@ -383,7 +452,7 @@ GDALTiler::createRasterTile(GDALDataset *dataset, double (&adfGeoTransform)[6])
   psWarpOptions->papszWarpOptions = warpOptions.StealList();
 
   // The raster tile is represented as a VRT dataset
-  hDstDS = GDALCreateWarpedVRT(hWrkSrcDS, mGrid.tileSize(), mGrid.tileSize(), adfGeoTransform, psWarpOptions);
+  hDstDS = GDALCreateWarpedVRT(hWrkSrcDS, xSize, ySize, adfGeoTransform, psWarpOptions);
 
   bool isApproxTransform = (psWarpOptions->pfnTransformer == GDALApproxTransform);
   GDALDestroyWarpOptions( psWarpOptions );
@@ -413,6 +482,84 @@ GDALTiler::createRasterTile(GDALDataset *dataset, double (&adfGeoTransform)[6])
                       ? transformerArg : NULL);
 }
 
+bool
+GDALTiler::isFlat(const TileCoordinate &coord) const {
+  if (!options.coverage || options.flatTolerance <= 0) {
+    return false;
+  }
+
+  const CoverageIndex::Stats stats = options.coverage->stats(coord);
+  return stats.validFraction >= 1 && (stats.maxHeight - stats.minHeight) <= options.flatTolerance;
+}
+
+/**
+ * @details A flat tile has no children, and otherwise a child only has data
+ * if it overlaps the dataset bounds, and for a mosaic a source reaching its
+ * zoom level.  Without a coverage index a quadrant has data if any of its
+ * raster pixels is not nodata; the middle row and column of an odd sized
+ * raster belong to both halves.
+ */
+void
+GDALTiler::childrenWithData(const TileCoordinate &coord, const float *rasterHeights, i_tile tileSizeX, i_tile tileSizeY, bool (&children)[4]) const {
+  if (isFlat(coord)) {
+    children[0] = children[1] = children[2] = children[3] = false;
+    return;
+  }
+
+  const CRSBounds tileBounds = mGrid.tileBounds(coord);
+  const CRSBounds quadrants[4] = { tileBounds.getSW(), tileBounds.getSE(), tileBounds.getNW(), tileBounds.getNE() };
+
+  for (int i = 0; i < 4; i++) {
+    children[i] = bounds().overlaps(quadrants[i]);
+    if (options.mosaic) children[i] = children[i] && options.mosaic->maxZoom(quadrants[i]) > coord.zoom;
+  }
+
+  if (options.coverage) {
+    const i_zoom zoom = coord.zoom + 1;
+    const TileCoordinate childCoords[4] = {
+      TileCoordinate(zoom, coord.x * 2, coord.y * 2),
+      TileCoordinate(zoom, coord.x * 2 + 1, coord.y * 2),
+      TileCoordinate(zoom, coord.x * 2, coord.y * 2 + 1),
+      TileCoordinate(zoom, coord.x * 2 + 1, coord.y * 2 + 1)
+    };
+
+    for (int i = 0; i < 4; i++) {
+      children[i] = children[i] && options.coverage->hasData(childCoords[i]);
+    }
+    return;
+  }
+
+  const float noData = heightsNoDataValue();
+
+  // The raster rows are from the north
+  const i_tile westEnd = (tileSizeX + 1) / 2, eastStart = tileSizeX / 2,
+    northEnd = (tileSizeY + 1) / 2, southStart = tileSizeY / 2;
+  bool valid[4] = { false, false, false, false };
+
+  for (i_tile row = 0; row < tileSizeY; row++) {
+    const bool north = row < northEnd, south = row >= southStart;
+    const float *heights = rasterHeights + row * tileSizeX;
+    const bool west = HeightKernels::heightRange(heights, westEnd, noData).valid > 0,
+      east = HeightKernels::heightRange(heights + eastStart, tileSizeX - eastStart, noData).valid > 0;
+
+    valid[0] = valid[0] || (south && west);
+    valid[1] = valid[1] || (south && east);
+    valid[2] = valid[2] || (north && west);
+    valid[3] = valid[3] || (north && east);
+  }
+
+  for (int i = 0; i < 4; i++) {
+    children[i] = children[i] && valid[i];
+  }
+}
+
+float
+GDALTiler::heightsNoDataValue() const {
+  int bGotNoData = FALSE;
+  const float noDataValue = (float) poDataset->GetRasterBand(options.heightBand)->GetNoDataValue(&bGotNoData);
+  return bGotNoData ? noDataValue : -32768;
+}
+
 /**
  * @details This dereferences the underlying GDAL dataset and closes it if the
  * reference count falls below 1.
@@ -22,7 +22,9 @@
  * @brief This declares the `GDALTiler` class
  */
 
+#include <memory>
 #include <string>
+#include <vector>
 #include "gdalwarper.h"
 
 #include "TileCoordinate.hpp"
@@ -34,6 +36,8 @@ namespace ctb {
   struct TilerOptions;
   class GDALTiler;
   class GDALDatasetReader; // forward declaration
+  class CoverageIndex;     // forward declaration
+  class SourceMosaic;      // forward declaration
 }
 
 /// Options passed to a `GDALTiler`
@@ -44,6 +48,16 @@ struct ctb::TilerOptions {
   double warpMemoryLimit = 0.0; // default to GDAL internal setting
   /// The warp resampling algorithm
   GDALResampleAlg resampleAlg = GRA_Average; // recommended by GDAL maintainer
+  /// The band holding the heights
+  int heightBand = 1;
+  /// The band holding the water mask (non-zero is water), `0` for none
+  int maskBand = 0;
+  /// The coverage of the source data, used to skip tiles without data
+  std::shared_ptr<const CoverageIndex> coverage;
+  /// The source height range within which a tile needs no children, `0` to subdivide every tile
+  float flatTolerance = 0;
+  /// The sources of a mosaic, used to limit the zoom levels of each region
+  std::shared_ptr<const SourceMosaic> mosaic;
 };
 
 /**
@@ -95,7 +109,7 @@ public:
   createTile(GDALDataset *dataset, const TileCoordinate &coord) const = 0;
 
   /// Get the maximum zoom level for the dataset
-  inline i_zoom
+  virtual i_zoom
   maxZoomLevel() const {
     return mGrid.zoomForResolution(resolution());
   }
@@ -139,12 +153,28 @@ public:
     return mGrid;
   }
 
+  /// Get the options of the tiler
+  inline const TilerOptions &
+  tilerOptions() const {
+    return options;
+  }
+
   /// Get the dataset bounds in EPSG:4326 coordinates
   inline const CRSBounds &
   bounds() const {
     return const_cast<const CRSBounds &>(mBounds);
   }
 
+  /**
+   * @brief Is a tile flat enough to need no children?
+   *
+   * This is the case if the tile is fully covered by data whose height range,
+   * according to the coverage index, is within the flat tolerance: any height
+   * the tile holds is then within the tolerance of the source.
+   */
+  bool
+  isFlat(const TileCoordinate &coord) const;
+
   /// Does the dataset require reprojecting to EPSG:4326?
   inline bool
   requiresReprojection() const {
@@ -153,6 +183,7 @@ public:
 
 protected:
   friend class GDALDatasetReader;
+  friend class CoverageIndex;
 
   /// Close the underlying dataset
   void closeDataset();
@@ -165,6 +196,45 @@ protected:
   virtual GDALTile *
   createRasterTile(GDALDataset *dataset, double (&adfGeoTransform)[6]) const;
 
+  /// Create a raster of any size from a geo transform
+  GDALTile *
+  createRasterTile(GDALDataset *dataset, double (&adfGeoTransform)[6], int xSize, int ySize) const;
+
+  /// Create a raster of any size from some bands of a dataset
+  GDALTile *
+  createRasterTile(GDALDataset *dataset, double (&adfGeoTransform)[6], int xSize, int ySize, const std::vector<int> &bands) const;
+
+  /// Create a raster of any size from some bands of a dataset with a resampling algorithm other than that of the options
+  GDALTile *
+  createRasterTile(GDALDataset *dataset, double (&adfGeoTransform)[6], int xSize, int ySize, const std::vector<int> &bands, GDALResampleAlg resampleAlg) const;
+
+  /**
+   * @brief Get the bands of a dataset which are warped into a raster tile
+   *
+   * The raster tile holds these bands in the same order, numbered from `1`.
+   */
+  virtual std::vector<int>
+  warpBands(GDALDataset *dataset) const;
+
+  /// Get the band of a raster tile holding a band of the source dataset, `0` if it is not warped
+  int
+  rasterTileBand(int sourceBand) const;
+
+  /**
+   * @brief Find which children of a tile have data
+   *
+   * The children are set in the order south west, south east, north west and
+   * north east.  They are looked up in the coverage index if there is one,
+   * otherwise the quadrants of the tile raster heights are tested for valid
+   * pixels.
+   */
+  void
+  childrenWithData(const TileCoordinate &coord, const float *rasterHeights, i_tile tileSizeX, i_tile tileSizeY, bool (&children)[4]) const;
+
+  /// Get the nodata value of the heights band, `-32768` if it has none
+  float
+  heightsNoDataValue() const;
+
   /// The grid used for generating tiles
   Grid mGrid;
 
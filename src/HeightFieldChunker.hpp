@@ -83,16 +83,22 @@ public:
 
     m_heights = tileHeights;
     m_size = tileSize;
-    m_log_size = (int)(log2((float)m_size - 1) + 0.5);
+    m_log_size = 0;
+    while ((1 << (m_log_size + 1)) < m_size) m_log_size++;
 
     // Initialize level array.
-    m_levels = (int*)CPLMalloc(tileCellSize * sizeof(int));
+    m_levels = (unsigned char*)CPLMalloc(tileCellSize * sizeof(unsigned char));
     for (int i = 0; i < tileCellSize; i++) m_levels[i] = 255;
   }
   ~heightfield() {
     clear();
   }
 
+  /// Returns true if the size is valid for a heightfield, i.e. size == (1 << log_size) + 1.
+  static bool isValidSize(int tileSize) {
+    return tileSize > 2 && ((tileSize - 1) & (tileSize - 2)) == 0;
+  }
+
   /// Apply the specified maximum geometric error to fill the level info of the grid.
   void applyGeometricError(double maximumGeometricError, bool smoothSmallZooms = false) {
     int tileCellSize = m_size * m_size;
@@ -182,7 +188,7 @@ private:
   int m_size;         // Number of cols and rows of this Heightmap
   int m_log_size;     // size == (1 << log_size) + 1
   float *m_heights;   // grid of heights
-  int *m_levels;      // grid of activation levels
+  unsigned char *m_levels; // grid of activation levels
 
   /// Return the activation level at (x, y)
   int get_level(int x, int y) const
@@ -251,6 +257,7 @@ private:
       // Compute the mesh level above which this vertex
       // needs to be included in LOD meshes.
       int activation_level = (int)std::floor(log2(error_B / base_max_error) + 0.5);
+      if (activation_level > 0x0E) activation_level = 0x0E; // 0x0F means inactive
 
       // Force the base vert to at least this activation level.
       activate(bx, by, activation_level);
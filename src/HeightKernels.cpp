@@ -0,0 +1,431 @@
+/*******************************************************************************
+ * Copyright 2018 GeoData <geodata@soton.ac.uk>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not
+ * use this file except in compliance with the License.  You may obtain a copy
+ * of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ *******************************************************************************/
+
+/**
+ * @file HeightKernels.cpp
+ * @brief This defines the `HeightKernels` class
+ *
+ * Each kernel processes as many heights as fit its vectors and returns the
+ * number processed, leaving the rest to the scalar version.  The vector
+ * versions follow the scalar ones operation for operation, so the results are
+ * the same.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <cfloat>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+
+#include "HeightKernels.hpp"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define CTB_KERNELS_SSE2
+#include <emmintrin.h>
+#endif
+
+// AVX2 is compiled for its functions only, and used if the processor has it
+#if defined(CTB_KERNELS_SSE2) && defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define CTB_KERNELS_AVX2
+#include <immintrin.h>
+#endif
+
+using namespace ctb;
+
+namespace {
+
+/// The instructions the kernels are run with
+enum InstructionSet {
+  SCALAR,
+  SSE2,
+  AVX2
+};
+
+InstructionSet
+detectInstructionSet() {
+#ifdef CTB_KERNELS_AVX2
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) return AVX2;
+#endif
+#ifdef CTB_KERNELS_SSE2
+  return SSE2;
+#else
+  return SCALAR;
+#endif
+}
+
+/// The fastest instructions the processor runs
+InstructionSet
+supportedInstructions() {
+  static const InstructionSet instructionSet = detectInstructionSet();
+  return instructionSet;
+}
+
+/// Get the instructions of a name, `-1` if it names none
+int
+parseInstructionSet(const char *name) {
+  if (strcmp(name, "scalar") == 0) return SCALAR;
+  if (strcmp(name, "sse2") == 0) return SSE2;
+  if (strcmp(name, "avx2") == 0) return AVX2;
+  return -1;
+}
+
+/**
+ * The instructions chosen, `-1` until the first call
+ *
+ * They default to the fastest supported, unless the `CTB_HEIGHT_KERNELS`
+ * environment variable names slower ones.
+ */
+std::atomic<int> chosenInstructions(-1);
+
+InstructionSet
+instructions() {
+  int instructionSet = chosenInstructions.load(std::memory_order_relaxed);
+
+  if (instructionSet < 0) {
+    instructionSet = supportedInstructions();
+
+    const char *name = getenv("CTB_HEIGHT_KERNELS");
+    const int requested = name ? parseInstructionSet(name) : -1;
+    if (requested >= 0 && requested < instructionSet) instructionSet = requested;
+
+    chosenInstructions.store(instructionSet, std::memory_order_relaxed);
+  }
+  return (InstructionSet) instructionSet;
+}
+
+inline bool
+isValid(float height, float noDataValue) {
+  return height == height && height != noDataValue;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Scalar
+
+/**
+ * Convert heights with the nodata test fixed for the whole loop
+ *
+ * The height is clamped whether valid or not, `NaN` becoming `0`, and the
+ * result selected afterwards.  Without branches the compiler vectorises the
+ * loop in optimised builds.
+ */
+template<bool noDataIsNaN> void
+convertScalar(const float *heights, size_t count, float noDataValue, i_terrain_height *terrainHeights) {
+  const i_terrain_height seaLevel = 5000;
+
+  for (size_t i = 0; i < count; i++) {
+    const float height = heights[i],
+      value = std::min(65535.0f, std::max(0.0f, (height + 1000) * 5));
+    const bool valid = noDataIsNaN ? height == height : (height == height) & (height != noDataValue);
+
+    terrainHeights[i] = valid ? (i_terrain_height) value : seaLevel;
+  }
+}
+
+void
+convertScalar(const float *heights, size_t count, float noDataValue, i_terrain_height *terrainHeights) {
+  if (std::isnan(noDataValue)) {
+    convertScalar<true>(heights, count, noDataValue, terrainHeights);
+  } else {
+    convertScalar<false>(heights, count, noDataValue, terrainHeights);
+  }
+}
+
+void
+rangeScalar(const float *heights, size_t count, float noDataValue, HeightKernels::Range &range) {
+  for (size_t i = 0; i < count; i++) {
+    if (!isValid(heights[i], noDataValue)) continue;
+
+    range.minHeight = std::min(range.minHeight, heights[i]);
+    range.maxHeight = std::max(range.maxHeight, heights[i]);
+    range.valid++;
+  }
+}
+
+void
+replaceScalar(float *heights, size_t count, float noDataValue, float value) {
+  const bool noDataIsNaN = std::isnan(noDataValue);
+
+  for (size_t i = 0; i < count; i++) {
+    if (noDataIsNaN ? std::isnan(heights[i]) : heights[i] == noDataValue) heights[i] = value;
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// SSE2
+
+#ifdef CTB_KERNELS_SSE2
+
+/// Convert 4 heights to terrain heights as 32 bit integers
+inline __m128i
+convertSSE2(__m128 height, __m128 noData) {
+  const __m128 valid = _mm_and_ps(_mm_cmpord_ps(height, height), _mm_cmpneq_ps(height, noData));
+
+  height = _mm_and_ps(height, valid); // nodata is sea level
+  __m128 value = _mm_mul_ps(_mm_add_ps(height, _mm_set1_ps(1000)), _mm_set1_ps(5));
+  value = _mm_min_ps(_mm_max_ps(value, _mm_setzero_ps()), _mm_set1_ps(65535));
+
+  return _mm_cvttps_epi32(value);
+}
+
+size_t
+convertSSE2(const float *heights, size_t count, float noDataValue, i_terrain_height *terrainHeights) {
+  const __m128 noData = _mm_set1_ps(noDataValue);
+  const __m128i bias = _mm_set1_epi32(32768);
+  size_t i = 0;
+
+  for (; i + 8 <= count; i += 8) {
+    // Pack as signed integers shifted down by 32768, then shift back
+    const __m128i low = _mm_sub_epi32(convertSSE2(_mm_loadu_ps(heights + i), noData), bias),
+      high = _mm_sub_epi32(convertSSE2(_mm_loadu_ps(heights + i + 4), noData), bias);
+    const __m128i packed = _mm_xor_si128(_mm_packs_epi32(low, high), _mm_set1_epi16((short) 0x8000));
+
+    _mm_storeu_si128((__m128i *) (terrainHeights + i), packed);
+  }
+  return i;
+}
+
+size_t
+rangeSSE2(const float *heights, size_t count, float noDataValue, HeightKernels::Range &range) {
+  const __m128 noData = _mm_set1_ps(noDataValue),
+    highest = _mm_set1_ps(FLT_MAX),
+    lowest = _mm_set1_ps(-FLT_MAX);
+  __m128 minHeights = highest, maxHeights = lowest;
+  __m128i valids = _mm_setzero_si128();
+  size_t i = 0;
+
+  for (; i + 4 <= count; i += 4) {
+    const __m128 height = _mm_loadu_ps(heights + i),
+      valid = _mm_and_ps(_mm_cmpord_ps(height, height), _mm_cmpneq_ps(height, noData));
+
+    minHeights = _mm_min_ps(minHeights, _mm_or_ps(_mm_and_ps(valid, height), _mm_andnot_ps(valid, highest)));
+    maxHeights = _mm_max_ps(maxHeights, _mm_or_ps(_mm_and_ps(valid, height), _mm_andnot_ps(valid, lowest)));
+    valids = _mm_sub_epi32(valids, _mm_castps_si128(valid)); // a valid lane is -1
+  }
+
+  float mins[4], maxs[4];
+  int counts[4];
+  _mm_storeu_ps(mins, minHeights);
+  _mm_storeu_ps(maxs, maxHeights);
+  _mm_storeu_si128((__m128i *) counts, valids);
+
+  for (int j = 0; j < 4; j++) {
+    if (counts[j] == 0) continue;
+    range.minHeight = std::min(range.minHeight, mins[j]);
+    range.maxHeight = std::max(range.maxHeight, maxs[j]);
+    range.valid += counts[j];
+  }
+  return i;
+}
+
+size_t
+replaceSSE2(float *heights, size_t count, float noDataValue, float value) {
+  const bool noDataIsNaN = std::isnan(noDataValue);
+  const __m128 noData = _mm_set1_ps(noDataValue), values = _mm_set1_ps(value);
+  size_t i = 0;
+
+  for (; i + 4 <= count; i += 4) {
+    const __m128 height = _mm_loadu_ps(heights + i),
+      replace = noDataIsNaN ? _mm_cmpunord_ps(height, height) : _mm_cmpeq_ps(height, noData);
+
+    _mm_storeu_ps(heights + i, _mm_or_ps(_mm_and_ps(replace, values), _mm_andnot_ps(replace, height)));
+  }
+  return i;
+}
+
+#endif /* CTB_KERNELS_SSE2 */
+
+////////////////////////////////////////////////////////////////////////////////
+// AVX2
+
+#ifdef CTB_KERNELS_AVX2
+
+/// Convert 8 heights to terrain heights as 32 bit integers
+__attribute__((target("avx2"))) inline __m256i
+convertAVX2(__m256 height, __m256 noData) {
+  const __m256 valid = _mm256_and_ps(_mm256_cmp_ps(height, height, _CMP_ORD_Q), _mm256_cmp_ps(height, noData, _CMP_NEQ_UQ));
+
+  height = _mm256_and_ps(height, valid); // nodata is sea level
+  __m256 value = _mm256_mul_ps(_mm256_add_ps(height, _mm256_set1_ps(1000)), _mm256_set1_ps(5));
+  value = _mm256_min_ps(_mm256_max_ps(value, _mm256_setzero_ps()), _mm256_set1_ps(65535));
+
+  return _mm256_cvttps_epi32(value);
+}
+
+__attribute__((target("avx2"))) size_t
+convertAVX2(const float *heights, size_t count, float noDataValue, i_terrain_height *terrainHeights) {
+  const __m256 noData = _mm256_set1_ps(noDataValue);
+  size_t i = 0;
+
+  for (; i + 16 <= count; i += 16) {
+    // The pack interleaves the 128 bit lanes, which the permute undoes
+    const __m256i packed = _mm256_packus_epi32(convertAVX2(_mm256_loadu_ps(heights + i), noData),
+                                               convertAVX2(_mm256_loadu_ps(heights + i + 8), noData));
+
+    _mm256_storeu_si256((__m256i *) (terrainHeights + i), _mm256_permute4x64_epi64(packed, 0xD8));
+  }
+  return i;
+}
+
+__attribute__((target("avx2"))) size_t
+rangeAVX2(const float *heights, size_t count, float noDataValue, HeightKernels::Range &range) {
+  const __m256 noData = _mm256_set1_ps(noDataValue),
+    highest = _mm256_set1_ps(FLT_MAX),
+    lowest = _mm256_set1_ps(-FLT_MAX);
+  __m256 minHeights = highest, maxHeights = lowest;
+  __m256i valids = _mm256_setzero_si256();
+  size_t i = 0;
+
+  for (; i + 8 <= count; i += 8) {
+    const __m256 height = _mm256_loadu_ps(heights + i),
+      valid = _mm256_and_ps(_mm256_cmp_ps(height, height, _CMP_ORD_Q), _mm256_cmp_ps(height, noData, _CMP_NEQ_UQ));
+
+    minHeights = _mm256_min_ps(minHeights, _mm256_blendv_ps(highest, height, valid));
+    maxHeights = _mm256_max_ps(maxHeights, _mm256_blendv_ps(lowest, height, valid));
+    valids = _mm256_sub_epi32(valids, _mm256_castps_si256(valid)); // a valid lane is -1
+  }
+
+  float mins[8], maxs[8];
+  int counts[8];
+  _mm256_storeu_ps(mins, minHeights);
+  _mm256_storeu_ps(maxs, maxHeights);
+  _mm256_storeu_si256((__m256i *) counts, valids);
+
+  for (int j = 0; j < 8; j++) {
+    if (counts[j] == 0) continue;
+    range.minHeight = std::min(range.minHeight, mins[j]);
+    range.maxHeight = std::max(range.maxHeight, maxs[j]);
+    range.valid += counts[j];
+  }
+  return i;
+}
+
+__attribute__((target("avx2"))) size_t
+replaceAVX2(float *heights, size_t count, float noDataValue, float value) {
+  const bool noDataIsNaN = std::isnan(noDataValue);
+  const __m256 noData = _mm256_set1_ps(noDataValue), values = _mm256_set1_ps(value);
+  size_t i = 0;
+
+  for (; i + 8 <= count; i += 8) {
+    const __m256 height = _mm256_loadu_ps(heights + i),
+      replace = noDataIsNaN ? _mm256_cmp_ps(height, height, _CMP_UNORD_Q) : _mm256_cmp_ps(height, noData, _CMP_EQ_OQ);
+
+    _mm256_storeu_ps(heights + i, _mm256_blendv_ps(height, values, replace));
+  }
+  return i;
+}
+
+#endif /* CTB_KERNELS_AVX2 */
+
+}
+
+void
+HeightKernels::convertHeights(const float *heights, size_t count, float noDataValue, i_terrain_height *terrainHeights) {
+  size_t done = 0;
+
+  switch (instructions()) {
+#ifdef CTB_KERNELS_AVX2
+  case AVX2:
+    done = convertAVX2(heights, count, noDataValue, terrainHeights);
+    break;
+#endif
+#ifdef CTB_KERNELS_SSE2
+  case SSE2:
+    done = convertSSE2(heights, count, noDataValue, terrainHeights);
+    break;
+#endif
+  default:
+    break;
+  }
+
+  convertScalar(heights + done, count - done, noDataValue, terrainHeights + done);
+}
+
+HeightKernels::Range
+HeightKernels::heightRange(const float *heights, size_t count, float noDataValue) {
+  Range range = { FLT_MAX, -FLT_MAX, 0 };
+  size_t done = 0;
+
+  switch (instructions()) {
+#ifdef CTB_KERNELS_AVX2
+  case AVX2:
+    done = rangeAVX2(heights, count, noDataValue, range);
+    break;
+#endif
+#ifdef CTB_KERNELS_SSE2
+  case SSE2:
+    done = rangeSSE2(heights, count, noDataValue, range);
+    break;
+#endif
+  default:
+    break;
+  }
+
+  rangeScalar(heights + done, count - done, noDataValue, range);
+  if (range.valid == 0) range.minHeight = range.maxHeight = 0;
+
+  return range;
+}
+
+void
+HeightKernels::replaceNoData(float *heights, size_t count, float noDataValue, float value) {
+  size_t done = 0;
+
+  switch (instructions()) {
+#ifdef CTB_KERNELS_AVX2
+  case AVX2:
+    done = replaceAVX2(heights, count, noDataValue, value);
+    break;
+#endif
+#ifdef CTB_KERNELS_SSE2
+  case SSE2:
+    done = replaceSSE2(heights, count, noDataValue, value);
+    break;
+#endif
+  default:
+    break;
+  }
+
+  replaceScalar(heights + done, count - done, noDataValue, value);
+}
+
+/**
+ * @details This is meant for tests and benchmarks comparing the
+ * implementations.  Other threads running the kernels at the same time may
+ * use either set of instructions for their current call.
+ */
+bool
+HeightKernels::setInstructionSet(const char *name) {
+  const int instructionSet = parseInstructionSet(name);
+
+  if (instructionSet < 0 || instructionSet > supportedInstructions()) return false;
+
+  chosenInstructions.store(instructionSet, std::memory_order_relaxed);
+  return true;
+}
+
+const char *
+HeightKernels::instructionSet() {
+  switch (instructions()) {
+  case AVX2:
+    return "avx2";
+  case SSE2:
+    return "sse2";
+  default:
+    return "scalar";
+  }
+}
@@ -0,0 +1,83 @@
+#ifndef HEIGHTKERNELS_HPP
+#define HEIGHTKERNELS_HPP
+
+/*******************************************************************************
+ * Copyright 2018 GeoData <geodata@soton.ac.uk>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not
+ * use this file except in compliance with the License.  You may obtain a copy
+ * of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ *******************************************************************************/
+
+/**
+ * @file HeightKernels.hpp
+ * @brief This declares the `HeightKernels` class
+ */
+
+#include <cstddef>
+
+#include "config.hpp"
+#include "types.hpp"
+
+namespace ctb {
+  class HeightKernels;
+}
+
+/**
+ * @brief Loops over buffers of `Float32` heights
+ *
+ * These are the passes made over the heights of every tile.  Each is
+ * implemented with AVX2 and SSE2 instructions where the compiler supports
+ * them, and the fastest one the processor runs is chosen when first called,
+ * falling back to plain C++.  All the implementations give the same results.
+ * The `CTB_HEIGHT_KERNELS` environment variable, or `setInstructionSet`, can
+ * choose slower instructions, such as `scalar` to rule the vector code out.
+ *
+ * A height is valid unless it equals the nodata value or is `NaN`.
+ */
+class CTB_DLL ctb::HeightKernels {
+public:
+
+  /// The range of the valid heights of a buffer
+  struct Range {
+    float minHeight;            ///< The lowest valid height
+    float maxHeight;            ///< The highest valid height
+    size_t valid;               ///< The number of valid heights
+  };
+
+  /**
+   * @brief Convert heights in metres to terrain tile heights
+   *
+   * A terrain height is the number of 1/5 metre units above -1000 metres,
+   * truncated and clamped to the range of `i_terrain_height`.  Nodata is
+   * converted as sea level.
+   */
+  static void
+  convertHeights(const float *heights, size_t count, float noDataValue, i_terrain_height *terrainHeights);
+
+  /// Get the range of the valid heights, `valid` being `0` if there are none
+  static Range
+  heightRange(const float *heights, size_t count, float noDataValue);
+
+  /// Replace the nodata heights with a value
+  static void
+  replaceNoData(float *heights, size_t count, float noDataValue, float value);
+
+  /// Get the name of the instructions used: `avx2`, `sse2` or `scalar`
+  static const char *
+  instructionSet();
+
+  /// Use the instructions of a name, returning `false` if the processor or compiler does not support them
+  static bool
+  setInstructionSet(const char *name);
+};
+
+#endif /* HEIGHTKERNELS_HPP */
@@ -0,0 +1,51 @@
+#ifndef IMAGESERIALIZER_HPP
+#define IMAGESERIALIZER_HPP
+
+/*******************************************************************************
+ * Copyright 2018 GeoData <geodata@soton.ac.uk>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not
+ * use this file except in compliance with the License.  You may obtain a copy
+ * of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ *******************************************************************************/
+
+/**
+ * @file ImageSerializer.hpp
+ * @brief This declares and defines the `ImageSerializer` class
+ */
+
+#include <cstddef>
+
+#include "config.hpp"
+#include "TileCoordinate.hpp"
+
+namespace ctb {
+  class ImageSerializer;
+}
+
+/// Store the encoded images of tiles, such as PNG elevation tiles
+class CTB_DLL ctb::ImageSerializer {
+public:
+
+  /// Start a new serialization task
+  virtual void startSerialization() = 0;
+
+  /// Returns if the specified Tile Coordinate should be serialized
+  virtual bool mustSerializeCoordinate(const ctb::TileCoordinate *coordinate) = 0;
+
+  /// Serialize the bytes of the image of a tile, stored as they are, to the store
+  virtual bool serializeImage(const ctb::TileCoordinate &coordinate, const unsigned char *data, size_t size, const char *extension) = 0;
+
+  /// Serialization finished, releases any resources loaded
+  virtual void endSerialization() = 0;
+};
+
+#endif /* IMAGESERIALIZER_HPP */
@@ -0,0 +1,47 @@
+/*******************************************************************************
+ * Copyright 2018 GeoData <geodata@soton.ac.uk>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not
+ * use this file except in compliance with the License.  You may obtain a copy
+ * of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ *******************************************************************************/
+
+/**
+ * @file ImageTiler.cpp
+ * @brief This defines the `ImageTiler` class
+ */
+
+#include "CTBException.hpp"
+#include "ImageTiler.hpp"
+
+using namespace ctb;
+
+CRSBounds
+ctb::ImageTiler::sampleBounds(const TileCoordinate &coord, double &resolution) const {
+  const CRSBounds bounds = mGrid.tileBounds(coord);
+
+  resolution = bounds.getWidth() / mGrid.tileSize();
+  return bounds;
+}
+
+/**
+ * @details Unlike the raster of a terrain tile, the raster is not shifted:
+ * the pixels are warped over the bounds of the tile.
+ */
+GDALTile *
+ctb::ImageTiler::createRasterTile(GDALDataset *dataset, const TileCoordinate &coord) const {
+  // Ensure we have some data from which to create a tile
+  if (dataset && dataset->GetRasterCount() < 1) {
+    throw CTBException("At least one band must be present in the GDAL dataset");
+  }
+
+  return GDALTiler::createRasterTile(dataset, coord);
+}
@@ -0,0 +1,73 @@
+#ifndef IMAGETILER_HPP
+#define IMAGETILER_HPP
+
+/*******************************************************************************
+ * Copyright 2018 GeoData <geodata@soton.ac.uk>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not
+ * use this file except in compliance with the License.  You may obtain a copy
+ * of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ *******************************************************************************/
+
+/**
+ * @file ImageTiler.hpp
+ * @brief This declares the `ImageTiler` class
+ */
+
+#include "TerrainTiler.hpp"
+
+namespace ctb {
+  class ImageTiler;
+}
+
+/**
+ * @brief Read the heights of elevation images from a GDAL Dataset
+ *
+ * Elevation images, such as Terrain-RGB and Terrarium tiles, are XYZ or TMS
+ * raster tiles: each pixel covers its own area of the tile, so the heights are
+ * sampled at the pixel centres of the tile bounds with a resolution of the
+ * tile width over the tile size.  Neighbouring tiles share no samples, unlike
+ * the heightmap tiles of a `TerrainTiler`.
+ *
+ * The heights are read with `readTileHeights` and encoded with
+ * `encodeHeights`; the terrain tiles of the base class are not created.
+ */
+class CTB_DLL ctb::ImageTiler :
+  public TerrainTiler
+{
+public:
+
+  /// Instantiate a tiler with all required arguments
+  ImageTiler(GDALDataset *poDataset, const Grid &grid, const TilerOptions &options):
+    TerrainTiler(poDataset, grid, options) {}
+
+  /// Instantiate a tiler with a dataset and grid but no options
+  ImageTiler(GDALDataset *poDataset, const Grid &grid):
+    TerrainTiler(poDataset, grid, TilerOptions()) {}
+
+  /// The bounds of the tile itself, with the resolution of its pixels
+  virtual CRSBounds
+  sampleBounds(const TileCoordinate &coord, double &resolution) const override;
+
+  /// Neighbouring images share no samples
+  virtual bool
+  sharesEdgeSamples() const override {
+    return false;
+  }
+
+protected:
+
+  /// Create a `GDALTile` of the pixels of the image
+  virtual GDALTile *
+  createRasterTile(GDALDataset *dataset, const TileCoordinate &coord) const override;
+};
+
+#endif /* IMAGETILER_HPP */
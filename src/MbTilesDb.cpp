@@ -28,10 +28,15 @@
 #include <string>
 #include <stdexcept>
 #include <sstream>
+#include <string.h>
 
 #include "MbTilesDb.hpp"
 
-ctb::MbTilesDb::MbTilesDb(std::string const& dbname) {
+ctb::MbTilesDb::MbTilesDb(std::string const& dbname, bool deduplicate):
+  tile_stmt(NULL),
+  deduplicated(deduplicate),
+  map_stmt(NULL),
+  image_stmt(NULL) {
 
   sqlite3 *db;
   if (sqlite3_open(dbname.c_str(), &db) != SQLITE_OK) {
@@ -62,14 +67,32 @@ ctb::MbTilesDb::MbTilesDb(std::string const& dbname) {
     err << "SQLite Error: Metadata Table Creation error: " << err_msg << std::endl;
     throw std::runtime_error(err.str());
   }
-  if (sqlite3_exec(mbTiles, "CREATE TABLE IF NOT EXISTS  tiles (zoom_level integer, tile_column integer, tile_row integer, tile_data blob);", NULL, NULL, &err_msg) != SQLITE_OK) {
+  if (sqlite3_exec(mbTiles, "create unique index IF NOT EXISTS  name on metadata (name);", NULL, NULL, &err_msg) != SQLITE_OK) {
     std::ostringstream err;
-    err << "SQLite Error: Tiles Table Creation error: " << err_msg << std::endl;
+    err << "SQLite Error: Metadata Index Creation error: " << err_msg << std::endl;
     throw std::runtime_error(err.str());
   }
-  if (sqlite3_exec(mbTiles, "create unique index IF NOT EXISTS  name on metadata (name);", NULL, NULL, &err_msg) != SQLITE_OK) {
+
+  // An existing database keeps its schema, which is deduplicated if `tiles` is a view
+  sqlite3_stmt *stmt;
+  if (sqlite3_prepare_v2(mbTiles, "SELECT type FROM sqlite_master WHERE name = 'tiles';", -1, &stmt, NULL) != SQLITE_OK) {
     std::ostringstream err;
-    err << "SQLite Error: Metadata Index Creation error: " << err_msg << std::endl;
+    err << "SQLite Error: Schema query failed: " << sqlite3_errmsg(mbTiles) << std::endl;
+    throw std::runtime_error(err.str());
+  }
+  if (sqlite3_step(stmt) == SQLITE_ROW) {
+    deduplicated = strcmp((const char *) sqlite3_column_text(stmt, 0), "view") == 0;
+  }
+  sqlite3_finalize(stmt);
+
+  if (deduplicated) {
+    createDeduplicatedSchema();
+    return;
+  }
+
+  if (sqlite3_exec(mbTiles, "CREATE TABLE IF NOT EXISTS  tiles (zoom_level integer, tile_column integer, tile_row integer, tile_data blob);", NULL, NULL, &err_msg) != SQLITE_OK) {
+    std::ostringstream err;
+    err << "SQLite Error: Tiles Table Creation error: " << err_msg << std::endl;
     throw std::runtime_error(err.str());
   }
   if (sqlite3_exec(mbTiles, "create unique index IF NOT EXISTS  tile_index on tiles (zoom_level, tile_column, tile_row);", NULL, NULL, &err_msg) != SQLITE_OK) {
@@ -79,7 +102,6 @@ ctb::MbTilesDb::MbTilesDb(std::string const& dbname) {
   }
 
   // Construct tile insertion prepared statement
-  sqlite3_stmt *stmt;
   const char *query = "insert into tiles (zoom_level, tile_column, tile_row, tile_data) values (?, ?, ?, ?)";
   if (sqlite3_prepare_v2(mbTiles, query, -1, &stmt, NULL) != SQLITE_OK) {
     std::ostringstream err;
@@ -89,6 +111,46 @@ ctb::MbTilesDb::MbTilesDb(std::string const& dbname) {
   tile_stmt = stmt;
 }
 
+/**
+ * @details The `map` and `images` tables are indexed by tile and by image
+ * identifier, and the identifiers of the images already stored are loaded so
+ * each image is only written once.
+ */
+void
+ctb::MbTilesDb::createDeduplicatedSchema() {
+  char *err_msg = NULL;
+  const char *schema =
+    "CREATE TABLE IF NOT EXISTS map (zoom_level integer, tile_column integer, tile_row integer, tile_id text);"
+    "CREATE TABLE IF NOT EXISTS images (tile_id text, tile_data blob);"
+    "CREATE UNIQUE INDEX IF NOT EXISTS map_index ON map (zoom_level, tile_column, tile_row);"
+    "CREATE UNIQUE INDEX IF NOT EXISTS images_id ON images (tile_id);"
+    "CREATE VIEW IF NOT EXISTS tiles AS"
+    " SELECT map.zoom_level AS zoom_level, map.tile_column AS tile_column, map.tile_row AS tile_row, images.tile_data AS tile_data"
+    " FROM map JOIN images ON images.tile_id = map.tile_id;";
+  if (sqlite3_exec(mbTiles, schema, NULL, NULL, &err_msg) != SQLITE_OK) {
+    std::ostringstream err;
+    err << "SQLite Error: Deduplicated Tables Creation error: " << err_msg << std::endl;
+    throw std::runtime_error(err.str());
+  }
+
+  if (sqlite3_prepare_v2(mbTiles, "INSERT OR REPLACE INTO map (zoom_level, tile_column, tile_row, tile_id) VALUES (?, ?, ?, ?)", -1, &map_stmt, NULL) != SQLITE_OK ||
+      sqlite3_prepare_v2(mbTiles, "INSERT OR IGNORE INTO images (tile_id, tile_data) VALUES (?, ?)", -1, &image_stmt, NULL) != SQLITE_OK) {
+    std::ostringstream err;
+    err << "SQLite Error: Map or image prepared statement failed to create." << std::endl;
+    throw std::runtime_error(err.str());
+  }
+
+  sqlite3_stmt *stmt;
+  if (sqlite3_prepare_v2(mbTiles, "SELECT tile_id FROM images;", -1, &stmt, NULL) != SQLITE_OK) {
+    std::string err = "Could not prepare image fetching statement";
+    throw std::runtime_error(err);
+  }
+  while (sqlite3_step(stmt) == SQLITE_ROW) {
+    imageIds.insert((const char *) sqlite3_column_text(stmt, 0));
+  }
+  sqlite3_finalize(stmt);
+}
+
 ctb::MbTilesDb::~MbTilesDb() {
   char *err;
   std::ostringstream err_msg;
@@ -97,7 +159,9 @@ ctb::MbTilesDb::~MbTilesDb() {
     err_msg << "SQLite Error: failed to ANALYZE: " << err << std::endl;
     throw std::runtime_error(err_msg.str());
   }
-  if (sqlite3_finalize(tile_stmt) != SQLITE_OK) {
+  if (sqlite3_finalize(tile_stmt) != SQLITE_OK ||
+      sqlite3_finalize(map_stmt) != SQLITE_OK ||
+      sqlite3_finalize(image_stmt) != SQLITE_OK) {
     err_msg << "SQLite Error: failed to finalize tile_stmt " << std::endl;
     throw std::runtime_error(err_msg.str());
   }
@@ -110,7 +174,10 @@ ctb::MbTilesDb::~MbTilesDb() {
 void
 ctb::MbTilesDb::loadRenderedTiles(std::unordered_set<uint64_t>& renderedTiles) {
   sqlite3_stmt *stmt;
-  if (sqlite3_prepare_v2(mbTiles, "SELECT zoom_level, tile_column, tile_row FROM tiles;", -1, &stmt, nullptr) != SQLITE_OK) {
+  const char *query = deduplicated
+    ? "SELECT zoom_level, tile_column, tile_row FROM map;"
+    : "SELECT zoom_level, tile_column, tile_row FROM tiles;";
+  if (sqlite3_prepare_v2(mbTiles, query, -1, &stmt, nullptr) != SQLITE_OK) {
     std::string err = "Could not prepare tile fetching statement";
     throw std::runtime_error(err);
   }
@@ -136,6 +203,10 @@ ctb::MbTilesDb::loadRenderedTiles(std::unordered_set<uint64_t>& renderedTiles) {
 }
 
 void ctb::MbTilesDb::writeTile(int z, int x, int y, const char *data, int size) {
+  if (deduplicated) {
+    throw std::runtime_error("The tiles of a deduplicated database are written as images and their map");
+  }
+
   sqlite3_stmt *stmt = tile_stmt;
   sqlite3_reset(stmt);
   sqlite3_clear_bindings(stmt);
@@ -149,6 +220,44 @@ void ctb::MbTilesDb::writeTile(int z, int x, int y, const char *data, int size)
   }
 }
 
+bool ctb::MbTilesDb::hasImage(std::string const& tileId) const {
+  return imageIds.find(tileId) != imageIds.end();
+}
+
+void ctb::MbTilesDb::writeImage(std::string const& tileId, const char *data, int size) {
+  sqlite3_stmt *stmt = image_stmt;
+  sqlite3_reset(stmt);
+  sqlite3_clear_bindings(stmt);
+  sqlite3_bind_text(stmt, 1, tileId.c_str(), -1, SQLITE_TRANSIENT);
+  sqlite3_bind_blob(stmt, 2, data, size, NULL);
+  if (sqlite3_step(stmt) != SQLITE_DONE) {
+    std::ostringstream err;
+    err << "SQLite Error: image insert failed: " << sqlite3_errmsg(mbTiles);
+    throw std::runtime_error(err.str());
+  }
+  imageIds.insert(tileId);
+}
+
+void ctb::MbTilesDb::writeMap(int z, int x, int y, std::string const& tileId) {
+  // The `tiles` view would hide a tile mapped to a missing image
+  if (!hasImage(tileId)) {
+    throw std::runtime_error("A tile can only be mapped to an image already stored");
+  }
+
+  sqlite3_stmt *stmt = map_stmt;
+  sqlite3_reset(stmt);
+  sqlite3_clear_bindings(stmt);
+  sqlite3_bind_int(stmt, 1, z);
+  sqlite3_bind_int(stmt, 2, x);
+  sqlite3_bind_int(stmt, 3, y);
+  sqlite3_bind_text(stmt, 4, tileId.c_str(), -1, SQLITE_TRANSIENT);
+  if (sqlite3_step(stmt) != SQLITE_DONE) {
+    std::ostringstream err;
+    err << "SQLite Error: map insert failed: " << sqlite3_errmsg(mbTiles);
+    throw std::runtime_error(err.str());
+  }
+}
+
 void ctb::MbTilesDb::quote(std::ostringstream & buf, std::string const& input) {
   for (auto & ch : input) {
     if (ch == '\\' || ch == '\"') {
@@ -189,7 +298,7 @@ bool ctb::MbTilesDb::tileExists(ctb::i_zoom z, ctb::i_tile x, ctb::i_tile y) {
 
   char *sql, *err;
 
-  sql = sqlite3_mprintf("SELECT zoom_level, tile_column, tile_row FROM tiles WHERE zoom_level = %u AND tile_column = %u AND tile_row = %u;", z, x, y);
+  sql = sqlite3_mprintf("SELECT zoom_level, tile_column, tile_row FROM %s WHERE zoom_level = %u AND tile_column = %u AND tile_row = %u;", deduplicated ? "map" : "tiles", z, x, y);
 
   sqlite3_stmt *stmt;
   if (sqlite3_prepare_v2(mbTiles, sql, -1, &stmt, nullptr) != SQLITE_OK) {
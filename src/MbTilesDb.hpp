@@ -48,15 +48,39 @@ namespace ctb {
   class MbTilesDb;
 }
 
+/**
+ * An MBTiles database
+ *
+ * The tiles are stored either in a single `tiles` table or, deduplicated, in a
+ * `map` table giving the identifier of the image of each tile and an `images`
+ * table storing each distinct image once, with a `tiles` view joining them so
+ * readers see the usual schema.  The identifier of an image is the hex
+ * `ContentHash` of its content.  An existing database keeps its schema.
+ */
 class CTB_DLL ctb::MbTilesDb {
 public:
-  MbTilesDb(std::string const& dbname);
+  MbTilesDb(std::string const& dbname, bool deduplicate = false);
   virtual ~MbTilesDb();
 
   void loadRenderedTiles(std::unordered_set<uint64_t>& renderedTiles);
 
+  /// Write a tile to a database which is not deduplicated
   void writeTile(int z, int x, int y, const char *data, int size);
 
+  /// Are the tiles stored as deduplicated images?
+  inline bool isDeduplicated() const {
+    return deduplicated;
+  }
+
+  /// Is an image stored in a deduplicated database?
+  bool hasImage(std::string const& tileId) const;
+
+  /// Store an image in a deduplicated database, unless it is already there, throwing on failure
+  void writeImage(std::string const& tileId, const char *data, int size);
+
+  /// Map a tile to an image already stored in a deduplicated database, throwing on failure
+  void writeMap(int z, int x, int y, std::string const& tileId);
+
   void quote(std::ostringstream & buf, std::string const& input);
 
   void saveMetadata(const std::stringstream & strm);
@@ -71,8 +95,18 @@ public:
     layer_map_type const &layermap);
 */
 protected:
+  /// Create the tables of a deduplicated database
+  void createDeduplicatedSchema();
+
   sqlite3* mbTiles;
   sqlite3_stmt* tile_stmt;
+
+  /// Are the tiles stored as deduplicated images?
+  bool deduplicated;
+  sqlite3_stmt* map_stmt;
+  sqlite3_stmt* image_stmt;
+  /// The identifiers of the stored images
+  std::unordered_set<std::string> imageIds;
 };
 
 
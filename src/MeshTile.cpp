@@ -21,14 +21,17 @@
  */
 
 #include <cmath>
+#include <limits>
 #include <vector>
 #include <map>
+#include <string.h>             // for memcmp
 #include "cpl_conv.h"
 
 #include "CTBException.hpp"
 #include "MeshTile.hpp"
 #include "BoundingSphere.hpp"
 #include "CTBZOutputStream.hpp"
+#include "HeightKernels.hpp"
 
 using namespace ctb;
 
@@ -110,7 +113,7 @@ static inline CRSVertex ocp_fromPoints(const std::vector<CRSVertex> &points, con
 
 // PACKAGE IO
 const double SHORT_MAX = 32767.0;
-const int BYTESPLIT = 65636;
+const int BYTESPLIT = 65536;
 
 static inline int quantizeIndices(const double &origin, const double &factor, const double &value) {
   return int(std::round((value - origin) * factor));
@@ -119,19 +122,15 @@ static inline int quantizeIndices(const double &origin, const double &factor, co
 // Write the edge indices of the mesh
 template <typename T> int writeEdgeIndices(CTBOutputStream &ostream, const Mesh &mesh, double edgeCoord, int componentIndex) {
   std::vector<uint32_t> indices;
-  std::map<uint32_t, size_t> ihash;
+  std::vector<bool> visited(mesh.vertices.size(), false);
 
   for (size_t i = 0, icount = mesh.indices.size(); i < icount; i++) {
     uint32_t indice = mesh.indices[i];
     double val = mesh.vertices[indice][componentIndex];
 
-    if (val == edgeCoord) {
-      std::map<uint32_t, size_t>::iterator it = ihash.find(indice);
-
-      if (it == ihash.end()) {
-        ihash.insert(std::make_pair(indice, i));
-        indices.push_back(indice);
-      }
+    if (val == edgeCoord && !visited[indice]) {
+      visited[indice] = true;
+      indices.push_back(indice);
     }
   }
 
@@ -208,7 +207,7 @@ MeshTile::MeshTile(const TileCoordinate &coord):
 void 
 MeshTile::writeFile(const char *fileName, bool writeVertexNormals) const {
   CTBZFileOutputStream ostream(fileName);
-  writeFile(ostream);
+  writeFile(ostream, writeVertexNormals);
 }
 
 /**
@@ -223,15 +222,24 @@ MeshTile::writeFile(CTBOutputStream &ostream, bool writeVertexNormals) const {
   BoundingBox<double> cartesianBounds;
   BoundingBox<double> bounds;
 
+  // The heights of the vertices were read as `Float32`, so their range is
+  // found by the height kernels, counting any nodata height as a height
+  std::vector<float> heights(mMesh.vertices.size());
+
   cartesianVertices.resize(mMesh.vertices.size());
   for (size_t i = 0, icount = mMesh.vertices.size(); i < icount; i++) {
     const CRSVertex &vertex = mMesh.vertices[i];
     cartesianVertices[i] = LLH2ECEF(vertex);
+    heights[i] = (float) vertex.z;
   }
   cartesianBoundingSphere.fromPoints(cartesianVertices);
   cartesianBounds.fromPoints(cartesianVertices);
   bounds.fromPoints(mMesh.vertices);
 
+  const HeightKernels::Range heightRange = HeightKernels::heightRange(heights.data(), heights.size(), std::numeric_limits<float>::quiet_NaN());
+  bounds.min.z = heightRange.minHeight;
+  bounds.max.z = heightRange.maxHeight;
+
 
   // # Write the mesh header data:
   // # https://github.com/AnalyticalGraphicsInc/quantized-mesh
@@ -291,6 +299,12 @@ MeshTile::writeFile(CTBOutputStream &ostream, bool writeVertexNormals) const {
   }
 
   // # Write mesh indices:
+  // 32 bit indices are padded to a 4 byte boundary: the header plus the vertex
+  // count take 92 bytes, each vertex takes 6 bytes.
+  if (vertexCount > BYTESPLIT && (vertexCount & 1)) {
+    uint16_t padding = 0;
+    ostream.write(&padding, sizeof(uint16_t));
+  }
   int triangleCount = mMesh.indices.size() / 3;
   ostream.write(&triangleCount, sizeof(int));
   if (vertexCount > BYTESPLIT) {
@@ -366,6 +380,53 @@ MeshTile::writeFile(CTBOutputStream &ostream, bool writeVertexNormals) const {
       ostream.write(&xy.y, sizeof(unsigned char));
     }
   }
+
+  // # Write 'Water Mask' (a single value when all land or all water):
+  if (!mWaterMask.empty()) {
+    unsigned char extensionId = 2;
+    ostream.write(&extensionId, sizeof(unsigned char));
+    uint32_t extensionLength = mWaterMask.size();
+    ostream.write(&extensionLength, sizeof(uint32_t));
+    ostream.write(mWaterMask.data(), extensionLength);
+  }
+
+  // # Write 'Metadata' with the availability of the tiles below:
+  if (!mMetadata.empty()) {
+    unsigned char extensionId = 4;
+    ostream.write(&extensionId, sizeof(unsigned char));
+    uint32_t jsonLength = mMetadata.size();
+    uint32_t extensionLength = sizeof(uint32_t) + jsonLength;
+    ostream.write(&extensionLength, sizeof(uint32_t));
+    ostream.write(&jsonLength, sizeof(uint32_t));
+    ostream.write(mMetadata.data(), jsonLength);
+  }
+}
+
+const std::string &
+MeshTile::getMetadata() const {
+  return mMetadata;
+}
+
+void
+MeshTile::setMetadata(const std::string &json) {
+  mMetadata = json;
+}
+
+bool
+MeshTile::hasWaterMask() const {
+  return !mWaterMask.empty();
+}
+
+void
+MeshTile::setWaterMask(const unsigned char *mask) {
+  const unsigned int MASK_CELL_SIZE = MASK_SIZE * MASK_SIZE;
+
+  // A mask is uniform when it equals itself shifted by one value
+  if (memcmp(mask, mask + 1, MASK_CELL_SIZE - 1) == 0) {
+    mWaterMask.assign(1, mask[0] ? 255 : 0);
+  } else {
+    mWaterMask.assign(mask, mask + MASK_CELL_SIZE);
+  }
 }
 
 bool
@@ -23,6 +23,8 @@
  * @author Alvaro Huarte <ahuarte47@yahoo.es>
  */
 
+#include <string>
+
 #include "config.hpp"
 #include "Mesh.hpp"
 #include "TileCoordinate.hpp"
@@ -109,11 +111,33 @@ public:
   /// Get the mesh data
   ctb::Mesh & getMesh();
 
+  /// Get the JSON object written as the `metadata` extension
+  const std::string & getMetadata() const;
+
+  /// Set the JSON object written as the `metadata` extension, empty for none
+  void setMetadata(const std::string &json);
+
+  /// Does this tile have a water mask, either uniform or not?
+  bool hasWaterMask() const;
+
+  /**
+   * @brief Set the water mask from `MASK_SIZE * MASK_SIZE` values
+   *
+   * A uniform mask is stored as a single value.
+   */
+  void setWaterMask(const unsigned char *mask);
+
 protected:
 
   /// The terrain mesh data
   ctb::Mesh mMesh;
 
+  /// The JSON object of the `metadata` extension
+  std::string mMetadata;
+
+  /// The water mask, empty for none, one value when uniform
+  std::vector<unsigned char> mWaterMask;
+
 private:
 
   char mChildren;               ///< The child flags
@@ -20,10 +20,13 @@
  * @author Alvaro Huarte <ahuarte47@yahoo.es>
  */
 
+#include <algorithm>
+
 #include "CTBException.hpp"
 #include "MeshTiler.hpp"
 #include "HeightFieldChunker.hpp"
 #include "GDALDatasetReader.hpp"
+#include "TileArena.hpp"
 
 using namespace ctb;
 
@@ -39,7 +42,7 @@ private:
   double mCellSizeX;
   double mCellSizeY;
 
-  std::map<int, int> mIndicesMap;
+  std::vector<int> mIndicesMap;
   Coordinate<int> mTriangles[3];
   bool mTriOddOrder;
   int mTriIndex;
@@ -52,12 +55,15 @@ public:
     mTriIndex(0) {
     mCellSizeX = (bounds.getMaxX() - bounds.getMinX()) / (double)(tileSizeX - 1);
     mCellSizeY = (bounds.getMaxY() - bounds.getMinY()) / (double)(tileSizeY - 1);
+
+    // One slot per grid cell, -1 means that the cell has no vertex yet.
+    mIndicesMap.resize(tileSizeX * tileSizeY, -1);
   }
 
   virtual void clear() {
     mMesh.vertices.clear();
     mMesh.indices.clear();
-    mIndicesMap.clear();
+    std::fill(mIndicesMap.begin(), mIndicesMap.end(), -1);
     mTriOddOrder = false;
     mTriIndex = 0;
   }
@@ -87,12 +93,10 @@ public:
     }
   }
   void appendVertex(const ctb::chunk::heightfield &heightfield, int x, int y) {
-    int iv;
     int index = heightfield.indexOfGridCoordinate(x, y);
+    int iv = mIndicesMap[index];
 
-    std::map<int, int>::iterator it = mIndicesMap.find(index);
-
-    if (it == mIndicesMap.end()) {
+    if (iv == -1) {
       iv = mMesh.vertices.size();
 
       double xmin = mBounds.getMinX();
@@ -100,10 +104,7 @@ public:
       double height = heightfield.height(x, y);
 
       mMesh.vertices.push_back(CRSVertex(xmin + (x * mCellSizeX), ymax - (y * mCellSizeY), height));
-      mIndicesMap.insert(std::make_pair(index, iv));
-    }
-    else {
-      iv = it->second;
+      mIndicesMap[index] = iv;
     }
     mMesh.indices.push_back(iv);
   }
@@ -145,51 +146,86 @@ ctb::MeshTiler::prepareSettingsOfTile(MeshTile *terrainTile, const TileCoordinat
   heightfield.clear();
 
   // If we are not at the maximum zoom level we need to set child flags on the
-  // tile where child tiles overlap the dataset bounds.
+  // tile where child tiles have data.
   if (coord.zoom != maxZoomLevel()) {
-    CRSBounds tileBounds = mGrid.tileBounds(coord);
+    bool children[4];
+    childrenWithData(coord, rasterHeights, tileSizeX, tileSizeY, children);
 
-    if (! (bounds().overlaps(tileBounds))) {
-      terrainTile->setAllChildren(false);
-    } else {
-      if (bounds().overlaps(tileBounds.getSW())) {
-        terrainTile->setChildSW();
-      }
-      if (bounds().overlaps(tileBounds.getNW())) {
-        terrainTile->setChildNW();
-      }
-      if (bounds().overlaps(tileBounds.getNE())) {
-        terrainTile->setChildNE();
-      }
-      if (bounds().overlaps(tileBounds.getSE())) {
-        terrainTile->setChildSE();
-      }
-    }
+    terrainTile->setChildSW(children[0]);
+    terrainTile->setChildSE(children[1]);
+    terrainTile->setChildNW(children[2]);
+    terrainTile->setChildNE(children[3]);
+  }
+}
+
+i_zoom
+ctb::MeshTiler::maxZoomLevel() const {
+  const i_tile tileSize = mGrid.tileSize();
+  return mGrid.zoomForResolution(resolution() * (tileSize - 1) / (double)tileSize);
+}
+
+bool
+ctb::MeshTiler::isValidTileSize(i_tile tileSize) {
+  return ctb::chunk::heightfield::isValidSize(tileSize);
+}
+
+void
+ctb::MeshTiler::checkTileSize(const Grid &grid) {
+  if (!isValidTileSize(grid.tileSize())) {
+    throw CTBException("The grid tile size of a mesh tiler must be (2^n) + 1, e.g. 65, 129, 257 or 513");
   }
 }
 
 MeshTile *
 ctb::MeshTiler::createMesh(GDALDataset *dataset, const TileCoordinate &coord) const {
-  // Copy the raster data into an array
-  float *rasterHeights = ctb::GDALDatasetReader::readRasterHeights(*this, dataset, coord, mGrid.tileSize(), mGrid.tileSize());
+  // Copy the raster data (and the water mask) into an array
+  std::vector<unsigned char> rasterMask(options.maskBand > 0 ? MASK_SIZE * MASK_SIZE : 0);
+  float *rasterHeights = ctb::GDALDatasetReader::readRasterHeights(*this, dataset, coord, mGrid.tileSize(), mGrid.tileSize(), rasterMask.empty() ? NULL : rasterMask.data());
 
   // Get a mesh tile represented by the tile coordinate
   MeshTile *terrainTile = new MeshTile(coord);
   prepareSettingsOfTile(terrainTile, coord, rasterHeights, mGrid.tileSize(), mGrid.tileSize());
   CPLFree(rasterHeights);
+  if (!rasterMask.empty()) terrainTile->setWaterMask(rasterMask.data());
 
   return terrainTile;
 }
 
 MeshTile *
 ctb::MeshTiler::createMesh(GDALDataset *dataset, const TileCoordinate &coord, ctb::GDALDatasetReader *reader) const {
-  // Copy the raster data into an array
-  float *rasterHeights = reader->readRasterHeights(dataset, coord, mGrid.tileSize(), mGrid.tileSize());
+  // Copy the raster data (and the water mask) into an array
+  std::vector<unsigned char> rasterMask(options.maskBand > 0 ? MASK_SIZE * MASK_SIZE : 0);
+  float *rasterHeights = reader->readRasterHeights(dataset, coord, mGrid.tileSize(), mGrid.tileSize(), rasterMask.empty() ? NULL : rasterMask.data());
 
   // Get a mesh tile represented by the tile coordinate
   MeshTile *terrainTile = new MeshTile(coord);
   prepareSettingsOfTile(terrainTile, coord, rasterHeights, mGrid.tileSize(), mGrid.tileSize());
   CPLFree(rasterHeights);
+  if (!rasterMask.empty()) terrainTile->setWaterMask(rasterMask.data());
+
+  return terrainTile;
+}
+
+MeshTile *
+ctb::MeshTiler::createMesh(GDALDataset *dataset, const TileCoordinate &coord, ctb::GDALDatasetReader *reader, TileArena &arena) const {
+  readTileHeights(dataset, coord, reader, arena);
+  return createMesh(coord, arena);
+}
+
+MeshTile *
+ctb::MeshTiler::createMesh(const TileCoordinate &coord, TileArena &arena) const {
+  const i_tile tileSize = mGrid.tileSize();
+
+  // Reset the mesh tile of the arena to the tile coordinate
+  MeshTile *terrainTile = &arena.meshTile;
+  static_cast<TileCoordinate &>(*terrainTile) = coord;
+  terrainTile->setAllChildren(false);
+  terrainTile->setIsValid();
+  terrainTile->mMetadata.clear();
+  terrainTile->mWaterMask.clear();
+
+  prepareSettingsOfTile(terrainTile, coord, arena.heights.data(), tileSize, tileSize);
+  if (!arena.mask.empty()) terrainTile->setWaterMask(arena.mask.data());
 
   return terrainTile;
 }
@@ -28,6 +28,7 @@
 
 namespace ctb {
   class MeshTiler;
+  class TileArena;              // forward declaration
 }
 
 /**
@@ -44,7 +45,9 @@ public:
   /// Instantiate a tiler with all required arguments
   MeshTiler(GDALDataset *poDataset, const Grid &grid, const TilerOptions &options, double meshQualityFactor = 1.0):
     TerrainTiler(poDataset, grid, options),
-    mMeshQualityFactor(meshQualityFactor) {}
+    mMeshQualityFactor(meshQualityFactor) {
+    checkTileSize(grid);
+  }
 
   /// Instantiate a tiler with an empty GDAL dataset
   MeshTiler(double meshQualityFactor = 1.0):
@@ -54,12 +57,28 @@ public:
   /// Instantiate a tiler with a dataset and grid but no options
   MeshTiler(GDALDataset *poDataset, const Grid &grid, double meshQualityFactor = 1.0):
     TerrainTiler(poDataset, grid, TilerOptions()),
-    mMeshQualityFactor(meshQualityFactor) {}
+    mMeshQualityFactor(meshQualityFactor) {
+    checkTileSize(grid);
+  }
 
   /// Overload the assignment operator
   MeshTiler &
   operator=(const MeshTiler &other);
 
+  /**
+   * @brief Get the maximum zoom level for the dataset
+   *
+   * A mesh tile of `N` samples spans `N - 1` cells, so the zoom level is
+   * chosen from the cell size of the heightfield rather than from the grid
+   * resolution.
+   */
+  virtual i_zoom
+  maxZoomLevel() const;
+
+  /// Is the tile size valid for the heightfield chunker, i.e. `(2^n) + 1`?
+  static bool
+  isValidTileSize(i_tile tileSize);
+
   /// Create a mesh from a tile coordinate
   MeshTile *
   createMesh(GDALDataset *dataset, const TileCoordinate &coord) const;
@@ -68,6 +87,20 @@ public:
   MeshTile *
   createMesh(GDALDataset *dataset, const TileCoordinate &coord, GDALDatasetReader *reader) const;
 
+  /**
+   * @brief Create a mesh from a tile coordinate into the mesh tile of an arena
+   *
+   * The heights are read into the buffers of the arena and the vectors of the
+   * mesh keep their capacity.  The tile returned is the mesh tile of the
+   * arena: it must not be deleted.
+   */
+  MeshTile *
+  createMesh(GDALDataset *dataset, const TileCoordinate &coord, GDALDatasetReader *reader, TileArena &arena) const;
+
+  /// Create a mesh from the heights already read into an arena with `readTileHeights`
+  MeshTile *
+  createMesh(const TileCoordinate &coord, TileArena &arena) const;
+
 protected:
 
   // Specifies the factor of the quality to convert terrain heightmaps to meshes.
@@ -80,6 +113,10 @@ protected:
     int tileWidth, 
     int numberOfTilesAtLevelZero);
 
+  /// Throw an exception if the grid tile size is not supported
+  static void
+  checkTileSize(const Grid &grid);
+
   /// Assigns settings of Tile just to use.
   void prepareSettingsOfTile(MeshTile *tile, const TileCoordinate &coord, float *rasterHeights, ctb::i_tile tileSizeX, ctb::i_tile tileSizeY) const;
 };
@@ -0,0 +1,204 @@
+/*******************************************************************************
+ * Copyright 2018 GeoData <geodata@soton.ac.uk>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not
+ * use this file except in compliance with the License.  You may obtain a copy
+ * of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ *******************************************************************************/
+
+/**
+ * @file OverviewCache.cpp
+ * @brief This defines the `OverviewCache` class
+ */
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <sstream>
+
+#include "cpl_vsi.h"
+
+#include "OverviewCache.hpp"
+
+using namespace ctb;
+
+double OverviewCache::maxPixels = 1 << 26;
+
+namespace {
+
+/// The state of a copy in the cache
+struct Entry {
+  std::string filename;
+  bool ready;                   ///< Has the creation finished?
+  bool failed;                  ///< Did the creation fail?
+};
+
+/// The copies, keyed by source and bands, then by factor
+std::map<std::string, std::map<int, Entry> > entries;
+std::mutex mutex;
+std::condition_variable created;
+int fileCount = 0;
+
+}
+
+std::string
+OverviewCache::getOverview(GDALDataset *dataset, const std::vector<int> &bands, int factor) {
+  const double pixels = ((double) dataset->GetRasterXSize() / factor) * ((double) dataset->GetRasterYSize() / factor);
+  if (factor < 2 || pixels > maxPixels || bands.empty()) {
+    return std::string();
+  }
+
+  // Identify the source by its description and bands
+  std::ostringstream key;
+  key << dataset->GetDescription();
+  if (strlen(dataset->GetDescription()) == 0) key << (void *) dataset;
+  for (size_t i = 0; i < bands.size(); i++) key << ":" << bands[i];
+
+  std::unique_lock<std::mutex> lock(mutex);
+  std::map<int, Entry> &copies = entries[key.str()];
+
+  // Wait for a copy being created by another thread
+  std::map<int, Entry>::iterator it = copies.find(factor);
+  if (it != copies.end()) {
+    created.wait(lock, [&]() { return it->second.ready; });
+    return it->second.failed ? std::string() : it->second.filename;
+  }
+
+  std::ostringstream filename;
+  filename << "/vsimem/ctb-overview-" << fileCount++ << ".tif";
+  Entry &entry = copies[factor];
+  entry.filename = filename.str();
+  entry.ready = entry.failed = false;
+
+  // Start from the closest finer copy available
+  std::string source;
+  int sourceFactor = 1;
+  for (it = copies.begin(); it != copies.end() && it->first < factor; ++it) {
+    if (it->second.ready && !it->second.failed && factor % it->first == 0) {
+      source = it->second.filename;
+      sourceFactor = it->first;
+    }
+  }
+  lock.unlock();
+
+  bool ok = false;
+  if (source.empty()) {
+    ok = createOverview(dataset, bands, factor, entry.filename);
+  } else {
+    GDALDataset *poSource = (GDALDataset *) GDALOpen(source.c_str(), GA_ReadOnly);
+
+    if (poSource) {
+      std::vector<int> sourceBands(poSource->GetRasterCount());
+      for (size_t i = 0; i < sourceBands.size(); i++) sourceBands[i] = i + 1;
+
+      ok = createOverview(poSource, sourceBands, factor / sourceFactor, entry.filename);
+      GDALClose(poSource);
+    }
+  }
+
+  lock.lock();
+  entry.ready = true;
+  entry.failed = !ok;
+  created.notify_all();
+
+  return ok ? entry.filename : std::string();
+}
+
+/**
+ * @details The copy is written as a tiled GeoTIFF with the data type of the
+ * bands, a strip of rows at a time, using average resampling which ignores
+ * nodata.  Its size is rounded up and its geo transform adjusted so it covers
+ * the extent of the source exactly.
+ */
+bool
+OverviewCache::createOverview(GDALDataset *dataset, const std::vector<int> &bands, int factor, const std::string &filename) {
+  GDALDriver *poDriver = GetGDALDriverManager()->GetDriverByName("GTiff");
+  double adfGeoTransform[6];
+
+  if (poDriver == NULL || dataset->GetGeoTransform(adfGeoTransform) != CE_None) {
+    return false;
+  }
+
+  const int sourceXSize = dataset->GetRasterXSize(),
+    sourceYSize = dataset->GetRasterYSize(),
+    xSize = (sourceXSize + factor - 1) / factor,
+    ySize = (sourceYSize + factor - 1) / factor;
+
+  GDALDataType dataType = dataset->GetRasterBand(bands[0])->GetRasterDataType();
+  for (size_t i = 1; i < bands.size(); i++) {
+    dataType = GDALDataTypeUnion(dataType, dataset->GetRasterBand(bands[i])->GetRasterDataType());
+  }
+
+  CPLStringList options;
+  options.SetNameValue("TILED", "YES");
+
+  GDALDataset *poOverview = poDriver->Create(filename.c_str(), xSize, ySize, bands.size(), dataType, options.List());
+  if (poOverview == NULL) {
+    return false;
+  }
+
+  adfGeoTransform[1] *= (double) sourceXSize / xSize;
+  adfGeoTransform[2] *= (double) sourceYSize / ySize;
+  adfGeoTransform[4] *= (double) sourceXSize / xSize;
+  adfGeoTransform[5] *= (double) sourceYSize / ySize;
+  poOverview->SetGeoTransform(adfGeoTransform);
+  poOverview->SetProjection(dataset->GetProjectionRef());
+
+  // Copy the bands a strip at a time
+  const int stripRows = 256;
+  std::vector<double> buffer((size_t) xSize * stripRows);
+  bool ok = true;
+
+  GDALRasterIOExtraArg sExtraArg;
+  INIT_RASTERIO_EXTRA_ARG(sExtraArg);
+  sExtraArg.eResampleAlg = GRIORA_Average;
+
+  for (size_t i = 0; i < bands.size() && ok; i++) {
+    GDALRasterBand *poSourceBand = dataset->GetRasterBand(bands[i]),
+      *poBand = poOverview->GetRasterBand(i + 1);
+
+    int bGotNoData = FALSE;
+    const double noDataValue = poSourceBand->GetNoDataValue(&bGotNoData);
+    if (bGotNoData) poBand->SetNoDataValue(noDataValue);
+
+    for (int row = 0; row < ySize && ok; row += stripRows) {
+      const int rows = std::min(stripRows, ySize - row),
+        sourceRow = (int) ((double) row * sourceYSize / ySize),
+        sourceRows = (int) ((double) (row + rows) * sourceYSize / ySize) - sourceRow;
+
+      ok = poSourceBand->RasterIO(GF_Read, 0, sourceRow, sourceXSize, sourceRows,
+                                  buffer.data(), xSize, rows, GDT_Float64,
+                                  0, 0, &sExtraArg) == CE_None
+        && poBand->RasterIO(GF_Write, 0, row, xSize, rows,
+                            buffer.data(), xSize, rows, GDT_Float64,
+                            0, 0) == CE_None;
+    }
+  }
+
+  GDALClose(poOverview);
+  if (!ok) VSIUnlink(filename.c_str());
+
+  return ok;
+}
+
+void
+OverviewCache::clear() {
+  std::lock_guard<std::mutex> lock(mutex);
+
+  for (auto &copies : entries) {
+    for (auto &copy : copies.second) {
+      if (copy.second.ready && !copy.second.failed) VSIUnlink(copy.second.filename.c_str());
+    }
+  }
+  entries.clear();
+}
@@ -0,0 +1,77 @@
+#ifndef OVERVIEWCACHE_HPP
+#define OVERVIEWCACHE_HPP
+
+/*******************************************************************************
+ * Copyright 2018 GeoData <geodata@soton.ac.uk>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not
+ * use this file except in compliance with the License.  You may obtain a copy
+ * of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ *******************************************************************************/
+
+/**
+ * @file OverviewCache.hpp
+ * @brief This declares the `OverviewCache` class
+ */
+
+#include <string>
+#include <vector>
+
+#include "gdal_priv.h"
+
+#include "config.hpp"
+
+namespace ctb {
+  class OverviewCache;
+}
+
+/**
+ * @brief A process wide cache of reduced resolution copies of datasets
+ *
+ * Warping a low zoom level tile from a large source without overviews reads
+ * far more pixels than the tile holds, and can fail altogether.  This cache
+ * creates a reduced resolution copy of the source bands once, in memory
+ * (`/vsimem`), for every power of two reduction factor that is requested.
+ * Each copy is derived from the closest finer copy already available.
+ *
+ * The copies are identified by the description of the source dataset (its
+ * file name), the bands and the factor, so the different dataset handles of
+ * the worker threads share them.  Each thread opens its own handle on a copy
+ * from the returned file name.
+ */
+class CTB_DLL ctb::OverviewCache {
+public:
+
+  /**
+   * @brief Get the file name of a reduced resolution copy of some bands of a dataset
+   *
+   * The copy is created if needed, while other threads requesting it wait.
+   * An empty string is returned if the copy would exceed `maxPixels` or could
+   * not be created.
+   */
+  static std::string
+  getOverview(GDALDataset *dataset, const std::vector<int> &bands, int factor);
+
+  /// Delete all the copies
+  static void
+  clear();
+
+  /// The maximum number of pixels of a copy
+  static double maxPixels;
+
+protected:
+
+  /// Create a copy of the bands of a dataset reduced by a factor
+  static bool
+  createOverview(GDALDataset *dataset, const std::vector<int> &bands, int factor, const std::string &filename);
+};
+
+#endif /* OVERVIEWCACHE_HPP */
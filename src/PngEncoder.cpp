@@ -0,0 +1,190 @@
+/*******************************************************************************
+ * Copyright 2018 GeoData <geodata@soton.ac.uk>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not
+ * use this file except in compliance with the License.  You may obtain a copy
+ * of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ *******************************************************************************/
+
+/**
+ * @file PngEncoder.cpp
+ * @brief This defines the `PngEncoder` class
+ */
+
+#include <cstdlib>
+#include <cstring>
+
+#include "CTBException.hpp"
+#include "PngEncoder.hpp"
+
+using namespace ctb;
+
+ctb::PngEncoder::PngEncoder(Filter filter, int compressionLevel):
+  mFilter(filter)
+{
+  if (compressionLevel < 0 || compressionLevel > 9) {
+    throw CTBException("The PNG compression level must be between 0 and 9");
+  }
+
+  mStream.zalloc = Z_NULL;
+  mStream.zfree = Z_NULL;
+  mStream.opaque = Z_NULL;
+
+  // The image data of a PNG is a zlib stream
+  if (deflateInit(&mStream, compressionLevel) != Z_OK) {
+    throw CTBException("Failed to initialise the zlib stream");
+  }
+}
+
+ctb::PngEncoder::~PngEncoder() {
+  deflateEnd(&mStream);
+}
+
+/**
+ * @details Each row is filtered against the previous row and added to the
+ * scanlines, which are then compressed in one go.
+ */
+void
+ctb::PngEncoder::encode(const unsigned char *pixels, i_tile width, i_tile height, int channels, const unsigned char *transparent) {
+  // The colour type of each number of channels
+  static const unsigned char colourTypes[5] = { 0, 0, 4, 2, 6 };
+
+  if (channels < 1 || channels > 4) {
+    throw CTBException("A PNG image has from 1 to 4 channels");
+  }
+  const size_t length = (size_t) width * channels;
+
+  mZeros.assign(length, 0);
+  mCandidate.resize(length + 1);
+  mScanlines.resize((length + 1) * height);
+
+  for (i_tile y = 0; y < height; y++) {
+    const unsigned char *row = pixels + length * y,
+      *previous = (y > 0) ? row - length : mZeros.data();
+    unsigned char *scanline = &mScanlines[(length + 1) * y];
+
+    if (mFilter != FilterAdaptive) {
+      filterRow(mFilter, row, previous, length, channels, scanline);
+      continue;
+    }
+
+    // Keep the filter whose bytes, taken as signed, sum to the least
+    unsigned long best = 0;
+    for (int filter = FilterNone; filter <= FilterPaeth; filter++) {
+      filterRow((Filter) filter, row, previous, length, channels, mCandidate.data());
+
+      unsigned long sum = 0;
+      for (size_t i = 1; i <= length; i++) {
+        sum += std::abs((int) (signed char) mCandidate[i]);
+      }
+      if (filter == FilterNone || sum < best) {
+        best = sum;
+        std::memcpy(scanline, mCandidate.data(), length + 1);
+      }
+    }
+  }
+
+  // Compress the scanlines
+  deflateReset(&mStream);
+  mCompressed.resize(deflateBound(&mStream, (uLong) mScanlines.size()));
+  mStream.next_in = mScanlines.data();
+  mStream.avail_in = (uInt) mScanlines.size();
+  mStream.next_out = mCompressed.data();
+  mStream.avail_out = (uInt) mCompressed.size();
+  if (deflate(&mStream, Z_FINISH) != Z_STREAM_END) {
+    throw CTBException("Failed to compress the PNG image");
+  }
+  mCompressed.resize(mCompressed.size() - mStream.avail_out);
+
+  // The signature, an 8 bit header, the transparency, the data and the end
+  static const unsigned char signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+  const unsigned char header[13] = {
+    (unsigned char) (width >> 24), (unsigned char) (width >> 16), (unsigned char) (width >> 8), (unsigned char) width,
+    (unsigned char) (height >> 24), (unsigned char) (height >> 16), (unsigned char) (height >> 8), (unsigned char) height,
+    8,                          // bit depth
+    colourTypes[channels],
+    0, 0, 0                     // compression, filter and interlace methods
+  };
+
+  mImage.assign(signature, signature + sizeof(signature));
+  appendChunk("IHDR", header, sizeof(header));
+  if (transparent && (channels == 1 || channels == 3)) {
+    // Each sample of the colour is 16 bits
+    unsigned char colour[6] = { 0 };
+    for (int i = 0; i < channels; i++) {
+      colour[i * 2 + 1] = transparent[i];
+    }
+    appendChunk("tRNS", colour, channels * 2);
+  }
+  appendChunk("IDAT", mCompressed.data(), mCompressed.size());
+  appendChunk("IEND", NULL, 0);
+}
+
+/**
+ * @details The scanline starts with the type of the filter followed by the
+ * filtered bytes, each predicted from the byte of the previous pixel (`a`),
+ * the byte above (`b`) and the byte above the previous pixel (`c`).
+ */
+void
+ctb::PngEncoder::filterRow(Filter filter, const unsigned char *row, const unsigned char *previous, size_t length, int channels, unsigned char *scanline) {
+  *scanline++ = (unsigned char) filter;
+
+  for (size_t i = 0; i < length; i++) {
+    const int a = (i >= (size_t) channels) ? row[i - channels] : 0,
+      b = previous[i],
+      c = (i >= (size_t) channels) ? previous[i - channels] : 0;
+    int prediction;
+
+    switch (filter) {
+    case FilterSub:
+      prediction = a;
+      break;
+    case FilterUp:
+      prediction = b;
+      break;
+    case FilterAverage:
+      prediction = (a + b) / 2;
+      break;
+    case FilterPaeth: {
+      const int p = a + b - c,
+        pa = std::abs(p - a),
+        pb = std::abs(p - b),
+        pc = std::abs(p - c);
+      prediction = (pa <= pb && pa <= pc) ? a : (pb <= pc) ? b : c;
+      break;
+    }
+    default:
+      prediction = 0;
+      break;
+    }
+
+    scanline[i] = (unsigned char) (row[i] - prediction);
+  }
+}
+
+void
+ctb::PngEncoder::appendChunk(const char *type, const unsigned char *data, size_t length) {
+  const unsigned char size[4] = {
+    (unsigned char) (length >> 24), (unsigned char) (length >> 16), (unsigned char) (length >> 8), (unsigned char) length
+  };
+  mImage.insert(mImage.end(), size, size + 4);
+
+  // The checksum covers the type and the data
+  const size_t start = mImage.size();
+  mImage.insert(mImage.end(), type, type + 4);
+  if (length > 0) mImage.insert(mImage.end(), data, data + length);
+
+  const uLong crc = crc32(crc32(0L, Z_NULL, 0), &mImage[start], (uInt) (mImage.size() - start));
+  const unsigned char checksum[4] = {
+    (unsigned char) (crc >> 24), (unsigned char) (crc >> 16), (unsigned char) (crc >> 8), (unsigned char) crc
+  };
+  mImage.insert(mImage.end(), checksum, checksum + 4);
+}
@@ -0,0 +1,113 @@
+#ifndef PNGENCODER_HPP
+#define PNGENCODER_HPP
+
+/*******************************************************************************
+ * Copyright 2018 GeoData <geodata@soton.ac.uk>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not
+ * use this file except in compliance with the License.  You may obtain a copy
+ * of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ *******************************************************************************/
+
+/**
+ * @file PngEncoder.hpp
+ * @brief This declares the `PngEncoder` class
+ */
+
+#include <vector>
+#include "zlib.h"
+
+#include "config.hpp"
+#include "types.hpp"
+
+namespace ctb {
+  class PngEncoder;
+}
+
+/**
+ * @brief Encode 8 bit pixels as a PNG image in memory
+ *
+ * The PNG is written with zlib directly rather than through a GDAL driver.
+ * Pixels of one to four channels are written as grey, grey and alpha, RGB or
+ * RGBA images respectively.  The row filter and the zlib compression level
+ * trade the size of the images for the time taken to encode them.  The
+ * encoder keeps its buffers and zlib stream from one image to the next, so
+ * each thread should have its own.
+ */
+class CTB_DLL ctb::PngEncoder {
+public:
+
+  /// The filter of the rows of the image
+  enum Filter {
+    FilterNone = 0,
+    FilterSub = 1,
+    FilterUp = 2,
+    FilterAverage = 3,
+    FilterPaeth = 4,
+    FilterAdaptive              ///< The filter giving the smallest sum of each row
+  };
+
+  /// Instantiate an encoder with a zlib compression level from `0` to `9`
+  PngEncoder(Filter filter = FilterUp, int compressionLevel = 6);
+
+  virtual ~PngEncoder();
+
+  /**
+   * @brief Encode interleaved pixels, rows from the north, as the image of the encoder
+   *
+   * A grey or RGB image can be given the colour of its transparent pixels,
+   * one byte per channel.
+   */
+  void
+  encode(const unsigned char *pixels, i_tile width, i_tile height, int channels, const unsigned char *transparent = NULL);
+
+  /// The bytes of the last image encoded
+  inline const unsigned char *
+  data() const {
+    return mImage.data();
+  }
+
+  /// The number of bytes of the last image encoded
+  inline size_t
+  size() const {
+    return mImage.size();
+  }
+
+protected:
+
+  /// Filter a row of pixels into a scanline, given the previous row
+  static void
+  filterRow(Filter filter, const unsigned char *row, const unsigned char *previous, size_t length, int channels, unsigned char *scanline);
+
+  /// Append a chunk to the image
+  void
+  appendChunk(const char *type, const unsigned char *data, size_t length);
+
+  /// The filter of the rows
+  Filter mFilter;
+
+  /// The zlib stream
+  z_stream mStream;
+
+  /// The zero row above the first
+  std::vector<unsigned char> mZeros;
+  /// The filtered scanlines of the image, and a scanline being tried
+  std::vector<unsigned char> mScanlines, mCandidate;
+  /// The compressed scanlines
+  std::vector<unsigned char> mCompressed;
+  /// The bytes of the image
+  std::vector<unsigned char> mImage;
+
+  PngEncoder(const PngEncoder &) = delete;
+  PngEncoder &operator=(const PngEncoder &) = delete;
+};
+
+#endif /* PNGENCODER_HPP */
@@ -0,0 +1,69 @@
+/*******************************************************************************
+ * Copyright 2018 GeoData <geodata@soton.ac.uk>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not
+ * use this file except in compliance with the License.  You may obtain a copy
+ * of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ *******************************************************************************/
+
+/**
+ * @file PngHeightEncoder.cpp
+ * @brief This defines the `PngHeightEncoder` class
+ */
+
+#include <cmath>
+
+#include "PngHeightEncoder.hpp"
+
+using namespace ctb;
+
+/// The bytes of an RGB pixel
+static const size_t PIXEL_SIZE = 3;
+
+void
+ctb::PngHeightEncoder::encode(const float *heights, i_tile width, i_tile height, float noDataValue) {
+  const size_t length = (size_t) width * PIXEL_SIZE;
+
+  mPixels.resize(length * height);
+  for (i_tile y = 0; y < height; y++) {
+    packRow(heights + (size_t) width * y, width, noDataValue, &mPixels[length * y]);
+  }
+
+  PngEncoder::encode(mPixels.data(), width, height, (int) PIXEL_SIZE);
+}
+
+void
+ctb::PngHeightEncoder::packRow(const float *heights, i_tile width, float noDataValue, unsigned char *pixels) const {
+  for (i_tile x = 0; x < width; x++, pixels += PIXEL_SIZE) {
+    double height = heights[x];
+    if (height == noDataValue || std::isnan(height)) height = 0;
+
+    if (mEncoding == TerrainRGB) {
+      // Tenths of a metre above -10000 metres
+      const double value = std::floor((height + 10000) * 10 + 0.5);
+      const unsigned int units = (value < 0) ? 0 : (value > 0xffffff) ? 0xffffff : (unsigned int) value;
+
+      pixels[0] = (unsigned char) (units >> 16);
+      pixels[1] = (unsigned char) (units >> 8);
+      pixels[2] = (unsigned char) units;
+    } else {
+      // Metres above -32768 metres, the fraction in the blue channel
+      double value = height + 32768;
+      if (value < 0) value = 0;
+      if (value > 65535 + 255 / 256.0) value = 65535 + 255 / 256.0;
+      const unsigned int metres = (unsigned int) value;
+
+      pixels[0] = (unsigned char) (metres >> 8);
+      pixels[1] = (unsigned char) metres;
+      pixels[2] = (unsigned char) ((value - metres) * 256);
+    }
+  }
+}
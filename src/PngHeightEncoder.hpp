@@ -0,0 +1,91 @@
+#ifndef PNGHEIGHTENCODER_HPP
+#define PNGHEIGHTENCODER_HPP
+
+/*******************************************************************************
+ * Copyright 2018 GeoData <geodata@soton.ac.uk>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not
+ * use this file except in compliance with the License.  You may obtain a copy
+ * of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ *******************************************************************************/
+
+/**
+ * @file PngHeightEncoder.hpp
+ * @brief This declares the `PngHeightEncoder` class
+ */
+
+#include <vector>
+
+#include "config.hpp"
+#include "types.hpp"
+#include "PngEncoder.hpp"
+
+namespace ctb {
+  class PngHeightEncoder;
+}
+
+/**
+ * @brief Encode heights as the RGB pixels of a PNG image
+ *
+ * This packs a buffer of `Float32` heights, such as the heights a
+ * `TerrainTiler` reads for a tile, into one of the elevation encodings read by
+ * web map clients before writing the image as a `PngEncoder`:
+ *
+ * - `TerrainRGB`, the Mapbox encoding, where the height is
+ *   `-10000 + (R * 65536 + G * 256 + B) * 0.1` metres.
+ * - `Terrarium`, the Mapzen encoding, where the height is
+ *   `(R * 256 + G + B / 256) - 32768` metres.
+ *
+ * Nodata is encoded as sea level, as in terrain tiles.
+ */
+class CTB_DLL ctb::PngHeightEncoder :
+  public PngEncoder
+{
+public:
+
+  /// The packing of the heights into RGB pixels
+  enum Encoding {
+    TerrainRGB,                 ///< Mapbox Terrain-RGB
+    Terrarium                   ///< Mapzen Terrarium
+  };
+
+  /// Instantiate an encoder with a zlib compression level from `0` to `9`
+  PngHeightEncoder(Encoding encoding = TerrainRGB, Filter filter = FilterUp, int compressionLevel = 6):
+    PngEncoder(filter, compressionLevel),
+    mEncoding(encoding)
+  {}
+
+  using PngEncoder::encode;
+
+  /// Encode heights, rows from the north, as the image of the encoder
+  void
+  encode(const float *heights, i_tile width, i_tile height, float noDataValue);
+
+  /// Get the encoding of the heights
+  inline Encoding
+  encoding() const {
+    return mEncoding;
+  }
+
+protected:
+
+  /// Pack the heights of a row into RGB pixels
+  void
+  packRow(const float *heights, i_tile width, float noDataValue, unsigned char *pixels) const;
+
+  /// The packing of the heights
+  Encoding mEncoding;
+
+  /// The RGB pixels of the heights
+  std::vector<unsigned char> mPixels;
+};
+
+#endif /* PNGHEIGHTENCODER_HPP */
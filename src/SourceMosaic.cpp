@@ -0,0 +1,373 @@
+/*******************************************************************************
+ * Copyright 2018 GeoData <geodata@soton.ac.uk>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not
+ * use this file except in compliance with the License.  You may obtain a copy
+ * of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ *******************************************************************************/
+
+/**
+ * @file SourceMosaic.cpp
+ * @brief This defines the `SourceMosaic` class
+ */
+
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+
+#include "cpl_conv.h"
+#include "cpl_vsi.h"
+
+#include "CTBException.hpp"
+#include "MeshTiler.hpp"
+#include "RasterTiler.hpp"
+#include "SourceMosaic.hpp"
+
+using namespace ctb;
+
+/// The maximum number of children of an R-tree node
+static const size_t NODE_CAPACITY = 16;
+
+/// Record the footprint, resolution and maximum zoom level of a source as seen by a type of tiler
+template<typename T> static void
+describeSource(GDALDataset *poDataset, const Grid &grid, SourceMosaic::Source &source) {
+  const T tiler(poDataset, grid);
+  source.bounds = tiler.bounds();
+  source.resolution = tiler.resolution();
+  source.maxZoom = tiler.maxZoomLevel();
+}
+
+SourceMosaic::SourceMosaic(const std::vector<std::string> &filenames, const Grid &grid, bool meshTiles, unsigned int maxHandles):
+  mResolution(0),
+  mBandCount(0),
+  mDataType(GDT_Float32),
+  mNoDataValue(-32768),
+  mHasNoData(false),
+  mMaxHandles(maxHandles),
+  mOpenHandles(0)
+{
+  if (filenames.empty()) {
+    throw CTBException("The mosaic has no sources");
+  }
+
+  // Record the footprint of each source
+  for (size_t i = 0; i < filenames.size(); i++) {
+    GDALDataset *poDataset = (GDALDataset *) GDALOpen(filenames[i].c_str(), GA_ReadOnly);
+    if (poDataset == NULL) {
+      throw CTBException(("Could not open the mosaic source " + filenames[i]).c_str());
+    }
+
+    Source source;
+    source.filename = filenames[i];
+    try {
+      if (meshTiles) {
+        describeSource<MeshTiler>(poDataset, grid, source);
+      } else {
+        describeSource<RasterTiler>(poDataset, grid, source);
+      }
+    } catch (...) {
+      GDALClose(poDataset);
+      throw;
+    }
+
+    // The sources must share their bands, as they are read as one dataset
+    GDALRasterBand *poBand = poDataset->GetRasterBand(1);
+    int bGotNoData = FALSE;
+    const int bandCount = poDataset->GetRasterCount();
+    const GDALDataType dataType = poBand->GetRasterDataType();
+    const double noDataValue = poBand->GetNoDataValue(&bGotNoData);
+
+    if (mSources.empty()) {
+      mBandCount = bandCount;
+      mDataType = dataType;
+      mHasNoData = bGotNoData;
+      if (bGotNoData) mNoDataValue = noDataValue;
+
+      mBounds = source.bounds;
+      mResolution = source.resolution;
+    } else {
+      const char *mismatch = NULL;
+      if (bandCount != mBandCount) {
+        mismatch = "band count";
+      } else if (dataType != mDataType) {
+        mismatch = "data type";
+      } else if ((bool) bGotNoData != mHasNoData ||
+                 (bGotNoData && noDataValue != mNoDataValue && !(std::isnan(noDataValue) && std::isnan(mNoDataValue)))) {
+        mismatch = "nodata value";
+      }
+      if (mismatch) {
+        GDALClose(poDataset);
+        throw CTBException(("The mosaic source " + filenames[i] + " does not have the " + mismatch + " of " + filenames[0]).c_str());
+      }
+
+      mBounds = CRSBounds(std::min(mBounds.getMinX(), source.bounds.getMinX()),
+                          std::min(mBounds.getMinY(), source.bounds.getMinY()),
+                          std::max(mBounds.getMaxX(), source.bounds.getMaxX()),
+                          std::max(mBounds.getMaxY(), source.bounds.getMaxY()));
+      mResolution = std::min(mResolution, source.resolution);
+    }
+    GDALClose(poDataset);
+
+    mSources.push_back(source);
+  }
+
+  char *gridWKT = NULL;
+  if (grid.getSRS().exportToWkt(&gridWKT) != OGRERR_NONE) {
+    CPLFree(gridWKT);
+    throw CTBException("Could not create grid WKT string");
+  }
+  mGridWKT = gridWKT;
+  CPLFree(gridWKT);
+
+  // Pack the footprints into an R-tree
+  std::vector<Node> level(mSources.size());
+  for (size_t i = 0; i < mSources.size(); i++) {
+    level[i].bounds = mSources[i].bounds;
+    level[i].first = i;
+    level[i].count = 0;
+  }
+
+  while (level.size() > 1) {
+    std::vector<Node> parents = packLevel(level);
+    mLevels.push_back(level);
+    level.swap(parents);
+  }
+  mLevels.push_back(level);     // the root
+}
+
+SourceMosaic::~SourceMosaic() {
+  for (auto &handle : mIdle) {
+    GDALClose(handle.second);
+  }
+}
+
+std::vector<std::string>
+SourceMosaic::listSources(const std::string &path) {
+  std::vector<std::string> filenames;
+  VSIStatBufL statbuf;
+
+  if (VSIStatL(path.c_str(), &statbuf) != 0) {
+    throw CTBException(("Could not find the mosaic sources " + path).c_str());
+  }
+
+  if (VSI_ISDIR(statbuf.st_mode)) {
+    char **papszFiles = VSIReadDir(path.c_str());
+
+    for (char **papszFile = papszFiles; papszFile && *papszFile; ++papszFile) {
+      if (strcmp(*papszFile, ".") == 0 || strcmp(*papszFile, "..") == 0) continue;
+
+      const std::string filename = CPLFormFilename(path.c_str(), *papszFile, NULL);
+      if (GDALIdentifyDriver(filename.c_str(), NULL) != NULL) {
+        filenames.push_back(filename);
+      }
+    }
+    CSLDestroy(papszFiles);
+
+    std::sort(filenames.begin(), filenames.end());
+  } else {
+    std::ifstream list(path.c_str());
+    const std::string directory = CPLGetPath(path.c_str());
+    std::string line;
+
+    // Relative names are relative to the list
+    while (std::getline(list, line)) {
+      line.erase(0, line.find_first_not_of(" \t\r"));
+      line.erase(line.find_last_not_of(" \t\r") + 1);
+      if (line.empty() || line[0] == '#') continue;
+
+      filenames.push_back(CPLIsFilenameRelative(line.c_str())
+                          ? std::string(CPLFormFilename(directory.c_str(), line.c_str(), NULL))
+                          : line);
+    }
+  }
+
+  return filenames;
+}
+
+/**
+ * @details The nodes are sorted by the x of their centre and cut into
+ * vertical slices, and each slice is sorted by y and cut into parents, so
+ * the parents hold nodes that are close together.
+ */
+std::vector<SourceMosaic::Node>
+SourceMosaic::packLevel(std::vector<Node> &level) {
+  const size_t parentCount = (level.size() + NODE_CAPACITY - 1) / NODE_CAPACITY,
+    sliceCount = (size_t) std::ceil(std::sqrt((double) parentCount)),
+    sliceSize = sliceCount * NODE_CAPACITY;
+
+  std::sort(level.begin(), level.end(), [](const Node &a, const Node &b) {
+      return a.bounds.getMinX() + a.bounds.getMaxX() < b.bounds.getMinX() + b.bounds.getMaxX();
+    });
+
+  std::vector<Node> parents;
+  for (size_t slice = 0; slice < level.size(); slice += sliceSize) {
+    const size_t sliceEnd = std::min(slice + sliceSize, level.size());
+
+    std::sort(level.begin() + slice, level.begin() + sliceEnd, [](const Node &a, const Node &b) {
+        return a.bounds.getMinY() + a.bounds.getMaxY() < b.bounds.getMinY() + b.bounds.getMaxY();
+      });
+
+    for (size_t first = slice; first < sliceEnd; first += NODE_CAPACITY) {
+      Node parent;
+      parent.first = first;
+      parent.count = std::min(NODE_CAPACITY, sliceEnd - first);
+      parent.bounds = level[first].bounds;
+
+      for (size_t i = first + 1; i < first + parent.count; i++) {
+        const CRSBounds &bounds = level[i].bounds;
+        parent.bounds = CRSBounds(std::min(parent.bounds.getMinX(), bounds.getMinX()),
+                                  std::min(parent.bounds.getMinY(), bounds.getMinY()),
+                                  std::max(parent.bounds.getMaxX(), bounds.getMaxX()),
+                                  std::max(parent.bounds.getMaxY(), bounds.getMaxY()));
+      }
+      parents.push_back(parent);
+    }
+  }
+
+  return parents;
+}
+
+void
+SourceMosaic::search(size_t level, const Node &node, const CRSBounds &bounds, std::vector<size_t> &result) const {
+  if (!node.bounds.overlaps(bounds)) {
+    return;
+  }
+  if (node.count == 0) {
+    result.push_back(node.first);
+    return;
+  }
+
+  const std::vector<Node> &children = mLevels[level - 1];
+  for (size_t i = node.first; i < node.first + node.count; i++) {
+    search(level - 1, children[i], bounds, result);
+  }
+}
+
+std::vector<size_t>
+SourceMosaic::intersecting(const CRSBounds &bounds) const {
+  std::vector<size_t> result;
+
+  search(mLevels.size() - 1, mLevels.back()[0], bounds, result);
+  std::sort(result.begin(), result.end());
+
+  return result;
+}
+
+std::vector<size_t>
+SourceMosaic::select(const CRSBounds &bounds, double resolution) const {
+  std::vector<size_t> result = intersecting(bounds);
+
+  std::stable_sort(result.begin(), result.end(), [&](size_t a, size_t b) {
+      const double resolutionA = mSources[a].resolution,
+        resolutionB = mSources[b].resolution;
+      const bool fineA = resolutionA <= resolution,
+        fineB = resolutionB <= resolution;
+
+      if (fineA != fineB) return fineA;
+      return fineA ? resolutionA > resolutionB : resolutionA < resolutionB;
+    });
+
+  return result;
+}
+
+i_zoom
+SourceMosaic::maxZoom(const CRSBounds &bounds) const {
+  i_zoom zoom = 0;
+
+  for (size_t index : intersecting(bounds)) {
+    zoom = std::max(zoom, mSources[index].maxZoom);
+  }
+  return zoom;
+}
+
+/**
+ * @details An idle handle on the source is reused if there is one, otherwise
+ * a new handle is counted, making room by closing the least recently used
+ * idle handle, and opened outside of the lock.
+ */
+GDALDataset *
+SourceMosaic::acquire(size_t index) {
+  {
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    for (auto it = mIdle.begin(); it != mIdle.end(); ++it) {
+      if (it->first == index) {
+        GDALDataset *poDataset = it->second;
+        mIdle.erase(it);
+        return poDataset;
+      }
+    }
+
+    mOpenHandles++;
+    closeIdle();
+  }
+
+  GDALDataset *poDataset = (GDALDataset *) GDALOpen(mSources[index].filename.c_str(), GA_ReadOnly);
+  if (poDataset == NULL) {
+    std::lock_guard<std::mutex> lock(mMutex);
+    mOpenHandles--;
+    throw CTBException(("Could not open the mosaic source " + mSources[index].filename).c_str());
+  }
+  return poDataset;
+}
+
+void
+SourceMosaic::release(size_t index, GDALDataset *dataset) {
+  std::lock_guard<std::mutex> lock(mMutex);
+
+  mIdle.push_front(std::make_pair(index, dataset));
+  closeIdle();
+}
+
+void
+SourceMosaic::closeIdle() {
+  while (mOpenHandles > mMaxHandles && !mIdle.empty()) {
+    GDALClose(mIdle.back().second);
+    mIdle.pop_back();
+    mOpenHandles--;
+  }
+}
+
+/**
+ * @details The dataset is a VRT without any sources, so it holds no pixels
+ * and reads as nodata.  When the mosaic is wider or taller than a GDAL
+ * dataset can be at its finest resolution, the resolution of the footprint
+ * is coarsened to fit.
+ */
+GDALDataset *
+SourceMosaic::createFootprint() const {
+  GDALDriver *poDriver = GetGDALDriverManager()->GetDriverByName("VRT");
+  if (poDriver == NULL) {
+    throw CTBException("Could not retrieve VRT GDAL driver");
+  }
+
+  const double maxSize = INT_MAX - 1,
+    resolution = std::max(mResolution, std::max(mBounds.getWidth(), mBounds.getHeight()) / maxSize),
+    xSize = std::max(1.0, std::min(std::ceil(mBounds.getWidth() / resolution), maxSize)),
+    ySize = std::max(1.0, std::min(std::ceil(mBounds.getHeight() / resolution), maxSize));
+
+  GDALDataset *poDataset = poDriver->Create("", (int) xSize, (int) ySize, mBandCount, mDataType, NULL);
+  if (poDataset == NULL) {
+    throw CTBException("Could not create the mosaic footprint");
+  }
+
+  double adfGeoTransform[6] = { mBounds.getMinX(), resolution, 0, mBounds.getMaxY(), 0, -resolution };
+  poDataset->SetGeoTransform(adfGeoTransform);
+  poDataset->SetProjection(mGridWKT.c_str());
+
+  for (int i = 1; i <= mBandCount; i++) {
+    poDataset->GetRasterBand(i)->SetNoDataValue(mNoDataValue);
+  }
+
+  return poDataset;
+}
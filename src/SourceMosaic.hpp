@@ -0,0 +1,189 @@
+#ifndef SOURCEMOSAIC_HPP
+#define SOURCEMOSAIC_HPP
+
+/*******************************************************************************
+ * Copyright 2018 GeoData <geodata@soton.ac.uk>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not
+ * use this file except in compliance with the License.  You may obtain a copy
+ * of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ *******************************************************************************/
+
+/**
+ * @file SourceMosaic.hpp
+ * @brief This declares the `SourceMosaic` class
+ */
+
+#include <list>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "gdal_priv.h"
+
+#include "config.hpp"
+#include "types.hpp"
+#include "Grid.hpp"
+
+namespace ctb {
+  class SourceMosaic;
+}
+
+/**
+ * @brief A mosaic of many GDAL datasets indexed by their footprints
+ *
+ * Each source file is opened once to record its footprint and resolution in
+ * the grid spatial reference system, and the footprints are packed into an
+ * R-tree (sort tile recursive) so the sources intersecting a tile are found
+ * without visiting all of them.  The sources are kept in priority order: the
+ * first source with data at a point wins among sources of the same resolution.
+ *
+ * Sources of different resolutions are chosen per tile: the coarsest source
+ * that is at least as fine as the tile is used first, so fine sources only
+ * take over at the zoom levels that need them.  Each source also limits the
+ * zoom levels of the region it covers to its own maximum zoom level.
+ *
+ * The sources must have the same band count, data type and nodata value.
+ *
+ * Sources are opened on demand through a pool of handles shared by all
+ * threads.  A handle is used by one thread at a time, and idle handles are
+ * closed least recently used first once more than a maximum are open, those
+ * in use included.
+ *
+ * Tilers still need a dataset to work out their extent and zoom levels from:
+ * `createFootprint` creates an empty virtual dataset covering the mosaic at
+ * its finest resolution for that purpose.
+ */
+class CTB_DLL ctb::SourceMosaic {
+public:
+
+  /// A source dataset of the mosaic
+  struct Source {
+    std::string filename;       ///< The name the source is opened with
+    CRSBounds bounds;           ///< The footprint in the grid SRS
+    double resolution;          ///< The pixel size in the grid SRS
+    i_zoom maxZoom;             ///< The zoom level matching the resolution
+  };
+
+  /// Index the sources of a mosaic, in priority order, with the maximum zoom levels of mesh tiles if `meshTiles` is set
+  SourceMosaic(const std::vector<std::string> &filenames, const Grid &grid, bool meshTiles = false, unsigned int maxHandles = 64);
+
+  /// Close all the handles
+  ~SourceMosaic();
+
+  /**
+   * @brief List the sources in a directory or listed in a text file
+   *
+   * The files of a directory are sorted by name and those GDAL does not
+   * recognise are ignored.  A text file names one source per line.
+   */
+  static std::vector<std::string>
+  listSources(const std::string &path);
+
+  /// Get the sources
+  inline const std::vector<Source> &
+  sources() const {
+    return mSources;
+  }
+
+  /// Get the extent of all the sources
+  inline const CRSBounds &
+  bounds() const {
+    return mBounds;
+  }
+
+  /// Get the indices of the sources overlapping an extent, in priority order
+  std::vector<size_t>
+  intersecting(const CRSBounds &bounds) const;
+
+  /**
+   * @brief Get the indices of the sources overlapping an extent, in the order to read them at a resolution
+   *
+   * The sources at least as fine as the resolution come first, from the
+   * coarsest, followed by the coarser sources from the finest, so the samples
+   * a source leaves as nodata are filled from the next best source.  Sources
+   * of the same resolution are in priority order.
+   */
+  std::vector<size_t>
+  select(const CRSBounds &bounds, double resolution) const;
+
+  /// Get the highest maximum zoom level of the sources overlapping an extent, `0` if there are none
+  i_zoom
+  maxZoom(const CRSBounds &bounds) const;
+
+  /// Get a handle on a source for the exclusive use of the caller
+  GDALDataset *
+  acquire(size_t index);
+
+  /// Give back a handle obtained from `acquire`
+  void
+  release(size_t index, GDALDataset *dataset);
+
+  /// Create an empty dataset covering the mosaic at its finest resolution, or coarser if that is too large
+  GDALDataset *
+  createFootprint() const;
+
+protected:
+
+  /// A node of the R-tree
+  struct Node {
+    CRSBounds bounds;           ///< The extent of the children
+    size_t first;               ///< The first child, or the source of a leaf
+    size_t count;               ///< The number of children, `0` for a leaf
+  };
+
+  /// Pack a level of nodes into their parents, sorting the level
+  static std::vector<Node>
+  packLevel(std::vector<Node> &level);
+
+  /// Add the sources below a node that overlap an extent
+  void
+  search(size_t level, const Node &node, const CRSBounds &bounds, std::vector<size_t> &result) const;
+
+  /// Close the least recently used idle handles while too many are open, with the lock held
+  void
+  closeIdle();
+
+  /// The sources in priority order
+  std::vector<Source> mSources;
+
+  /// The extent of all the sources
+  CRSBounds mBounds;
+
+  /// The finest resolution of the sources
+  double mResolution;
+
+  /// The number of bands, data type and nodata value of the sources
+  int mBandCount;
+  GDALDataType mDataType;
+  double mNoDataValue;
+  bool mHasNoData;
+
+  /// The grid spatial reference system
+  std::string mGridWKT;
+
+  /// The levels of the R-tree, from the leaves up to the root
+  std::vector<std::vector<Node> > mLevels;
+
+  /// The idle handles, most recently used first
+  std::list<std::pair<size_t, GDALDataset *> > mIdle;
+
+  /// The maximum number of open handles
+  unsigned int mMaxHandles;
+
+  /// The number of open handles, idle or in use
+  unsigned int mOpenHandles;
+
+  /// Serialises the access to the handles
+  std::mutex mMutex;
+};
+
+#endif /* SOURCEMOSAIC_HPP */
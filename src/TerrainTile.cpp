@@ -76,8 +76,9 @@ Terrain::Terrain(FILE *fp):
   }
 
   // Get the water mask
-  mMaskLength = fread(mMask, 1, MASK_CELL_SIZE, fp);
-  switch (mMaskLength) {
+  mMask.resize(MASK_CELL_SIZE);
+  mMask.resize(fread(mMask.data(), 1, MASK_CELL_SIZE, fp));
+  switch (mMask.size()) {
   case MASK_CELL_SIZE:
     break;
   case 1:
@@ -109,12 +110,13 @@ Terrain::readFile(const char *fileName) {
   gzclose(terrainFile);
 
   // Check the water mask type
+  size_t maskLength;
   switch(inflatedBytes) {
   case MAX_TERRAIN_SIZE:      // a water mask is present
-    mMaskLength = MASK_CELL_SIZE;
+    maskLength = MASK_CELL_SIZE;
     break;
   case (TILE_CELL_SIZE * 2) + 2:   // there is no water mask
-    mMaskLength = 1;
+    maskLength = 1;
     break;
   default:                    // it can't be a terrain file
     throw CTBException("File has wrong file size to be a valid terrain");
@@ -130,7 +132,8 @@ Terrain::readFile(const char *fileName) {
   mChildren = inflateBuffer[byteCount]; // byte 8451
 
   // Get the water mask
-  memcpy(mMask, &(inflateBuffer[++byteCount]), mMaskLength);
+  ++byteCount;
+  mMask.assign(inflateBuffer + byteCount, inflateBuffer + byteCount + maskLength);
 }
 
 /**
@@ -168,7 +171,7 @@ Terrain::writeFile(CTBOutputStream &ostream) const {
   }
 
   // Write the water mask
-  if (ostream.write(&mMask, mMaskLength) != mMaskLength) {
+  if (ostream.write(mMask.data(), mMask.size()) != mMask.size()) {
     throw CTBException("Failed to write water mask");
   }
 }
@@ -176,7 +179,7 @@ Terrain::writeFile(CTBOutputStream &ostream) const {
 std::vector<bool>
 Terrain::mask() {
   std::vector<bool> mask;
-  mask.assign(mMask, mMask + mMaskLength);
+  mask.assign(mMask.begin(), mMask.end());
   return mask;
 }
 
@@ -252,29 +255,41 @@ Terrain::setAllChildren(bool on) {
 
 void
 Terrain::setIsWater() {
-  mMask[0] = 1;
-  mMaskLength = 1;
+  mMask.assign(1, 1);
 }
 
 bool
 Terrain::isWater() const {
-  return mMaskLength == 1 && (bool) mMask[0];
+  return mMask.size() == 1 && (bool) mMask[0];
 }
 
 void
 Terrain::setIsLand() {
-  mMask[0] = 0;
-  mMaskLength = 1;
+  mMask.assign(1, 0);
 }
 
 bool
 Terrain::isLand() const {
-  return mMaskLength == 1 && ! (bool) mMask[0];
+  return mMask.size() == 1 && ! (bool) mMask[0];
 }
 
 bool
 Terrain::hasWaterMask() const {
-  return mMaskLength == MASK_CELL_SIZE;
+  return mMask.size() == MASK_CELL_SIZE;
+}
+
+void
+Terrain::setWaterMask(const unsigned char *mask) {
+  // A mask is uniform when it equals itself shifted by one value
+  if (memcmp(mask, mask + 1, MASK_CELL_SIZE - 1) == 0) {
+    if (mask[0]) {
+      setIsWater();
+    } else {
+      setIsLand();
+    }
+  } else {
+    mMask.assign(mask, mask + MASK_CELL_SIZE);
+  }
 }
 
 const std::vector<i_terrain_height> &
@@ -134,6 +134,14 @@ public:
   bool
   hasWaterMask() const;
 
+  /**
+   * @brief Set the water mask from `MASK_SIZE * MASK_SIZE` values
+   *
+   * A uniform mask is stored as all land or all water.
+   */
+  void
+  setWaterMask(const unsigned char *mask);
+
   /// Get the height data as a const vector
   const std::vector<i_terrain_height> &
   getHeights() const;
@@ -165,8 +173,7 @@ protected:
 private:
 
   char mChildren;               ///< The child flags
-  char mMask[MASK_CELL_SIZE];   ///< The water mask
-  size_t mMaskLength;           ///< What size is the water mask?
+  std::vector<char> mMask;      ///< The water mask, a single value when uniform
   bool isValid = true;
 
   /**
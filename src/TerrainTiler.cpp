@@ -22,6 +22,9 @@
 #include "CTBException.hpp"
 #include "TerrainTiler.hpp"
 #include "GDALDatasetReader.hpp"
+#include "HeightKernels.hpp"
+#include "PngHeightEncoder.hpp"
+#include "TileArena.hpp"
 
 using namespace ctb;
 
@@ -31,63 +34,105 @@ ctb::TerrainTiler::prepareSettingsOfTile(TerrainTile *terrainTile, const TileCoo
 
   // Convert the raster data into the terrain tile heights.  This assumes the
   // input raster data represents meters above sea level. Each terrain height
-  // value is the number of 1/5 meter units above -1000 meters.
-  // TODO: try doing this using a VRT derived band:
-  // (http://www.gdal.org/gdal_vrttut.html)
-  for (unsigned short int i = 0; i < TILE_CELL_SIZE; i++) {
-    terrainTile->mHeights[i] = (i_terrain_height) ((rasterHeights[i] + 1000) * 5);
-  }
+  // value is the number of 1/5 meter units above -1000 meters, clamped to the
+  // range of a terrain height, and nodata is sea level.
+  HeightKernels::convertHeights(rasterHeights, TILE_CELL_SIZE, heightsNoDataValue(), terrainTile->mHeights.data());
 
   // If we are not at the maximum zoom level we need to set child flags on the
-  // tile where child tiles overlap the dataset bounds.
+  // tile where child tiles have data.
   if (coord.zoom != maxZoomLevel()) {
-    CRSBounds tileBounds = mGrid.tileBounds(coord);
-
-    if (! (bounds().overlaps(tileBounds))) {
-      terrainTile->setAllChildren(false);
-    } else {
-      if (bounds().overlaps(tileBounds.getSW())) {
-        terrainTile->setChildSW();
-      }
-      if (bounds().overlaps(tileBounds.getNW())) {
-        terrainTile->setChildNW();
-      }
-      if (bounds().overlaps(tileBounds.getNE())) {
-        terrainTile->setChildNE();
-      }
-      if (bounds().overlaps(tileBounds.getSE())) {
-        terrainTile->setChildSE();
-      }
-    }
+    bool children[4];
+    childrenWithData(coord, rasterHeights, tileSizeX, tileSizeY, children);
+
+    terrainTile->setChildSW(children[0]);
+    terrainTile->setChildSE(children[1]);
+    terrainTile->setChildNW(children[2]);
+    terrainTile->setChildNE(children[3]);
   }
 }
 
 TerrainTile *
 ctb::TerrainTiler::createTile(GDALDataset *dataset, const TileCoordinate &coord) const {
-  // Copy the raster data into an array
-  float *rasterHeights = ctb::GDALDatasetReader::readRasterHeights(*this, dataset, coord, TILE_SIZE, TILE_SIZE);
+  // Copy the raster data (and the water mask) into an array
+  std::vector<unsigned char> rasterMask(options.maskBand > 0 ? MASK_SIZE * MASK_SIZE : 0);
+  float *rasterHeights = ctb::GDALDatasetReader::readRasterHeights(*this, dataset, coord, TILE_SIZE, TILE_SIZE, rasterMask.empty() ? NULL : rasterMask.data());
 
   // Get a terrain tile represented by the tile coordinate
   TerrainTile *terrainTile = new TerrainTile(coord);
   prepareSettingsOfTile(terrainTile, coord, rasterHeights, TILE_SIZE, TILE_SIZE);
   CPLFree(rasterHeights);
+  if (!rasterMask.empty()) terrainTile->setWaterMask(rasterMask.data());
 
   return terrainTile;
 }
 
 TerrainTile *
 ctb::TerrainTiler::createTile(GDALDataset *dataset, const TileCoordinate &coord, ctb::GDALDatasetReader *reader) const {
-  // Copy the raster data into an array
-  float *rasterHeights = reader->readRasterHeights(dataset, coord, TILE_SIZE, TILE_SIZE);
+  // Copy the raster data (and the water mask) into an array
+  std::vector<unsigned char> rasterMask(options.maskBand > 0 ? MASK_SIZE * MASK_SIZE : 0);
+  float *rasterHeights = reader->readRasterHeights(dataset, coord, TILE_SIZE, TILE_SIZE, rasterMask.empty() ? NULL : rasterMask.data());
 
   // Get a mesh tile represented by the tile coordinate
   TerrainTile *terrainTile = new TerrainTile(coord);
   prepareSettingsOfTile(terrainTile, coord, rasterHeights, TILE_SIZE, TILE_SIZE);
   CPLFree(rasterHeights);
+  if (!rasterMask.empty()) terrainTile->setWaterMask(rasterMask.data());
+
+  return terrainTile;
+}
+
+TerrainTile *
+ctb::TerrainTiler::createTile(GDALDataset *dataset, const TileCoordinate &coord, ctb::GDALDatasetReader *reader, TileArena &arena) const {
+  // Copy the raster data (and the water mask) into the buffers of the arena
+  arena.heights.resize(TILE_SIZE * TILE_SIZE);
+  arena.mask.resize(options.maskBand > 0 ? MASK_SIZE * MASK_SIZE : 0);
+  reader->readRasterHeightsInto(dataset, coord, TILE_SIZE, TILE_SIZE, arena.heights.data(), arena.mask.empty() ? NULL : arena.mask.data());
+
+  return createTile(coord, arena);
+}
+
+void
+ctb::TerrainTiler::readTileHeights(GDALDataset *dataset, const TileCoordinate &coord, ctb::GDALDatasetReader *reader, TileArena &arena) const {
+  const i_tile tileSize = mGrid.tileSize();
+
+  // Copy the raster data (and the water mask) into the buffers of the arena
+  arena.heights.resize((size_t) tileSize * tileSize);
+  arena.mask.resize(options.maskBand > 0 ? MASK_SIZE * MASK_SIZE : 0);
+  reader->readRasterHeightsInto(dataset, coord, tileSize, tileSize, arena.heights.data(), arena.mask.empty() ? NULL : arena.mask.data());
+}
+
+TerrainTile *
+ctb::TerrainTiler::createTile(const TileCoordinate &coord, TileArena &arena) const {
+  if (arena.heights.size() != TILE_SIZE * TILE_SIZE) {
+    throw CTBException("The heights of a terrain tile must be read with a tile size of 65");
+  }
+
+  // Reset the terrain tile of the arena to the tile coordinate
+  TerrainTile *terrainTile = &arena.terrainTile;
+  static_cast<TileCoordinate &>(*terrainTile) = coord;
+  terrainTile->setAllChildren(false);
+  terrainTile->setIsValid();
+
+  prepareSettingsOfTile(terrainTile, coord, arena.heights.data(), TILE_SIZE, TILE_SIZE);
+  if (!arena.mask.empty()) {
+    terrainTile->setWaterMask(arena.mask.data());
+  } else {
+    terrainTile->setIsLand();
+  }
 
   return terrainTile;
 }
 
+void
+ctb::TerrainTiler::encodeHeights(const TileArena &arena, PngHeightEncoder &encoder) const {
+  const i_tile tileSize = mGrid.tileSize();
+
+  if (arena.heights.size() != (size_t) tileSize * tileSize) {
+    throw CTBException("The heights of the tile have not been read on the grid of the tiler");
+  }
+  encoder.encode(arena.heights.data(), tileSize, tileSize, heightsNoDataValue());
+}
+
 GDALTile *
 ctb::TerrainTiler::createRasterTile(GDALDataset *dataset, const TileCoordinate &coord) const {
   // Ensure we have some data from which to create a tile
@@ -131,6 +176,29 @@ ctb::TerrainTiler::createRasterTile(GDALDataset *dataset, const TileCoordinate &
   return tile;
 }
 
+/**
+ * @details The heights are the only band of the raster tile: the water mask
+ * is warped on its own grid by `GDALDatasetReader::readRasterMask`.  Any other
+ * dataset, such as an overview created from the raster tiles, already holds
+ * only the heights and is warped as is.
+ */
+std::vector<int>
+ctb::TerrainTiler::warpBands(GDALDataset *dataset) const {
+  if (dataset != poDataset) {
+    return GDALTiler::warpBands(dataset);
+  }
+
+  const int bandCount = dataset->GetRasterCount();
+  if (options.heightBand < 1 || options.heightBand > bandCount) {
+    throw CTBException("The height band is not present in the GDAL dataset");
+  }
+  if (options.maskBand > bandCount) {
+    throw CTBException("The water mask band is not present in the GDAL dataset");
+  }
+
+  return std::vector<int>(1, options.heightBand);
+}
+
 TerrainTiler &
 ctb::TerrainTiler::operator=(const TerrainTiler &other) {
   GDALTiler::operator=(other);
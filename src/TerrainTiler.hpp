@@ -27,6 +27,8 @@
 
 namespace ctb {
   class TerrainTiler;
+  class TileArena;              // forward declaration
+  class PngHeightEncoder;       // forward declaration
 }
 
 /**
@@ -65,11 +67,43 @@ public:
   TerrainTile *
   createTile(GDALDataset *dataset, const TileCoordinate &coord, GDALDatasetReader *reader) const;
 
-protected:
+  /**
+   * @brief Create a tile from a tile coordinate into the tile of an arena
+   *
+   * The heights are read into the buffers of the arena, and the tile returned
+   * is the terrain tile of the arena: it must not be deleted.
+   */
+  TerrainTile *
+  createTile(GDALDataset *dataset, const TileCoordinate &coord, GDALDatasetReader *reader, TileArena &arena) const;
 
-  /// Create a `GDALTile` representing the required terrain tile data
-  virtual GDALTile *
-  createRasterTile(GDALDataset *dataset, const TileCoordinate &coord) const override;
+  /**
+   * @brief Read the heights of a tile into the buffers of an arena
+   *
+   * The heights are read on the grid of the tiler, so that the terrain tile
+   * and, for a `MeshTiler`, the mesh of the coordinate can both be created
+   * from them without reading the dataset again.
+   */
+  void
+  readTileHeights(GDALDataset *dataset, const TileCoordinate &coord, GDALDatasetReader *reader, TileArena &arena) const;
+
+  /**
+   * @brief Create a tile from the heights already read into an arena
+   *
+   * The heights must have been read with `readTileHeights` for the same
+   * coordinate on a grid with a tile size of 65.
+   */
+  TerrainTile *
+  createTile(const TileCoordinate &coord, TileArena &arena) const;
+
+  /**
+   * @brief Encode the heights already read into an arena as a PNG image
+   *
+   * The heights must have been read with `readTileHeights`, so the image has
+   * the tile size of the grid, by an `ImageTiler` for the pixels to cover the
+   * tile as XYZ and TMS clients expect.  The image is left in the encoder.
+   */
+  void
+  encodeHeights(const TileArena &arena, PngHeightEncoder &encoder) const;
 
   /**
    * @brief Get terrain bounds shifted to introduce a pixel overlap
@@ -102,6 +136,34 @@ protected:
     return tile;
   }
 
+  /**
+   * @brief Get the bounds of the raster the heights of a tile are sampled from
+   *
+   * The heights are the pixel centres of a raster of the tile size whose top
+   * left corner is that of the bounds, at the resolution set.  For terrain and
+   * mesh tiles these are the `terrainTileBounds`.
+   */
+  virtual CRSBounds
+  sampleBounds(const TileCoordinate &coord, double &resolution) const {
+    return terrainTileBounds(coord, resolution);
+  }
+
+  /// Do neighbouring tiles share their edge samples, as terrain tiles do?
+  virtual bool
+  sharesEdgeSamples() const {
+    return true;
+  }
+
+protected:
+
+  /// Create a `GDALTile` representing the required terrain tile data
+  virtual GDALTile *
+  createRasterTile(GDALDataset *dataset, const TileCoordinate &coord) const override;
+
+  /// Only warp the height band
+  virtual std::vector<int>
+  warpBands(GDALDataset *dataset) const override;
+
   /// Assigns settings of Tile just to use.
   void prepareSettingsOfTile(TerrainTile *tile, const TileCoordinate &coord, float *rasterHeights, ctb::i_tile tileSizeX, ctb::i_tile tileSizeY) const;
 };
@@ -0,0 +1,71 @@
+#ifndef TILEARENA_HPP
+#define TILEARENA_HPP
+
+/*******************************************************************************
+ * Copyright 2018 GeoData <geodata@soton.ac.uk>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not
+ * use this file except in compliance with the License.  You may obtain a copy
+ * of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ *******************************************************************************/
+
+/**
+ * @file TileArena.hpp
+ * @brief This declares and defines the `TileArena` class
+ */
+
+#include <vector>
+
+#include "config.hpp"
+#include "TerrainTile.hpp"
+#include "MeshTile.hpp"
+
+namespace ctb {
+  class TileArena;
+}
+
+/**
+ * @brief The buffers and tiles reused by a thread from one tile to the next
+ *
+ * Creating a tile through an arena reads the heights into the buffers of the
+ * arena and fills the tile of the arena rather than allocating new ones, so
+ * after the first few tiles the tilers no longer allocate memory for the
+ * heights, the tile or the vectors of a mesh.  A tile created through an
+ * arena belongs to it and is overwritten by the next tile created with it.
+ *
+ * An arena is not thread safe: each thread needs its own.
+ */
+class CTB_DLL ctb::TileArena {
+public:
+
+  /// Instantiate an empty arena
+  TileArena():
+    terrainTile(TileCoordinate())
+  {}
+
+  /// The raster heights of the last tile
+  std::vector<float> heights;
+
+  /// The water mask of the last tile, empty if none was read
+  std::vector<unsigned char> mask;
+
+  /// The terrain tile filled by `TerrainTiler::createTile`
+  TerrainTile terrainTile;
+
+  /// The mesh tile filled by `MeshTiler::createMesh`
+  MeshTile meshTile;
+
+  /// An arena is not copied
+  TileArena(const TileArena &) = delete;
+  TileArena &operator=(const TileArena &) = delete;
+};
+
+#endif /* TILEARENA_HPP */
@@ -0,0 +1,297 @@
+/*******************************************************************************
+ * Copyright 2018 GeoData <geodata@soton.ac.uk>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not
+ * use this file except in compliance with the License.  You may obtain a copy
+ * of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ *******************************************************************************/
+
+/**
+ * @file TileAvailability.cpp
+ * @brief This defines the `TileAvailability` class
+ */
+
+#include <algorithm>
+#include <limits>
+#include <sstream>
+
+#include "TileAvailability.hpp"
+
+using namespace ctb;
+
+TileAvailability::TileAvailability(const TileAvailability &other):
+  mLevels(other.mLevels),
+  mLastSpan(NULL)
+{}
+
+TileAvailability &
+TileAvailability::operator=(const TileAvailability &other) {
+  mLevels = other.mLevels;
+  mLastSpan = NULL;
+
+  return *this;
+}
+
+void
+TileAvailability::addRun(Column &column, i_tile startY, i_tile endY) {
+  // Fast path: extend or append to the last run
+  if (column.empty() || startY > column.back().endY + 1) {
+    Run run = { startY, endY };
+    column.push_back(run);
+    return;
+  }
+  if (startY >= column.back().startY) {
+    column.back().endY = std::max(column.back().endY, endY);
+    return;
+  }
+
+  // Find the first run touching the new one and merge the following ones
+  Column::iterator it = std::lower_bound(column.begin(), column.end(), startY,
+    [](const Run &run, i_tile y) { return run.endY + 1 < y; });
+
+  if (it->startY > endY + 1) {
+    Run run = { startY, endY };
+    column.insert(it, run);
+    return;
+  }
+  it->startY = std::min(it->startY, startY);
+  it->endY = std::max(it->endY, endY);
+
+  Column::iterator last = it + 1;
+  while (last != column.end() && last->startY <= it->endY + 1) {
+    it->endY = std::max(it->endY, last->endY);
+    ++last;
+  }
+  column.erase(it + 1, last);
+}
+
+TileAvailability::Level::const_iterator
+TileAvailability::findSpan(const Level &level, i_tile x) {
+  Level::const_iterator it = level.upper_bound(x);
+
+  if (it == level.begin()) {
+    return level.end();
+  }
+  --it;
+  return (it->second.endX >= x) ? it : level.end();
+}
+
+void
+TileAvailability::splitSpan(Level &level, i_tile x) {
+  Level::iterator it = level.upper_bound(x);
+
+  if (it == level.begin()) {
+    return;
+  }
+  --it;
+  if (it->first < x && it->second.endX >= x) {
+    Span &span = level[x];    // does not invalidate `it`
+    span.endX = it->second.endX;
+    span.column = it->second.column;
+    it->second.endX = x - 1;
+  }
+}
+
+void
+TileAvailability::addRange(Level &level, i_tile startX, i_tile endX, i_tile startY, i_tile endY) {
+  splitSpan(level, startX);
+  splitSpan(level, endX + 1);
+
+  // Add the runs to the spans within the range, filling any gap with a new span
+  Level::iterator it = level.lower_bound(startX);
+  i_tile x = startX;
+
+  while (x <= endX) {
+    if (it == level.end() || it->first > x) {
+      Span &span = level[x];
+      span.endX = (it == level.end()) ? endX : std::min(endX, it->first - 1);
+      addRun(span.column, startY, endY);
+      x = span.endX + 1;
+    } else {
+      addRun(it->second.column, startY, endY);
+      x = it->second.endX + 1;
+      ++it;
+    }
+
+    if (x == 0) break; // wrapped around
+  }
+}
+
+void
+TileAvailability::add(const TileCoordinate &coord) {
+  if (mLastSpan == NULL || mLastCoord.zoom != coord.zoom || mLastCoord.x != coord.x) {
+    if (coord.zoom >= mLevels.size()) {
+      mLevels.resize(coord.zoom + 1);
+    }
+    Level &level = mLevels[coord.zoom];
+
+    // Isolate the column of the tile in its own span
+    addRange(level, coord.x, coord.x, coord.y, coord.y);
+    mLastSpan = &(level[coord.x]);
+    mLastCoord = coord;
+    return;
+  }
+  addRun(mLastSpan->column, coord.y, coord.y);
+}
+
+void
+TileAvailability::add(i_zoom zoom, const TileBounds &bounds) {
+  if (zoom >= mLevels.size()) {
+    mLevels.resize(zoom + 1);
+  }
+  mLastSpan = NULL;
+
+  addRange(mLevels[zoom], bounds.getMinX(), bounds.getMaxX(), bounds.getMinY(), bounds.getMaxY());
+}
+
+void
+TileAvailability::add(const TileAvailability &other) {
+  if (other.mLevels.size() > mLevels.size()) {
+    mLevels.resize(other.mLevels.size());
+  }
+  mLastSpan = NULL;
+
+  for (size_t zoom = 0; zoom < other.mLevels.size(); zoom++) {
+    const Level &otherLevel = other.mLevels[zoom];
+    Level &level = mLevels[zoom];
+
+    for (Level::const_iterator it = otherLevel.begin(); it != otherLevel.end(); ++it) {
+      const Column &column = it->second.column;
+
+      for (Column::const_iterator run = column.begin(); run != column.end(); ++run) {
+        addRange(level, it->first, it->second.endX, run->startY, run->endY);
+      }
+    }
+  }
+}
+
+bool
+TileAvailability::isAvailable(const TileCoordinate &coord) const {
+  if (coord.zoom >= mLevels.size()) {
+    return false;
+  }
+  const Level &level = mLevels[coord.zoom];
+  Level::const_iterator it = findSpan(level, coord.x);
+
+  if (it == level.end()) {
+    return false;
+  }
+  const Column &column = it->second.column;
+  Column::const_iterator run = std::lower_bound(column.begin(), column.end(), coord.y,
+    [](const Run &run, i_tile y) { return run.endY < y; });
+
+  return run != column.end() && run->startY <= coord.y;
+}
+
+std::vector<TileBounds>
+TileAvailability::rectangles(i_zoom zoom) const {
+  return rectangles(zoom, TileBounds(0, 0, std::numeric_limits<i_tile>::max(), std::numeric_limits<i_tile>::max()));
+}
+
+/**
+ * @details Runs of adjacent columns covering the same `y` range are merged
+ * into a single rectangle, so a rectangular area always results in one
+ * rectangle and a set of islands in one rectangle per island row range.
+ */
+std::vector<TileBounds>
+TileAvailability::rectangles(i_zoom zoom, const TileBounds &clip) const {
+  std::vector<TileBounds> result;
+
+  if (zoom >= mLevels.size()) {
+    return result;
+  }
+  const Level &level = mLevels[zoom];
+
+  // The runs of the previous span with the index of their rectangle
+  std::vector<std::pair<Run, size_t> > open, next;
+  i_tile previousX = 0;
+
+  Level::const_iterator it = findSpan(level, clip.getMinX());
+  if (it == level.end()) it = level.lower_bound(clip.getMinX());
+
+  for (; it != level.end() && it->first <= clip.getMaxX(); ++it) {
+    const i_tile startX = std::max(it->first, clip.getMinX()),
+      endX = std::min(it->second.endX, clip.getMaxX());
+    const bool adjacent = !open.empty() && startX == previousX + 1;
+    std::vector<std::pair<Run, size_t> >::const_iterator candidate = open.begin();
+
+    next.clear();
+    for (Column::const_iterator run = it->second.column.begin(); run != it->second.column.end(); ++run) {
+      if (run->endY < clip.getMinY()) continue;
+      if (run->startY > clip.getMaxY()) break;
+
+      Run clipped = { std::max(run->startY, clip.getMinY()), std::min(run->endY, clip.getMaxY()) };
+
+      // Both lists are sorted, so look for an identical run in the previous span
+      if (adjacent) {
+        while (candidate != open.end() && candidate->first.startY < clipped.startY) ++candidate;
+      }
+      if (adjacent && candidate != open.end() &&
+          candidate->first.startY == clipped.startY && candidate->first.endY == clipped.endY) {
+        result[candidate->second].setMaxX(endX);
+        next.push_back(*candidate);
+      } else {
+        result.push_back(TileBounds(startX, clipped.startY, endX, clipped.endY));
+        next.push_back(std::make_pair(clipped, result.size() - 1));
+      }
+    }
+
+    open.swap(next);
+    previousX = endX;
+  }
+
+  return result;
+}
+
+std::string
+TileAvailability::metadataJson(const TileCoordinate &coord, i_zoom levels) const {
+  std::vector<std::string> available;
+
+  for (i_zoom i = 1; i <= levels && coord.zoom + i < mLevels.size(); i++) {
+    const i_tile scale = 1 << i;
+    TileBounds clip(coord.x * scale, coord.y * scale, (coord.x + 1) * scale - 1, (coord.y + 1) * scale - 1);
+
+    available.push_back(toJson(rectangles(coord.zoom + i, clip)));
+  }
+
+  // Trailing levels without tiles are omitted
+  while (!available.empty() && available.back() == "[]") {
+    available.pop_back();
+  }
+
+  std::string json = "{\"available\":[";
+  for (size_t i = 0; i < available.size(); i++) {
+    if (i > 0) json += ",";
+    json += available[i];
+  }
+  json += "]}";
+
+  return json;
+}
+
+std::string
+TileAvailability::toJson(const std::vector<TileBounds> &rectangles) {
+  std::ostringstream stream;
+
+  stream << "[";
+  for (size_t i = 0; i < rectangles.size(); i++) {
+    const TileBounds &rect = rectangles[i];
+
+    if (i > 0) stream << ",";
+    stream << "{\"startX\":" << rect.getMinX()
+           << ",\"startY\":" << rect.getMinY()
+           << ",\"endX\":" << rect.getMaxX()
+           << ",\"endY\":" << rect.getMaxY() << "}";
+  }
+  stream << "]";
+
+  return stream.str();
+}
@@ -0,0 +1,153 @@
+#ifndef TILEAVAILABILITY_HPP
+#define TILEAVAILABILITY_HPP
+
+/*******************************************************************************
+ * Copyright 2018 GeoData <geodata@soton.ac.uk>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not
+ * use this file except in compliance with the License.  You may obtain a copy
+ * of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ *******************************************************************************/
+
+/**
+ * @file TileAvailability.hpp
+ * @brief This declares the `TileAvailability` class
+ */
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "config.hpp"
+#include "types.hpp"
+#include "TileCoordinate.hpp"
+
+namespace ctb {
+  class TileAvailability;
+}
+
+/**
+ * @brief The set of tiles available in a tileset
+ *
+ * Each zoom level is stored as spans of adjacent columns sharing the same
+ * sorted list of disjoint runs of `y` coordinates.  Tiles are usually recorded
+ * in the order of a `GridIterator` (`y` varies fastest) so adding a tile
+ * mostly extends the last run of the current column, while adding a whole
+ * range of tiles only touches the spans it overlaps.
+ *
+ * The availability of a zoom level can be retrieved as a set of rectangles in
+ * the form used by the `available` property of the Cesium `layer.json` file
+ * and by the quantized-mesh `metadata` extension.
+ */
+class CTB_DLL ctb::TileAvailability {
+public:
+
+  /// Create an empty availability
+  TileAvailability():
+    mLastSpan(NULL) {}
+
+  /// The copy constructor
+  TileAvailability(const TileAvailability &other);
+
+  /// Overload the assignment operator
+  TileAvailability &
+  operator=(const TileAvailability &other);
+
+  /// Record a tile as available
+  void
+  add(const TileCoordinate &coord);
+
+  /// Record a range of tiles of a zoom level as available
+  void
+  add(i_zoom zoom, const TileBounds &bounds);
+
+  /// Merge the availability of another instance
+  void
+  add(const TileAvailability &other);
+
+  /// Is the tile available?
+  bool
+  isAvailable(const TileCoordinate &coord) const;
+
+  /// Get the number of zoom levels, i.e. the maximum zoom level plus one
+  inline i_zoom
+  levelCount() const {
+    return mLevels.size();
+  }
+
+  /// Get the available tiles of a zoom level as a set of rectangles
+  std::vector<TileBounds>
+  rectangles(i_zoom zoom) const;
+
+  /// Get the available tiles of a zoom level within a range as a set of rectangles
+  std::vector<TileBounds>
+  rectangles(i_zoom zoom, const TileBounds &clip) const;
+
+  /**
+   * @brief Get the availability of the tiles below a tile
+   *
+   * This returns the JSON object of the quantized-mesh `metadata` extension,
+   * listing the available tiles of the `levels` zoom levels following the
+   * zoom level of the tile.
+   */
+  std::string
+  metadataJson(const TileCoordinate &coord, i_zoom levels) const;
+
+  /// Get a set of rectangles as a JSON array
+  static std::string
+  toJson(const std::vector<TileBounds> &rectangles);
+
+protected:
+
+  /// A range of consecutive `y` coordinates
+  struct Run {
+    i_tile startY, endY;
+  };
+
+  /// The sorted runs of a column
+  typedef std::vector<Run> Column;
+
+  /// Adjacent columns with the same runs
+  struct Span {
+    i_tile endX;
+    Column column;
+  };
+
+  /// The spans of a zoom level keyed by their first `x`
+  typedef std::map<i_tile, Span> Level;
+
+  /// Add a range of `y` coordinates to a column
+  static void
+  addRun(Column &column, i_tile startY, i_tile endY);
+
+  /// Ensure a span starts at `x` if `x` is within a span
+  static void
+  splitSpan(Level &level, i_tile x);
+
+  /// Add a range of tiles to a zoom level
+  static void
+  addRange(Level &level, i_tile startX, i_tile endX, i_tile startY, i_tile endY);
+
+  /// Get the span containing `x`, or the end of the level
+  static Level::const_iterator
+  findSpan(const Level &level, i_tile x);
+
+  /// The available tiles of each zoom level
+  std::vector<Level> mLevels;
+
+private:
+
+  /// A cache of the single column span of the last tile recorded
+  Span *mLastSpan;
+  TileCoordinate mLastCoord;
+};
+
+#endif /* TILEAVAILABILITY_HPP */
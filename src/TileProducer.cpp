@@ -0,0 +1,286 @@
+/*******************************************************************************
+ * Copyright 2018 GeoData <geodata@soton.ac.uk>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not
+ * use this file except in compliance with the License.  You may obtain a copy
+ * of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ *******************************************************************************/
+
+/**
+ * @file TileProducer.cpp
+ * @brief This defines the `TileProducer` class
+ */
+
+#include <exception>
+#include <memory>
+#include <thread>
+
+#include "cpl_multiproc.h"      // for CPLGetNumCPUs
+#include "gdal_priv.h"
+
+#include "CoverageIndex.hpp"
+#include "CTBException.hpp"
+#include "CTBZOutputStream.hpp"
+#include "GDALDatasetReader.hpp"
+#include "GDALTileEncoder.hpp"
+#include "MeshTiler.hpp"
+#include "RasterTiler.hpp"
+#include "ImageTiler.hpp"
+#include "TerrainTiler.hpp"
+#include "TileArena.hpp"
+#include "TileProducer.hpp"
+#include "TilingEngine.hpp"
+
+using namespace ctb;
+
+TileProducer::TileProducer(const std::string &filename, const Grid &grid, const TilerOptions &options, Format format):
+  mFilename(filename),
+  mGrid(grid),
+  mOptions(options),
+  mFormat(format),
+  mThreadCount(0),
+  mEngine(NULL),
+  mMeshQualityFactor(1.0),
+  mVertexNormals(false),
+  mPngFilter(PngHeightEncoder::FilterUp),
+  mPngCompressionLevel(6),
+  mDriverName("PNG"),
+  mNextIndex(0),
+  mProduced(0),
+  mCancelled(false)
+{
+  if (options.mosaic) {
+    throw CTBException("A tile producer reads a single dataset rather than a mosaic");
+  }
+  if (format == Terrain && grid.tileSize() != TILE_SIZE) {
+    throw CTBException("The grid tile size of terrain tiles must be 65");
+  }
+  if (format == Mesh && !MeshTiler::isValidTileSize(grid.tileSize())) {
+    throw CTBException("The grid tile size of mesh tiles must be (2^n) + 1, e.g. 65, 129, 257 or 513");
+  }
+}
+
+/**
+ * @details The extent of each zoom level is taken from a tiler of the
+ * dataset, as the iterators of the tilers do.
+ */
+size_t
+TileProducer::produce(i_zoom startZoom, i_zoom endZoom, const Sink &sink) {
+  GDALDataset *poDataset = (GDALDataset *) GDALOpen(mFilename.c_str(), GA_ReadOnly);
+  if (poDataset == NULL) {
+    throw CTBException("Could not open GDAL dataset");
+  }
+
+  Job job;
+  job.coords = NULL;
+  job.size = 0;
+  job.endZoom = endZoom;
+
+  try {
+    const TerrainTiler tiler(poDataset, mGrid, mOptions);
+
+    for (i_zoom zoom = startZoom + 1; zoom-- > endZoom; ) {
+      Level level;
+      level.zoom = zoom;
+      level.bounds = tiler.tileBoundsForZoom(zoom);
+      level.first = job.size;
+
+      job.levels.push_back(level);
+      job.size += (size_t) (level.bounds.getWidth() + 1) * (level.bounds.getHeight() + 1);
+    }
+  } catch (CTBException &e) {
+    GDALClose(poDataset);
+    throw;
+  }
+  GDALClose(poDataset);
+
+  return run(job, sink);
+}
+
+size_t
+TileProducer::produce(const std::vector<TileCoordinate> &coords, const Sink &sink) {
+  Job job;
+  job.coords = &coords;
+  job.size = coords.size();
+  job.endZoom = 0;
+
+  return run(job, sink);
+}
+
+void
+TileProducer::cancel() {
+  mCancelled = true;
+}
+
+/**
+ * @details The workers take the tiles of the job in turn from a shared index,
+ * and the first error of a worker is thrown once they have all stopped.  The
+ * cancellation is cleared once the workers have stopped rather than when they
+ * start, so a `cancel` made just before the production is not lost.
+ */
+size_t
+TileProducer::run(const Job &job, const Sink &sink) {
+  mNextIndex = 0;
+  mProduced = 0;
+  mError.clear();
+
+  if (mEngine) {
+    mEngine->submit([&](TilingJob &) { work(job, sink); }, mThreadCount)->wait();
+  } else {
+    const int threadCount = (mThreadCount > 0) ? mThreadCount : CPLGetNumCPUs();
+
+    std::vector<std::thread> workers;
+    for (int i = 0; i < threadCount; i++) {
+      workers.push_back(std::thread(&TileProducer::work, this, std::cref(job), std::cref(sink)));
+    }
+    for (auto &worker : workers) {
+      worker.join();
+    }
+  }
+  mCancelled = false;
+
+  if (!mError.empty()) {
+    throw CTBException(mError.c_str());
+  }
+  return mProduced;
+}
+
+void
+TileProducer::work(const Job &job, const Sink &sink) {
+  GDALDataset *poDataset = (GDALDataset *) GDALOpen(mFilename.c_str(), GA_ReadOnly);
+  if (poDataset == NULL) {
+    fail("Could not open GDAL dataset");
+    return;
+  }
+
+  try {
+    // Elevation images are sampled at their pixel centres
+    std::unique_ptr<TerrainTiler> tiler(mFormat == Mesh
+                                        ? new MeshTiler(poDataset, mGrid, mOptions, mMeshQualityFactor)
+                                        : (mFormat == TerrainRGB || mFormat == Terrarium)
+                                        ? new ImageTiler(poDataset, mGrid, mOptions)
+                                        : new TerrainTiler(poDataset, mGrid, mOptions));
+    GDALDatasetReaderAligned reader(*tiler);
+    TileArena arena;
+    CTBZMemoryOutputStream stream;
+
+    // Raster tiles are warped by a raster tiler and encoded by the driver
+    std::unique_ptr<RasterTiler> rasterTiler;
+    std::unique_ptr<GDALTileEncoder> rasterEncoder;
+    if (mFormat == Raster) {
+      GDALDriver *driver = GetGDALDriverManager()->GetDriverByName(mDriverName.c_str());
+      if (driver == NULL) {
+        throw CTBException("Could not retrieve GDAL driver");
+      }
+      rasterTiler.reset(new RasterTiler(poDataset, mGrid, mOptions));
+      rasterEncoder.reset(new GDALTileEncoder(driver, mCreationOptions));
+    }
+
+    // Elevation images are encoded from the heights read by the image tiler
+    std::unique_ptr<PngHeightEncoder> encoder;
+    if (mFormat == TerrainRGB || mFormat == Terrarium) {
+      encoder.reset(new PngHeightEncoder(mFormat == Terrarium ? PngHeightEncoder::Terrarium : PngHeightEncoder::TerrainRGB,
+                                         mPngFilter, mPngCompressionLevel));
+    }
+
+    for (size_t index = mNextIndex++; index < job.size && !mCancelled; index = mNextIndex++) {
+      const TileCoordinate coord = coordinate(job, index);
+      if (skipTile(*tiler, coord, job.endZoom)) continue;
+
+      const unsigned char *data;
+      size_t size;
+      if (rasterEncoder) {
+        const std::unique_ptr<GDALTile> tile(rasterTiler->createTile(poDataset, coord));
+        rasterEncoder->encode(*tile);
+        data = rasterEncoder->data();
+        size = rasterEncoder->size();
+      } else if (encoder) {
+        tiler->readTileHeights(poDataset, coord, &reader, arena);
+        tiler->encodeHeights(arena, *encoder);
+        data = encoder->data();
+        size = encoder->size();
+      } else {
+        stream.reset();
+        if (mFormat == Mesh) {
+          const MeshTile *tile = static_cast<const MeshTiler &>(*tiler).createMesh(poDataset, coord, &reader, arena);
+          tile->writeFile(stream, mVertexNormals);
+        } else {
+          const TerrainTile *tile = tiler->createTile(poDataset, coord, &reader, arena);
+          tile->writeFile(stream);
+        }
+        stream.finish();
+        data = stream.data();
+        size = stream.size();
+      }
+
+      if (!sink(coord, data, size)) {
+        cancel();
+      }
+      mProduced++;
+    }
+  } catch (std::exception &e) {   // including the exceptions of the sink
+    fail(e.what());
+  }
+
+  GDALClose(poDataset);
+}
+
+TileCoordinate
+TileProducer::coordinate(const Job &job, size_t index) {
+  if (job.coords) {
+    return (*job.coords)[index];
+  }
+
+  // Find the level of the tile, rows from the north as the iterators do
+  size_t i = job.levels.size() - 1;
+  while (job.levels[i].first > index) i--;
+
+  const Level &level = job.levels[i];
+  const size_t offset = index - level.first,
+    width = level.bounds.getWidth() + 1;
+
+  return TileCoordinate(level.zoom,
+                        level.bounds.getMinX() + (i_tile) (offset % width),
+                        level.bounds.getMaxY() - (i_tile) (offset / width));
+}
+
+/**
+ * @details As in `ctb-tile`, a coverage index skips the tiles without data
+ * and the tiles below a flat tile down to the coarsest zoom level.
+ */
+bool
+TileProducer::skipTile(const GDALTiler &tiler, const TileCoordinate &coord, i_zoom endZoom) const {
+  const CoverageIndex *coverage = mOptions.coverage.get();
+
+  if (coverage == NULL) {
+    return false;
+  }
+  if (!coverage->hasData(coord)) {
+    return true;
+  }
+
+  for (i_zoom zoom = endZoom; zoom < coord.zoom; zoom++) {
+    const i_zoom shift = coord.zoom - zoom;
+
+    if (tiler.isFlat(TileCoordinate(zoom, coord.x >> shift, coord.y >> shift))) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void
+TileProducer::fail(const char *message) {
+  std::lock_guard<std::mutex> lock(mMutex);
+
+  if (mError.empty()) mError = message;
+  mCancelled = true;
+}
@@ -0,0 +1,226 @@
+#ifndef TILEPRODUCER_HPP
+#define TILEPRODUCER_HPP
+
+/*******************************************************************************
+ * Copyright 2018 GeoData <geodata@soton.ac.uk>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not
+ * use this file except in compliance with the License.  You may obtain a copy
+ * of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ *******************************************************************************/
+
+/**
+ * @file TileProducer.hpp
+ * @brief This declares the `TileProducer` class
+ */
+
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "cpl_string.h"
+
+#include "config.hpp"
+#include "types.hpp"
+#include "Grid.hpp"
+#include "GDALTiler.hpp"
+#include "PngHeightEncoder.hpp"
+#include "TileCoordinate.hpp"
+
+namespace ctb {
+  class TileProducer;
+  class TilingEngine;           // forward declaration
+}
+
+/**
+ * @brief Produce encoded terrain, mesh, elevation image or raster tiles in memory
+ *
+ * A producer creates the tiles of a dataset on a pool of worker threads and
+ * passes the bytes of each tile with its coordinate to a sink, gzipped for
+ * terrain and mesh tiles, as a PNG image for elevation images and encoded by a
+ * `GDALTileEncoder` for raster tiles, so an
+ * application can store or serve the tiles without going through files.  Each
+ * worker opens its own handle on the dataset and encodes its tiles into a
+ * buffer it reuses: the sink is given a view of that buffer, valid only for
+ * the duration of the call, and must copy the bytes it keeps.
+ *
+ * The sink is called from several workers at once and so must be thread safe.
+ * A worker waits for the sink to return before creating its next tile, so a
+ * sink that blocks, for instance on a full queue, holds the workers back.
+ * The production is cancelled when the sink returns `false` or `cancel` is
+ * called, after the tiles the workers are creating.
+ *
+ * The heights are read as by `ctb-tile`, without mosaics or nodata filling.
+ */
+class CTB_DLL ctb::TileProducer {
+public:
+
+  /// The type of tiles produced
+  enum Format {
+    Terrain,                    ///< heightmap-1.0 terrain tiles
+    Mesh,                       ///< quantized-mesh-1.0 tiles
+    TerrainRGB,                 ///< Mapbox Terrain-RGB PNG images
+    Terrarium,                  ///< Mapzen Terrarium PNG images
+    Raster                      ///< Raster tiles in the format of a GDAL driver
+  };
+
+  /// Receives an encoded tile, returning `false` to cancel the production
+  typedef std::function<bool (const TileCoordinate &coord, const unsigned char *data, size_t size)> Sink;
+
+  /// Instantiate a producer of the tiles of a dataset
+  TileProducer(const std::string &filename, const Grid &grid, const TilerOptions &options = TilerOptions(), Format format = Terrain);
+
+  /// Set the number of worker threads, the number of CPUs if less than one
+  inline void
+  setThreadCount(int threadCount) {
+    mThreadCount = threadCount;
+  }
+
+  /**
+   * @brief Run the workers on the threads of an engine rather than new threads
+   *
+   * The number of workers is then the thread count, or all the threads of
+   * the engine if it is less than one.
+   */
+  inline void
+  setEngine(TilingEngine *engine) {
+    mEngine = engine;
+  }
+
+  /// Set the factor of the geometric error of mesh tiles
+  inline void
+  setMeshQualityFactor(double meshQualityFactor) {
+    mMeshQualityFactor = meshQualityFactor;
+  }
+
+  /// Write the vertex normals of mesh tiles
+  inline void
+  setVertexNormals(bool vertexNormals) {
+    mVertexNormals = vertexNormals;
+  }
+
+  /// Set the row filter and the zlib compression level of PNG images
+  inline void
+  setPngOptions(PngHeightEncoder::Filter filter, int compressionLevel) {
+    mPngFilter = filter;
+    mPngCompressionLevel = compressionLevel;
+  }
+
+  /// Set the GDAL driver and creation options of raster tiles
+  inline void
+  setRasterDriver(const std::string &driverName, const CPLStringList &creationOptions = CPLStringList()) {
+    mDriverName = driverName;
+    mCreationOptions = creationOptions;
+  }
+
+  /**
+   * @brief Produce the tiles between two zoom levels, returning the number produced
+   *
+   * Each zoom level is produced over the extent of the dataset, starting at
+   * the finest.  The tiles without data or below flat tiles are skipped when
+   * the tiler options have a coverage index.
+   */
+  size_t
+  produce(i_zoom startZoom, i_zoom endZoom, const Sink &sink);
+
+  /// Produce the tiles at some coordinates, returning the number produced
+  size_t
+  produce(const std::vector<TileCoordinate> &coords, const Sink &sink);
+
+  /// Stop the production in progress, or the next one if none is, from any thread
+  void
+  cancel();
+
+  /// Has the production in progress been cancelled?
+  inline bool
+  isCancelled() const {
+    return mCancelled;
+  }
+
+protected:
+
+  /// The tiles of a zoom level to produce
+  struct Level {
+    i_zoom zoom;
+    TileBounds bounds;
+    size_t first;               ///< The index of the first tile of the level
+  };
+
+  /// The coordinates of a production, either listed or by zoom level
+  struct Job {
+    const std::vector<TileCoordinate> *coords;
+    std::vector<Level> levels;
+    size_t size;                ///< The number of tiles
+    i_zoom endZoom;             ///< The coarsest zoom level produced
+  };
+
+  /// Run the workers over the coordinates of a job
+  size_t
+  run(const Job &job, const Sink &sink);
+
+  /// Create and pass on the tiles of a job until there are none left
+  void
+  work(const Job &job, const Sink &sink);
+
+  /// Get the coordinate of a tile of a job
+  static TileCoordinate
+  coordinate(const Job &job, size_t index);
+
+  /// Should a tile be skipped according to the tiler options?
+  bool
+  skipTile(const GDALTiler &tiler, const TileCoordinate &coord, i_zoom endZoom) const;
+
+  /// Record the first error of the workers and cancel the production
+  void
+  fail(const char *message);
+
+  /// The dataset opened by each worker
+  std::string mFilename;
+  /// The grid of the tiles
+  Grid mGrid;
+  /// The options of the tilers
+  TilerOptions mOptions;
+  /// The type of tiles produced
+  Format mFormat;
+
+  /// The number of worker threads
+  int mThreadCount;
+  /// The engine running the workers, if any
+  TilingEngine *mEngine;
+  /// The factor of the geometric error of mesh tiles
+  double mMeshQualityFactor;
+  /// Are the vertex normals of mesh tiles written?
+  bool mVertexNormals;
+  /// The row filter of PNG images
+  PngHeightEncoder::Filter mPngFilter;
+  /// The zlib compression level of PNG images
+  int mPngCompressionLevel;
+  /// The GDAL driver of raster tiles
+  std::string mDriverName;
+  /// The creation options of raster tiles
+  CPLStringList mCreationOptions;
+
+  /// The index of the next tile to create
+  std::atomic<size_t> mNextIndex;
+  /// The number of tiles passed to the sink
+  std::atomic<size_t> mProduced;
+  /// Has the production been cancelled?
+  std::atomic<bool> mCancelled;
+
+  /// The first error of the workers
+  std::string mError;
+  /// Serialises the access to the error
+  std::mutex mMutex;
+};
+
+#endif /* TILEPRODUCER_HPP */
@@ -0,0 +1,182 @@
+/*******************************************************************************
+ * Copyright 2018 GeoData <geodata@soton.ac.uk>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not
+ * use this file except in compliance with the License.  You may obtain a copy
+ * of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ *******************************************************************************/
+
+/**
+ * @file TilingEngine.cpp
+ * @brief This defines the `TilingEngine` and `TilingJob` classes
+ */
+
+#include <algorithm>
+#include <exception>
+
+#include "cpl_multiproc.h"      // for CPLGetNumCPUs
+
+#include "TilingEngine.hpp"
+
+using namespace ctb;
+
+TilingJob::TilingJob(const Task &task, int workers):
+  mTask(task),
+  mNextIndex(0),
+  mSize(0),
+  mCancelled(false),
+  mRemaining(workers)
+{}
+
+void
+TilingJob::setSize(size_t size) {
+  size_t unset = 0;
+  mSize.compare_exchange_strong(unset, size);
+}
+
+double
+TilingJob::progress() const {
+  const size_t size = mSize;
+  if (size == 0) return 0;
+
+  return std::min((size_t) mNextIndex, size) / (double) size;
+}
+
+void
+TilingJob::cancel() {
+  std::vector<std::function<void ()> > handlers;
+  {
+    std::lock_guard<std::mutex> lock(mMutex);
+    if (mCancelled) return;
+    mCancelled = true;
+    handlers.swap(mCancelHandlers);
+  }
+
+  for (auto &handler : handlers) {
+    handler();
+  }
+}
+
+void
+TilingJob::onCancel(const std::function<void ()> &handler) {
+  {
+    std::lock_guard<std::mutex> lock(mMutex);
+    if (!mCancelled) {
+      mCancelHandlers.push_back(handler);
+      return;
+    }
+  }
+  handler();
+}
+
+bool
+TilingJob::isFinished() const {
+  std::lock_guard<std::mutex> lock(mMutex);
+  return mRemaining == 0;
+}
+
+void
+TilingJob::wait() {
+  std::unique_lock<std::mutex> lock(mMutex);
+  mFinished.wait(lock, [this] { return mRemaining == 0; });
+}
+
+std::string
+TilingJob::error() const {
+  std::lock_guard<std::mutex> lock(mMutex);
+  return mError;
+}
+
+/**
+ * @details An exception thrown by the task is recorded as the error of the
+ * job, which is then cancelled.
+ */
+void
+TilingJob::run() {
+  std::string error;
+
+  try {
+    mTask(*this);
+  } catch (std::exception &e) {
+    error = e.what();
+    if (error.empty()) error = "Unknown error";
+  } catch (...) {
+    error = "Unknown error";
+  }
+
+  if (!error.empty()) {
+    {
+      std::lock_guard<std::mutex> lock(mMutex);
+      if (mError.empty()) mError = error;
+    }
+    cancel();
+  }
+
+  std::lock_guard<std::mutex> lock(mMutex);
+  if (--mRemaining == 0) {
+    mFinished.notify_all();
+  }
+}
+
+TilingEngine::TilingEngine(int threadCount):
+  mStopping(false)
+{
+  if (threadCount < 1) threadCount = CPLGetNumCPUs();
+  if (threadCount < 1) threadCount = 1;
+
+  for (int i = 0; i < threadCount; i++) {
+    mThreads.push_back(std::thread(&TilingEngine::runWorkers, this));
+  }
+}
+
+TilingEngine::~TilingEngine() {
+  {
+    std::lock_guard<std::mutex> lock(mMutex);
+    mStopping = true;
+  }
+  mCondition.notify_all();
+
+  for (auto &thread : mThreads) {
+    thread.join();
+  }
+}
+
+std::shared_ptr<TilingJob>
+TilingEngine::submit(const TilingJob::Task &task, int workers) {
+  if (workers < 1) workers = threadCount();
+
+  std::shared_ptr<TilingJob> job(new TilingJob(task, workers));
+  {
+    std::lock_guard<std::mutex> lock(mMutex);
+    for (int i = 0; i < workers; i++) {
+      mQueue.push_back(job);
+    }
+  }
+  mCondition.notify_all();
+
+  return job;
+}
+
+void
+TilingEngine::runWorkers() {
+  while (true) {
+    std::shared_ptr<TilingJob> job;
+    {
+      std::unique_lock<std::mutex> lock(mMutex);
+      mCondition.wait(lock, [this] { return mStopping || !mQueue.empty(); });
+
+      if (mQueue.empty()) return; // stopping
+      job = mQueue.front();
+      mQueue.pop_front();
+    }
+    job->run();
+  }
+}
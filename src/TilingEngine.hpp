@@ -0,0 +1,198 @@
+#ifndef TILINGENGINE_HPP
+#define TILINGENGINE_HPP
+
+/*******************************************************************************
+ * Copyright 2018 GeoData <geodata@soton.ac.uk>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not
+ * use this file except in compliance with the License.  You may obtain a copy
+ * of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ *******************************************************************************/
+
+/**
+ * @file TilingEngine.hpp
+ * @brief This declares the `TilingEngine` and `TilingJob` classes
+ */
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "config.hpp"
+
+namespace ctb {
+  class TilingEngine;
+  class TilingJob;
+}
+
+/**
+ * @brief A tiling job run by some workers of a `TilingEngine`
+ *
+ * The workers of a job share the tiles of the job: each claims the index of
+ * the next tile to create, so workers iterating over the same tiles each skip
+ * to the tiles they claimed.  The number of tiles is set by the first worker
+ * that knows it and the progress of the job is the fraction of the tiles
+ * claimed.
+ */
+class CTB_DLL ctb::TilingJob {
+public:
+
+  /// The work of a job, run by each of its workers
+  typedef std::function<void (TilingJob &job)> Task;
+
+  /// Claim the index of the next tile of the job
+  inline size_t
+  claim() {
+    return mNextIndex++;
+  }
+
+  /// Set the number of tiles of the job unless it is already set
+  void
+  setSize(size_t size);
+
+  /// Get the number of tiles of the job, `0` until it is set
+  inline size_t
+  size() const {
+    return mSize;
+  }
+
+  /// Get the fraction of the tiles of the job claimed by the workers
+  double
+  progress() const;
+
+  /// Ask the workers to stop, which they check with `isCancelled`
+  void
+  cancel();
+
+  /**
+   * @brief Call a function when the job is cancelled, at once if it already is
+   *
+   * This wakes workers waiting on each other, which would otherwise not see
+   * that the job has been cancelled, as by the error of another worker.
+   */
+  void
+  onCancel(const std::function<void ()> &handler);
+
+  /// Has the job been cancelled?
+  inline bool
+  isCancelled() const {
+    return mCancelled;
+  }
+
+  /// Have all the workers of the job returned?
+  bool
+  isFinished() const;
+
+  /// Wait for all the workers of the job to return
+  void
+  wait();
+
+  /// Get the first error thrown by a worker, empty if there is none
+  std::string
+  error() const;
+
+protected:
+  friend class TilingEngine;
+
+  /// Instantiate a job run by a number of workers
+  TilingJob(const Task &task, int workers);
+
+  /// Run the task as one of the workers
+  void
+  run();
+
+  /// The work of the job
+  Task mTask;
+
+  /// The index of the next tile to claim
+  std::atomic<size_t> mNextIndex;
+  /// The number of tiles
+  std::atomic<size_t> mSize;
+  /// Has the job been cancelled?
+  std::atomic<bool> mCancelled;
+
+  /// The number of workers still to return
+  int mRemaining;
+  /// The first error of the workers
+  std::string mError;
+  /// The functions to call when the job is cancelled
+  std::vector<std::function<void ()> > mCancelHandlers;
+
+  /// Serialises the access to the state of the workers
+  mutable std::mutex mMutex;
+  /// Signals the return of the last worker
+  std::condition_variable mFinished;
+};
+
+/**
+ * @brief A pool of threads running tiling jobs
+ *
+ * The threads are started with the engine and kept until it is destroyed, so
+ * a long running application keeps its threads, and the GDAL caches of their
+ * datasets, from one job to the next.  Several jobs can be submitted at once:
+ * the workers of the jobs are queued and run by the threads in the order they
+ * were submitted.
+ *
+ * A task typically opens its own handle on the dataset of the job, creates a
+ * tiler, and iterates over the tiles claiming them from the job, as `ctb-tile`
+ * does.  A task should not wait for another job, as that may hold the thread
+ * the other job is waiting for.
+ */
+class CTB_DLL ctb::TilingEngine {
+public:
+
+  /// Start a number of threads, the number of CPUs if less than one
+  TilingEngine(int threadCount = 0);
+
+  /// Run the queued jobs and stop the threads
+  ~TilingEngine();
+
+  /// Get the number of threads
+  inline int
+  threadCount() const {
+    return (int) mThreads.size();
+  }
+
+  /// Queue a job run by a number of workers, as many as there are threads if less than one
+  std::shared_ptr<TilingJob>
+  submit(const TilingJob::Task &task, int workers = 0);
+
+protected:
+
+  /// Run the workers of the queue until the engine stops
+  void
+  runWorkers();
+
+  /// The threads of the pool
+  std::vector<std::thread> mThreads;
+
+  /// The workers waiting for a thread, one entry for each worker of a job
+  std::deque<std::shared_ptr<TilingJob> > mQueue;
+
+  /// Are the threads to stop once the queue is empty?
+  bool mStopping;
+
+  /// Serialises the access to the queue
+  std::mutex mMutex;
+  /// Signals a new worker or the stop of the engine
+  std::condition_variable mCondition;
+
+  TilingEngine(const TilingEngine &) = delete;
+  TilingEngine &operator=(const TilingEngine &) = delete;
+};
+
+#endif /* TILINGENGINE_HPP */
@@ -90,19 +90,32 @@
  */
 
 #include "ctb/Bounds.hpp"
+#include "ctb/ContentHash.hpp"
 #include "ctb/Coordinate.hpp"
+#include "ctb/CoverageIndex.hpp"
 #include "ctb/CTBException.hpp"
 #include "ctb/GDALTile.hpp"
+#include "ctb/GDALTileEncoder.hpp"
 #include "ctb/GDALTiler.hpp"
 #include "ctb/GlobalGeodetic.hpp"
 #include "ctb/GlobalMercator.hpp"
 #include "ctb/Grid.hpp"
 #include "ctb/GridIterator.hpp"
+#include "ctb/HeightKernels.hpp"
+#include "ctb/ImageTiler.hpp"
+#include "ctb/OverviewCache.hpp"
+#include "ctb/PngEncoder.hpp"
+#include "ctb/PngHeightEncoder.hpp"
 #include "ctb/RasterIterator.hpp"
 #include "ctb/RasterTiler.hpp"
+#include "ctb/SourceMosaic.hpp"
 #include "ctb/TerrainIterator.hpp"
 #include "ctb/TerrainTile.hpp"
 #include "ctb/TerrainTiler.hpp"
+#include "ctb/TileArena.hpp"
+#include "ctb/TileAvailability.hpp"
+#include "ctb/TileProducer.hpp"
+#include "ctb/TilingEngine.hpp"
 #include "ctb/TileCoordinate.hpp"
 #include "ctb/Tile.hpp"
 #include "ctb/TilerIterator.hpp"
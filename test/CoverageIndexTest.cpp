@@ -0,0 +1,135 @@
+/*******************************************************************************
+ * Copyright 2018 GeoData <geodata@soton.ac.uk>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not
+ * use this file except in compliance with the License.  You may obtain a copy
+ * of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ *******************************************************************************/
+
+/**
+ * @file CoverageIndexTest.cpp
+ * @brief Check the coverage index keeps the height extremes of a source
+ *
+ * The source is flat at 0 m apart from a single pixel at 1000 m, and has
+ * averaged overviews in which that peak is smoothed away.  The coarse index
+ * must still report the peak, so the tile holding it is not flat.  It exits
+ * with `0` on success or `1` otherwise.
+ */
+
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "gdal_priv.h"
+#include "ogr_spatialref.h"
+
+#include "CTBException.hpp"
+#include "CoverageIndex.hpp"
+#include "GlobalGeodetic.hpp"
+#include "TerrainTiler.hpp"
+
+using namespace std;
+using namespace ctb;
+
+/// The size in pixels of the source, covering one degree
+static const int SOURCE_SIZE = 1024;
+
+/// The height of the peak
+static const float PEAK_HEIGHT = 1000;
+
+/// Create the source in memory over 0 to 1 degree east and north, with the peak in its centre
+static GDALDataset *
+createSource(const std::string &filename) {
+  GDALDriver *poDriver = GetGDALDriverManager()->GetDriverByName("GTiff");
+  GDALDataset *poDataset = poDriver->Create(filename.c_str(), SOURCE_SIZE, SOURCE_SIZE, 1, GDT_Float32, NULL);
+  if (poDataset == NULL) {
+    throw CTBException("Could not create the source");
+  }
+
+  OGRSpatialReference srs;
+  char *wkt = NULL;
+  srs.SetWellKnownGeogCS("WGS84");
+  srs.exportToWkt(&wkt);
+  double adfGeoTransform[6] = { 0, 1.0 / SOURCE_SIZE, 0, 1, 0, -1.0 / SOURCE_SIZE };
+  poDataset->SetGeoTransform(adfGeoTransform);
+  poDataset->SetProjection(wkt);
+  CPLFree(wkt);
+
+  GDALRasterBand *poBand = poDataset->GetRasterBand(1);
+  std::vector<float> row(SOURCE_SIZE);
+  for (int y = 0; y < SOURCE_SIZE; y++) {
+    row.assign(SOURCE_SIZE, 0);
+    if (y == SOURCE_SIZE / 2) {
+      row[SOURCE_SIZE / 2] = PEAK_HEIGHT;
+    }
+    if (poBand->RasterIO(GF_Write, 0, y, SOURCE_SIZE, 1, row.data(), SOURCE_SIZE, 1, GDT_Float32, 0, 0) != CE_None) {
+      GDALClose(poDataset);
+      throw CTBException("Could not write the source");
+    }
+  }
+
+  int overviews[] = { 2, 4, 8, 16, 32 };
+  if (poDataset->BuildOverviews("AVERAGE", 5, overviews, 0, NULL, GDALDummyProgress, NULL) != CE_None) {
+    GDALClose(poDataset);
+    throw CTBException("Could not build the source overviews");
+  }
+
+  return poDataset;
+}
+
+int
+main() {
+  GDALAllRegister();
+
+  const std::string filename = "/vsimem/ctb-test-coverage/source.tif";
+  int failures = 0;
+
+  try {
+    GDALDataset *poDataset = createSource(filename);
+    {
+      const GlobalGeodetic grid(65);
+
+      // A budget of a few tiles makes the index far coarser than the source
+      TilerOptions options;
+      options.coverage = std::make_shared<CoverageIndex>(TerrainTiler(poDataset, grid), 1 << 14);
+      options.flatTolerance = 10;
+      const TerrainTiler tiler(poDataset, grid, options);
+
+      // The tile of zoom 10 holding the peak, within the source throughout
+      const TileCoordinate coord = grid.crsToTile(CRSPoint(0.5005, 0.4995), 10);
+      const CoverageIndex::Stats stats = options.coverage->stats(coord);
+
+      if (stats.validFraction < 1) {
+        cerr << "FAIL: the tile " << coord.zoom << "/" << coord.x << "/" << coord.y
+             << " is only " << stats.validFraction << " covered" << endl;
+        failures++;
+      }
+      if (stats.maxHeight < PEAK_HEIGHT - 0.001 || stats.minHeight > 0.001) {
+        cerr << "FAIL: the index height range is " << stats.minHeight << " to "
+             << stats.maxHeight << " instead of 0 to " << PEAK_HEIGHT << " (index zoom "
+             << options.coverage->zoom() << ")" << endl;
+        failures++;
+      }
+      if (tiler.isFlat(coord)) {
+        cerr << "FAIL: the tile holding the peak is reported as flat" << endl;
+        failures++;
+      }
+    }
+    GDALClose(poDataset);
+  } catch (CTBException &e) {
+    cerr << "FAIL: " << e.what() << endl;
+    failures++;
+  }
+
+  VSIRmdirRecursive("/vsimem/ctb-test-coverage");
+  return failures ? 1 : 0;
+}
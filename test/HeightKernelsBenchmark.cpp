@@ -0,0 +1,124 @@
+/*******************************************************************************
+ * Copyright 2018 GeoData <geodata@soton.ac.uk>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not
+ * use this file except in compliance with the License.  You may obtain a copy
+ * of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ *******************************************************************************/
+
+/**
+ * @file HeightKernelsBenchmark.cpp
+ * @brief Time the height kernels with each instruction set
+ *
+ * Each kernel is run over the heights of a terrain tile, 65 * 65 samples with
+ * some nodata, and the time per tile is printed for every instruction set the
+ * processor supports, next to the conversion loop the terrain tiler used
+ * before the kernels.  The number of tiles can be given as the argument.  It
+ * exits with `1` if the scalar conversion, which the compiler vectorises in a
+ * release build, is slower than that loop.
+ */
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include "HeightKernels.hpp"
+
+using namespace std;
+using namespace ctb;
+
+/// The number of heights of a terrain tile
+static const size_t TILE_HEIGHTS = 65 * 65;
+
+/// Keeps the results alive, so the compiler does not drop the work
+static volatile float sink;
+
+/**
+ * The conversion of the terrain tiler before the kernels
+ *
+ * It is kept out of line with the tile size given at run time, as it was in
+ * the tiler, so the compiler does not optimise it for a known size.
+ */
+static void
+#ifdef __GNUC__
+__attribute__((noinline))
+#endif
+previousConversion(const float *heights, size_t tileCellSize, std::vector<i_terrain_height> &terrainHeights) {
+  for (unsigned short int i = 0; i < tileCellSize; i++) {
+    terrainHeights[i] = (i_terrain_height) ((heights[i] + 1000) * 5);
+  }
+}
+
+/// Print and return the time per tile taken by a function run over a number of tiles
+template<typename F> static double
+timeTiles(const char *name, int tiles, F run) {
+  run();                        // warm up
+
+  const chrono::steady_clock::time_point start = chrono::steady_clock::now();
+  for (int i = 0; i < tiles; i++) run();
+  const chrono::duration<double, nano> elapsed = chrono::steady_clock::now() - start;
+
+  cout << "  " << left << setw(16) << name << right << setw(10) << fixed << setprecision(1)
+       << elapsed.count() / tiles << " ns/tile" << endl;
+  return elapsed.count() / tiles;
+}
+
+int
+main(int argc, char *argv[]) {
+  const int tiles = (argc > 1) ? atoi(argv[1]) : 100000;
+  const float noDataValue = -32768;
+  volatile size_t tileCellSize = TILE_HEIGHTS; // only known at run time
+
+  std::mt19937 random(42);
+  std::uniform_real_distribution<float> height(-500, 4000);
+  std::vector<float> heights(TILE_HEIGHTS), buffer(TILE_HEIGHTS);
+  for (size_t i = 0; i < heights.size(); i++) {
+    heights[i] = (i % 97 == 0) ? noDataValue : height(random);
+  }
+  std::vector<i_terrain_height> terrainHeights(TILE_HEIGHTS);
+
+  cout << "previous loop" << endl;
+  const double previousTime = timeTiles("convert", tiles, [&]() {
+      previousConversion(heights.data(), tileCellSize, terrainHeights);
+      sink = terrainHeights[TILE_HEIGHTS / 2];
+    });
+  double scalarTime = 0;
+
+  const char *instructionSets[] = { "scalar", "sse2", "avx2" };
+  for (const char *instructionSet : instructionSets) {
+    if (!HeightKernels::setInstructionSet(instructionSet)) continue;
+    cout << instructionSet << endl;
+
+    const double convertTime = timeTiles("convertHeights", tiles, [&]() {
+        HeightKernels::convertHeights(heights.data(), TILE_HEIGHTS, noDataValue, terrainHeights.data());
+        sink = terrainHeights[TILE_HEIGHTS / 2];
+      });
+    if (strcmp(instructionSet, "scalar") == 0) scalarTime = convertTime;
+    timeTiles("heightRange", tiles, [&]() {
+        sink = HeightKernels::heightRange(heights.data(), TILE_HEIGHTS, noDataValue).maxHeight;
+      });
+    timeTiles("replaceNoData", tiles, [&]() {
+        buffer = heights;
+        HeightKernels::replaceNoData(buffer.data(), TILE_HEIGHTS, noDataValue, 0);
+        sink = buffer[TILE_HEIGHTS / 2];
+      });
+  }
+
+  if (scalarTime > previousTime) {
+    cerr << "FAIL: the scalar conversion is slower than the previous loop" << endl;
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,177 @@
+/*******************************************************************************
+ * Copyright 2018 GeoData <geodata@soton.ac.uk>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not
+ * use this file except in compliance with the License.  You may obtain a copy
+ * of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ *******************************************************************************/
+
+/**
+ * @file HeightKernelsTest.cpp
+ * @brief Check the height kernels against the scalar code
+ *
+ * Every instruction set the processor supports is run over buffers of random
+ * heights mixed with nodata, `NaN` and heights outside the terrain range, of
+ * every length up to a few vectors and from unaligned offsets.  The results
+ * must match those of the scalar kernels bit for bit, and the conversion of
+ * the heights within the terrain range must match the conversion the terrain
+ * tiler made before the kernels.  It exits with `0` on success or `1`
+ * otherwise.
+ */
+
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <vector>
+
+#include "HeightKernels.hpp"
+
+using namespace std;
+using namespace ctb;
+
+/// The number of failed checks
+static int failures = 0;
+
+static void
+check(bool ok, const char *kernel, const char *instructionSet, size_t offset, size_t count) {
+  if (ok) return;
+
+  cerr << "FAIL: " << kernel << " with " << instructionSet << " instructions over "
+       << count << " heights from offset " << offset << endl;
+  failures++;
+}
+
+/// Fill a buffer with heights, some of them nodata, `NaN` or outside the terrain range
+static void
+fillHeights(std::mt19937 &random, std::vector<float> &heights, float noDataValue) {
+  std::uniform_real_distribution<float> height(-1500, 14000);
+  std::uniform_int_distribution<int> kind(0, 15);
+
+  for (float &value : heights) {
+    switch (kind(random)) {
+    case 0:
+      value = noDataValue;
+      break;
+    case 1:
+      value = std::numeric_limits<float>::quiet_NaN();
+      break;
+    case 2:
+      value = -1000;            // the lowest terrain height
+      break;
+    case 3:
+      value = 12107;            // the highest terrain height
+      break;
+    default:
+      value = height(random);
+      break;
+    }
+  }
+}
+
+/// The conversion of `TerrainTiler::prepareSettingsOfTile` before the kernels
+static i_terrain_height
+previousConversion(float height) {
+  return (i_terrain_height) ((height + 1000) * 5);
+}
+
+static bool
+sameRange(const HeightKernels::Range &a, const HeightKernels::Range &b) {
+  return memcmp(&a.minHeight, &b.minHeight, sizeof(float)) == 0
+    && memcmp(&a.maxHeight, &b.maxHeight, sizeof(float)) == 0
+    && a.valid == b.valid;
+}
+
+/// Check the current instruction set against the scalar kernels
+static void
+checkInstructionSet(const char *instructionSet, float noDataValue) {
+  std::mt19937 random(42);
+  std::vector<float> heights(4225 + 16), replaced, expectedReplaced;
+  std::vector<i_terrain_height> converted(heights.size()), expectedConverted(heights.size());
+
+  for (int pass = 0; pass < 20; pass++) {
+    fillHeights(random, heights, noDataValue);
+
+    for (size_t offset = 0; offset < 8; offset++) {
+      for (size_t count = 0; count + offset <= heights.size(); count += (count < 80) ? 1 : 613) {
+        const float *buffer = heights.data() + offset;
+
+        // Convert
+        HeightKernels::setInstructionSet("scalar");
+        HeightKernels::convertHeights(buffer, count, noDataValue, expectedConverted.data());
+        HeightKernels::setInstructionSet(instructionSet);
+        HeightKernels::convertHeights(buffer, count, noDataValue, converted.data());
+        check(memcmp(converted.data(), expectedConverted.data(), count * sizeof(i_terrain_height)) == 0,
+              "convertHeights", instructionSet, offset, count);
+
+        // Range
+        HeightKernels::setInstructionSet("scalar");
+        const HeightKernels::Range expectedRange = HeightKernels::heightRange(buffer, count, noDataValue);
+        HeightKernels::setInstructionSet(instructionSet);
+        check(sameRange(HeightKernels::heightRange(buffer, count, noDataValue), expectedRange),
+              "heightRange", instructionSet, offset, count);
+
+        // Replace
+        expectedReplaced.assign(buffer, buffer + count);
+        replaced.assign(buffer, buffer + count);
+        HeightKernels::setInstructionSet("scalar");
+        HeightKernels::replaceNoData(expectedReplaced.data(), count, noDataValue, -9999);
+        HeightKernels::setInstructionSet(instructionSet);
+        HeightKernels::replaceNoData(replaced.data(), count, noDataValue, -9999);
+        check(memcmp(replaced.data(), expectedReplaced.data(), count * sizeof(float)) == 0,
+              "replaceNoData", instructionSet, offset, count);
+      }
+    }
+  }
+}
+
+/// Check the conversion of the heights within the terrain range against the previous conversion
+static void
+checkPreviousConversion(const char *instructionSet) {
+  std::vector<float> heights;
+  for (float height = -1000; height <= 12107; height += 0.0625f) {
+    heights.push_back(height);
+  }
+  std::vector<i_terrain_height> converted(heights.size());
+
+  HeightKernels::setInstructionSet(instructionSet);
+  HeightKernels::convertHeights(heights.data(), heights.size(), -32768, converted.data());
+
+  bool ok = true;
+  for (size_t i = 0; i < heights.size() && ok; i++) {
+    ok = converted[i] == previousConversion(heights[i]);
+  }
+  check(ok, "convertHeights against the previous conversion", instructionSet, 0, heights.size());
+}
+
+int
+main() {
+  const char *instructionSets[] = { "scalar", "sse2", "avx2" };
+
+  for (const char *instructionSet : instructionSets) {
+    if (!HeightKernels::setInstructionSet(instructionSet)) {
+      cout << "skipping " << instructionSet << ": not supported" << endl;
+      continue;
+    }
+    cout << "checking " << instructionSet << endl;
+
+    checkInstructionSet(instructionSet, -32768);
+    checkInstructionSet(instructionSet, std::numeric_limits<float>::quiet_NaN());
+    checkPreviousConversion(instructionSet);
+  }
+
+  if (failures) {
+    cerr << failures << " checks failed" << endl;
+    return 1;
+  }
+  return 0;
+}
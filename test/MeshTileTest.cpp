@@ -0,0 +1,341 @@
+/*******************************************************************************
+ * Copyright 2018 GeoData <geodata@soton.ac.uk>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not
+ * use this file except in compliance with the License.  You may obtain a copy
+ * of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ *******************************************************************************/
+
+/**
+ * @file MeshTileTest.cpp
+ * @brief Check the encoding of mesh tiles of every supported size
+ *
+ * A heightfield of each mesh tile size, 65 to 513 samples, is chunked into a
+ * mesh the way the mesh tiler does it, both simplified and at full detail, and
+ * the mesh is encoded as quantized-mesh and decoded again.  The header, the
+ * quantized vertices, the triangle indices and the edge indices must match
+ * the mesh, the 32 bit indices of large meshes must be aligned, and nothing
+ * must be left over.  It exits with `0` on success or `1` otherwise.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "CTBFileOutputStream.hpp"
+#include "HeightFieldChunker.hpp"
+#include "MeshTile.hpp"
+
+using namespace std;
+using namespace ctb;
+
+/// The number of failed checks
+static int failures = 0;
+
+static void
+check(bool ok, const char *what, const std::string &name) {
+  if (ok) return;
+
+  cerr << "FAIL: " << what << " for " << name << endl;
+  failures++;
+}
+
+/// Collect the triangles of a heightfield into a mesh, as `MeshTiler` does
+class TestMesh : public ctb::chunk::mesh {
+public:
+  TestMesh(const CRSBounds &bounds, Mesh &mesh, int tileSize):
+    mBounds(bounds),
+    mMesh(mesh),
+    mCellSize(bounds.getWidth() / (tileSize - 1)),
+    mIndices(tileSize * tileSize, -1),
+    mOddOrder(false),
+    mCount(0) {}
+
+  virtual void clear() {
+    mMesh.vertices.clear();
+    mMesh.indices.clear();
+    std::fill(mIndices.begin(), mIndices.end(), -1);
+    mOddOrder = false;
+    mCount = 0;
+  }
+
+  virtual void emit_vertex(const ctb::chunk::heightfield &heightfield, int x, int y) {
+    mStrip[mCount][0] = x;
+    mStrip[mCount][1] = y;
+    if (++mCount < 3) return;
+
+    mOddOrder = !mOddOrder;
+    const int first = mOddOrder ? 0 : 1, second = mOddOrder ? 1 : 0;
+    appendVertex(heightfield, mStrip[first][0], mStrip[first][1]);
+    appendVertex(heightfield, mStrip[second][0], mStrip[second][1]);
+    appendVertex(heightfield, mStrip[2][0], mStrip[2][1]);
+
+    memmove(mStrip[0], mStrip[1], sizeof(mStrip[0]) * 2);
+    mCount--;
+  }
+
+private:
+  void appendVertex(const ctb::chunk::heightfield &heightfield, int x, int y) {
+    int &index = mIndices[heightfield.indexOfGridCoordinate(x, y)];
+
+    if (index == -1) {
+      index = (int) mMesh.vertices.size();
+      mMesh.vertices.push_back(CRSVertex(mBounds.getMinX() + x * mCellSize,
+                                         mBounds.getMaxY() - y * mCellSize,
+                                         heightfield.height(x, y)));
+    }
+    mMesh.indices.push_back(index);
+  }
+
+  const CRSBounds &mBounds;
+  Mesh &mMesh;
+  double mCellSize;
+  std::vector<int> mIndices;
+  int mStrip[3][2];
+  bool mOddOrder;
+  int mCount;
+};
+
+/// Read the values of an encoded tile in turn
+class Reader {
+public:
+  Reader(const unsigned char *data, size_t size):
+    mData(data),
+    mSize(size),
+    mOffset(0),
+    mOverrun(false) {}
+
+  template<typename T> T
+  read() {
+    T value = T();
+    if (mOffset + sizeof(T) > mSize) {
+      mOverrun = true;
+    } else {
+      memcpy(&value, mData + mOffset, sizeof(T));
+    }
+    mOffset += sizeof(T);
+    return value;
+  }
+
+  inline size_t offset() const { return mOffset; }
+  inline bool overrun() const { return mOverrun; }
+  inline bool atEnd() const { return mOffset == mSize; }
+
+private:
+  const unsigned char *mData;
+  size_t mSize, mOffset;
+  bool mOverrun;
+};
+
+/// The quantized value of a vertex coordinate, as the encoder computes it
+static int
+quantize(double value, double minimum, double maximum) {
+  return (maximum > minimum) ? (int) std::round((value - minimum) * (32767.0 / (maximum - minimum))) : 0;
+}
+
+/// Decode a list of edge indices and check it holds the vertices on the edge
+template<typename T> static bool
+checkEdge(Reader &reader, const std::vector<int> &coordinates, int edge) {
+  const uint32_t count = reader.read<uint32_t>();
+  std::set<uint32_t> decoded, expected;
+
+  for (uint32_t i = 0; i < count && !reader.overrun(); i++) {
+    decoded.insert(reader.read<T>());
+  }
+  for (size_t i = 0; i < coordinates.size(); i++) {
+    if (coordinates[i] == edge) expected.insert((uint32_t) i);
+  }
+  return decoded.size() == count && decoded == expected;
+}
+
+/// Decode the indices of the triangles, stored as high water mark codes
+template<typename T> static bool
+checkIndices(Reader &reader, const std::vector<uint32_t> &indices) {
+  uint32_t highest = 0;
+
+  for (size_t i = 0; i < indices.size(); i++) {
+    const uint32_t code = reader.read<T>();
+    if (highest - code != indices[i]) return false;
+    if (code == 0) highest++;
+  }
+  return !reader.overrun();
+}
+
+/// Encode a mesh tile and check the decoded tile against its mesh
+static void
+checkEncoding(const MeshTile &tile, const std::string &name) {
+  const Mesh &mesh = tile.getMesh();
+
+  // The range of the vertices, from which they are quantized
+  double minimum[3], maximum[3];
+  for (int c = 0; c < 3; c++) {
+    minimum[c] = maximum[c] = mesh.vertices[0][c];
+    for (const CRSVertex &vertex : mesh.vertices) {
+      minimum[c] = std::min(minimum[c], vertex[c]);
+      maximum[c] = std::max(maximum[c], vertex[c]);
+    }
+  }
+
+  for (int normals = 0; normals <= 1; normals++) {
+    CTBMemoryOutputStream ostream;
+    tile.writeFile(ostream, normals == 1);
+    Reader reader(ostream.data(), ostream.size());
+
+    // Header
+    for (int i = 0; i < 3; i++) reader.read<double>();   // center
+    const float minimumHeight = reader.read<float>(), maximumHeight = reader.read<float>();
+    check(minimumHeight == (float) minimum[2] && maximumHeight == (float) maximum[2],
+          "the header height range", name);
+    for (int i = 0; i < 7; i++) reader.read<double>();   // bounding sphere and horizon occlusion point
+
+    // Vertices
+    const uint32_t vertexCount = reader.read<uint32_t>();
+    check(vertexCount == mesh.vertices.size(), "the vertex count", name);
+    if (vertexCount != mesh.vertices.size()) return;
+
+    std::vector<int> quantized[3];
+    bool verticesMatch = true;
+    for (int c = 0; c < 3; c++) {
+      int value = 0;
+      quantized[c].resize(vertexCount);
+
+      for (uint32_t i = 0; i < vertexCount; i++) {
+        const uint16_t zigZag = reader.read<uint16_t>();
+        value += (zigZag >> 1) ^ -(zigZag & 1);
+        quantized[c][i] = value;
+        verticesMatch = verticesMatch && value == quantize(mesh.vertices[i][c], minimum[c], maximum[c]);
+      }
+    }
+    check(verticesMatch, "the quantized vertices", name);
+
+    // Triangles and edges, with 32 bit indices aligned on 4 bytes
+    const bool wideIndices = vertexCount > 65536;
+    if (wideIndices && (vertexCount & 1)) reader.read<uint16_t>();
+    check(reader.offset() % (wideIndices ? 4 : 2) == 0, "the alignment of the indices", name);
+
+    const uint32_t triangleCount = reader.read<uint32_t>();
+    check(triangleCount * 3 == mesh.indices.size(), "the triangle count", name);
+    if (triangleCount * 3 != mesh.indices.size()) return;
+
+    if (wideIndices) {
+      check(checkIndices<uint32_t>(reader, mesh.indices), "the triangle indices", name);
+      check(checkEdge<uint32_t>(reader, quantized[0], 0) && checkEdge<uint32_t>(reader, quantized[1], 0) &&
+            checkEdge<uint32_t>(reader, quantized[0], 32767) && checkEdge<uint32_t>(reader, quantized[1], 32767),
+            "the edge indices", name);
+    } else {
+      check(checkIndices<uint16_t>(reader, mesh.indices), "the triangle indices", name);
+      check(checkEdge<uint16_t>(reader, quantized[0], 0) && checkEdge<uint16_t>(reader, quantized[1], 0) &&
+            checkEdge<uint16_t>(reader, quantized[0], 32767) && checkEdge<uint16_t>(reader, quantized[1], 32767),
+            "the edge indices", name);
+    }
+
+    // Extensions
+    if (normals) {
+      const unsigned char extensionId = reader.read<unsigned char>();
+      const uint32_t extensionLength = reader.read<uint32_t>();
+      check(extensionId == 1 && extensionLength == 2 * vertexCount, "the vertex normals extension", name);
+      for (uint32_t i = 0; i < extensionLength; i++) reader.read<unsigned char>();
+    }
+    check(reader.atEnd(), "the end of the tile", name);
+  }
+}
+
+/// Chunk a heightfield, encode its mesh and check the decoded tile against it
+static void
+checkTile(int tileSize, double maximumError) {
+  std::mt19937 random(tileSize);
+  std::uniform_real_distribution<float> noise(-50, 50);
+
+  // Rolling terrain with rough patches, so large tiles keep most samples at full detail
+  std::vector<float> heights((size_t) tileSize * tileSize);
+  for (int y = 0; y < tileSize; y++) {
+    for (int x = 0; x < tileSize; x++) {
+      heights[(size_t) y * tileSize + x] = 1000 + 800 * std::sin(x * 0.03) * std::cos(y * 0.02) + noise(random);
+    }
+  }
+
+  const CRSBounds bounds(7.03125, 45.0, 7.03125 + 0.17578125, 45.0 + 0.17578125);
+  MeshTile tile(TileCoordinate(10, 1064, 768));
+  Mesh &mesh = tile.getMesh();
+
+  // Chunk the heights into a mesh
+  ctb::chunk::heightfield heightfield(heights.data(), tileSize);
+  heightfield.applyGeometricError(maximumError);
+  TestMesh testMesh(bounds, mesh, tileSize);
+  heightfield.generateMesh(testMesh, 0);
+  heightfield.clear();
+
+  std::ostringstream name;
+  name << "a tile of " << tileSize << " samples with a maximum error of " << maximumError;
+  check(!mesh.indices.empty() && mesh.indices.size() % 3 == 0, "the mesh has triangles", name.str());
+  if (mesh.vertices.empty()) return;
+
+  checkEncoding(tile, name.str());
+
+  // The largest tiles at full detail need 32 bit indices
+  if (tileSize == 513 && maximumError < 1) {
+    check(mesh.vertices.size() > 65536, "a mesh with 32 bit indices", name.str());
+  }
+}
+
+/// Check the index width switches at 65536 vertices, with a strip of triangles
+static void
+checkStrip(uint32_t vertexCount) {
+  const CRSBounds bounds(7.03125, 45.0, 7.03125 + 0.17578125, 45.0 + 0.17578125);
+  MeshTile tile(TileCoordinate(10, 1064, 768));
+  Mesh &mesh = tile.getMesh();
+
+  // The vertices zigzag from the south to the north edge of the tile
+  const uint32_t columns = (vertexCount + 1) / 2 - 1;
+  for (uint32_t i = 0; i < vertexCount; i++) {
+    mesh.vertices.push_back(CRSVertex(bounds.getMinX() + bounds.getWidth() * (i / 2) / columns,
+                                      (i & 1) ? bounds.getMaxY() : bounds.getMinY(),
+                                      i % 7));
+  }
+  for (uint32_t i = 0; i + 2 < vertexCount; i++) {
+    mesh.indices.push_back(i);
+    mesh.indices.push_back(i + 1);
+    mesh.indices.push_back(i + 2);
+  }
+
+  checkEncoding(tile, "a strip of " + std::to_string(vertexCount) + " vertices");
+}
+
+int
+main() {
+  const int tileSizes[] = { 65, 129, 257, 513 };
+  const double maximumErrors[] = { 20, 0.1 };
+
+  for (int tileSize : tileSizes) {
+    for (double maximumError : maximumErrors) {
+      cout << "checking " << tileSize << " samples with a maximum error of " << maximumError << endl;
+      checkTile(tileSize, maximumError);
+    }
+  }
+
+  const uint32_t vertexCounts[] = { 65535, 65536, 65537, 65600, 65637 };
+  for (uint32_t vertexCount : vertexCounts) {
+    cout << "checking a strip of " << vertexCount << " vertices" << endl;
+    checkStrip(vertexCount);
+  }
+
+  if (failures) {
+    cerr << failures << " checks failed" << endl;
+    return 1;
+  }
+  return 0;
+}
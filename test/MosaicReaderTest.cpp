@@ -0,0 +1,142 @@
+/*******************************************************************************
+ * Copyright 2018 GeoData <geodata@soton.ac.uk>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not
+ * use this file except in compliance with the License.  You may obtain a copy
+ * of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ *******************************************************************************/
+
+/**
+ * @file MosaicReaderTest.cpp
+ * @brief Check the holes of a mosaic source are filled from the next source
+ *
+ * Two sources of the same resolution cover the same extent, both with a
+ * nodata value of `NaN`.  The first has its western half as nodata and its
+ * eastern half at 500 m, the second is at 100 m everywhere.  A terrain tile
+ * read from the mosaic must take its western samples from the second source
+ * and its eastern samples from the first, leaving no nodata.  It exits with
+ * `0` on success or `1` otherwise.
+ */
+
+#include <cmath>
+#include <iostream>
+#include <limits>
+#include <string>
+#include <vector>
+
+#include "gdal_priv.h"
+#include "ogr_spatialref.h"
+
+#include "CTBException.hpp"
+#include "GDALDatasetReader.hpp"
+#include "GlobalGeodetic.hpp"
+#include "SourceMosaic.hpp"
+#include "TerrainTiler.hpp"
+
+using namespace std;
+using namespace ctb;
+
+/// The size in pixels of the sources, covering one degree
+static const int SOURCE_SIZE = 256;
+
+/// Create a source in memory over 0 to 1 degree east and north, `NaN` west of a column
+static void
+createSource(const std::string &filename, int firstColumn, float height) {
+  GDALDriver *poDriver = GetGDALDriverManager()->GetDriverByName("GTiff");
+  GDALDataset *poDataset = poDriver->Create(filename.c_str(), SOURCE_SIZE, SOURCE_SIZE, 1, GDT_Float32, NULL);
+  if (poDataset == NULL) {
+    throw CTBException("Could not create a mosaic source");
+  }
+
+  OGRSpatialReference srs;
+  char *wkt = NULL;
+  srs.SetWellKnownGeogCS("WGS84");
+  srs.exportToWkt(&wkt);
+  double adfGeoTransform[6] = { 0, 1.0 / SOURCE_SIZE, 0, 1, 0, -1.0 / SOURCE_SIZE };
+  poDataset->SetGeoTransform(adfGeoTransform);
+  poDataset->SetProjection(wkt);
+  CPLFree(wkt);
+
+  GDALRasterBand *poBand = poDataset->GetRasterBand(1);
+  poBand->SetNoDataValue(std::numeric_limits<double>::quiet_NaN());
+
+  std::vector<float> row(SOURCE_SIZE);
+  for (int x = 0; x < SOURCE_SIZE; x++) {
+    row[x] = (x < firstColumn) ? std::numeric_limits<float>::quiet_NaN() : height;
+  }
+  for (int y = 0; y < SOURCE_SIZE; y++) {
+    if (poBand->RasterIO(GF_Write, 0, y, SOURCE_SIZE, 1, row.data(), SOURCE_SIZE, 1, GDT_Float32, 0, 0) != CE_None) {
+      GDALClose(poDataset);
+      throw CTBException("Could not write a mosaic source");
+    }
+  }
+  GDALClose(poDataset);
+}
+
+int
+main() {
+  GDALAllRegister();
+
+  const std::string first = "/vsimem/ctb-test-mosaic/first.tif",
+    second = "/vsimem/ctb-test-mosaic/second.tif";
+  int failures = 0;
+
+  try {
+    createSource(first, SOURCE_SIZE / 2, 500);
+    createSource(second, 0, 100);
+
+    const GlobalGeodetic grid(65);
+    std::vector<std::string> filenames;
+    filenames.push_back(first);
+    filenames.push_back(second);
+    SourceMosaic mosaic(filenames, grid);
+
+    GDALDataset *poFootprint = mosaic.createFootprint();
+    {
+      const TerrainTiler tiler(poFootprint, grid);
+      GDALDatasetReaderMosaic reader(tiler, mosaic);
+
+      // The tile of zoom 8 over 0 to 0.703125 degree east and north
+      const TileCoordinate coord(8, 256, 128);
+      std::vector<float> heights(65 * 65);
+      reader.readRasterHeightsInto(poFootprint, coord, 65, 65, heights.data());
+
+      int west = 0, east = 0;
+      for (float height : heights) {
+        if (std::isnan(height)) {
+          failures++;
+        } else if (std::fabs(height - 100) < 0.001) {
+          west++;
+        } else if (std::fabs(height - 500) < 0.001) {
+          east++;
+        } else {
+          failures++;
+        }
+      }
+
+      if (failures) {
+        cerr << "FAIL: " << failures << " samples are nodata or taken from no source" << endl;
+      }
+      if (west == 0 || east == 0) {
+        cerr << "FAIL: the tile has " << west << " samples from the second source and "
+             << east << " from the first" << endl;
+        failures++;
+      }
+    }
+    GDALClose(poFootprint);
+  } catch (CTBException &e) {
+    cerr << "FAIL: " << e.what() << endl;
+    failures++;
+  }
+
+  VSIRmdirRecursive("/vsimem/ctb-test-mosaic");
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,444 @@
+/*******************************************************************************
+ * Copyright 2018 GeoData <geodata@soton.ac.uk>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not
+ * use this file except in compliance with the License.  You may obtain a copy
+ * of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ *******************************************************************************/
+
+/**
+ * @file ctb-prepare.cpp
+ * @brief Convert a GDAL raster into a heights dataset aligned with the tiles
+ *
+ * This tool warps the heights of a GDAL raster once into an uncompressed,
+ * internally tiled Float32 GeoTIFF in the spatial reference system of the
+ * tile grid.  Its pixels are the height samples of the terrain and mesh tiles
+ * of the maximum zoom level, and it has an overview for each coarser level
+ * down to the one whose tiles cover the raster with at most 2x2 tiles.
+ *
+ * `ctb-tile` reads the heights of such a dataset directly instead of warping
+ * the source for every tile, and through a memory map as it is uncompressed.
+ * The output blocks without any data are not written, so the file is sparse.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <climits>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <string.h>             // for strcmp
+#include <stdlib.h>             // for atoi
+
+#include "cpl_multiproc.h"      // for CPLGetNumCPUs
+#include "gdal_priv.h"
+#include "gdalwarper.h"
+#include "commander.hpp"
+
+#include "config.hpp"
+#include "CTBException.hpp"
+#include "GlobalGeodetic.hpp"
+#include "GlobalMercator.hpp"
+#include "TerrainTiler.hpp"
+
+using namespace std;
+using namespace ctb;
+
+/// The size of the blocks of the output
+static const int BLOCK_SIZE = 256;
+
+/// Handle the prepare CLI options
+class TerrainPrepare : public Command {
+public:
+  TerrainPrepare(const char *name, const char *version) :
+    Command(name, version),
+    outputFilename(NULL),
+    profile("geodetic"),
+    threadCount(-1),
+    tileSize(0),
+    startZoom(-1),
+    heightBand(1),
+    resampleAlg(GRA_Average),
+    verbosity(1)
+  {}
+
+  void
+  check() const {
+    switch(command->argc) {
+    case 1:
+      if (outputFilename) return;
+      cerr << "  Error: The output file must be specified" << endl;
+      break;
+    case 0:
+      cerr << "  Error: The GDAL dataset must be specified" << endl;
+      break;
+    default:
+      cerr << "  Error: Only one command line argument must be specified" << endl;
+      break;
+    }
+
+    help();                     // print help and exit
+  }
+
+  static void
+  setOutputFilename(command_t *command) {
+    static_cast<TerrainPrepare *>(Command::self(command))->outputFilename = command->arg;
+  }
+
+  static void
+  setProfile(command_t *command) {
+    static_cast<TerrainPrepare *>(Command::self(command))->profile = command->arg;
+  }
+
+  static void
+  setThreadCount(command_t *command) {
+    static_cast<TerrainPrepare *>(Command::self(command))->threadCount = atoi(command->arg);
+  }
+
+  static void
+  setTileSize(command_t *command) {
+    static_cast<TerrainPrepare *>(Command::self(command))->tileSize = atoi(command->arg);
+  }
+
+  static void
+  setStartZoom(command_t *command) {
+    static_cast<TerrainPrepare *>(Command::self(command))->startZoom = atoi(command->arg);
+  }
+
+  static void
+  setHeightBand(command_t *command) {
+    static_cast<TerrainPrepare *>(Command::self(command))->heightBand = atoi(command->arg);
+  }
+
+  static void
+  setQuiet(command_t *command) {
+    --(static_cast<TerrainPrepare *>(Command::self(command))->verbosity);
+  }
+
+  static void
+  setResampleAlg(command_t *command) {
+    GDALResampleAlg eResampleAlg;
+
+    if (strcmp(command->arg, "nearest") == 0)
+      eResampleAlg = GRA_NearestNeighbour;
+    else if (strcmp(command->arg, "bilinear") == 0)
+      eResampleAlg = GRA_Bilinear;
+    else if (strcmp(command->arg, "cubic") == 0)
+      eResampleAlg = GRA_Cubic;
+    else if (strcmp(command->arg, "cubicspline") == 0)
+      eResampleAlg = GRA_CubicSpline;
+    else if (strcmp(command->arg, "lanczos") == 0)
+      eResampleAlg = GRA_Lanczos;
+    else if (strcmp(command->arg, "average") == 0)
+      eResampleAlg = GRA_Average;
+    else if (strcmp(command->arg, "max") == 0)
+      eResampleAlg = GRA_Max;
+    else if (strcmp(command->arg, "min") == 0)
+      eResampleAlg = GRA_Min;
+    else if (strcmp(command->arg, "med") == 0)
+      eResampleAlg = GRA_Med;
+    else {
+      cerr << "Error: Unknown resampling algorithm: " << command->arg << endl;
+      static_cast<TerrainPrepare *>(Command::self(command))->help(); // exit
+    }
+
+    static_cast<TerrainPrepare *>(Command::self(command))->resampleAlg = eResampleAlg;
+  }
+
+  const char *
+  getInputFilename() const {
+    return  (command->argc == 1) ? command->argv[0] : NULL;
+  }
+
+  const char *outputFilename;
+  const char *profile;
+  int threadCount;
+  int tileSize;
+  int startZoom;
+  int heightBand;
+  GDALResampleAlg resampleAlg;
+  int verbosity;
+};
+
+/// The output dataset shared by the warping threads
+struct PrepareJob {
+  GDALRasterBand *band;         ///< The heights band of the output
+  std::string gridWKT;          ///< The spatial reference system of the output
+  double geoTransform[6];       ///< The geo transform of the output
+  int xSize, ySize;             ///< The size of the output in pixels
+  double noDataValue;           ///< The nodata value of the heights
+
+  std::mutex mutex;             ///< Serialises the writes to the output
+  std::atomic<int> nextBlock;   ///< The next block to be warped
+  std::atomic<bool> failed;     ///< Has a thread failed?
+};
+
+/**
+ * @brief Warp the blocks of the output in turn until they are exhausted
+ *
+ * Each thread opens its own handle on the source and reads the blocks from a
+ * warped VRT of the whole output, writing those with any data.
+ */
+static void
+warpBlocks(const TerrainPrepare *command, PrepareJob *job) {
+  GDALDatasetH hSrcDS = GDALOpen(command->getInputFilename(), GA_ReadOnly);
+  if (hSrcDS == NULL) {
+    job->failed = true;
+    return;
+  }
+
+  CPLStringList transformOptions;
+  transformOptions.SetNameValue("DST_SRS", job->gridWKT.c_str());
+
+  void *transformerArg = GDALCreateGenImgProjTransformer2(hSrcDS, NULL, transformOptions.List());
+  if (transformerArg == NULL) {
+    GDALClose(hSrcDS);
+    job->failed = true;
+    return;
+  }
+  GDALSetGenImgProjTransformerDstGeoTransform(transformerArg, job->geoTransform);
+
+  GDALWarpOptions *psWarpOptions = GDALCreateWarpOptions();
+  psWarpOptions->eResampleAlg = command->resampleAlg;
+  psWarpOptions->hSrcDS = hSrcDS;
+  psWarpOptions->nBandCount = 1;
+  psWarpOptions->panSrcBands = (int *) CPLMalloc(sizeof(int));
+  psWarpOptions->panDstBands = (int *) CPLMalloc(sizeof(int));
+  psWarpOptions->panSrcBands[0] = command->heightBand;
+  psWarpOptions->panDstBands[0] = 1;
+  psWarpOptions->padfSrcNoDataReal = (double *) CPLCalloc(1, sizeof(double));
+  psWarpOptions->padfSrcNoDataImag = (double *) CPLCalloc(1, sizeof(double));
+  psWarpOptions->padfDstNoDataReal = (double *) CPLCalloc(1, sizeof(double));
+  psWarpOptions->padfDstNoDataImag = (double *) CPLCalloc(1, sizeof(double));
+  psWarpOptions->padfSrcNoDataReal[0] = psWarpOptions->padfDstNoDataReal[0] = job->noDataValue;
+  psWarpOptions->pTransformerArg = GDALCreateApproxTransformer(GDALGenImgProjTransform, transformerArg, 0.125);
+  psWarpOptions->pfnTransformer = GDALApproxTransform;
+
+  CPLStringList warpOptions(psWarpOptions->papszWarpOptions, false);
+  warpOptions.SetNameValue("INIT_DEST", "NO_DATA");
+  psWarpOptions->papszWarpOptions = warpOptions.StealList();
+
+  GDALDatasetH hVRTDS = GDALCreateWarpedVRT(hSrcDS, job->xSize, job->ySize, job->geoTransform, psWarpOptions);
+  GDALDestroyWarpOptions(psWarpOptions);
+
+  if (hVRTDS == NULL) {
+    GDALDestroyGenImgProjTransformer(transformerArg);
+    GDALClose(hSrcDS);
+    job->failed = true;
+    return;
+  }
+
+  GDALRasterBand *poVRTBand = ((GDALDataset *) hVRTDS)->GetRasterBand(1);
+  const int xBlocks = (job->xSize + BLOCK_SIZE - 1) / BLOCK_SIZE,
+    blockCount = xBlocks * ((job->ySize + BLOCK_SIZE - 1) / BLOCK_SIZE);
+  std::vector<float> buffer(BLOCK_SIZE * BLOCK_SIZE);
+
+  for (int block = job->nextBlock++; block < blockCount && !job->failed; block = job->nextBlock++) {
+    const int x = (block % xBlocks) * BLOCK_SIZE,
+      y = (block / xBlocks) * BLOCK_SIZE,
+      width = std::min(BLOCK_SIZE, job->xSize - x),
+      height = std::min(BLOCK_SIZE, job->ySize - y);
+
+    if (poVRTBand->RasterIO(GF_Read, x, y, width, height,
+                            (void *) buffer.data(), width, height, GDT_Float32,
+                            0, 0) != CE_None) {
+      job->failed = true;
+      break;
+    }
+
+    // Leave the blocks without data sparse
+    const float noDataValue = (float) job->noDataValue;
+    if (std::all_of(buffer.begin(), buffer.begin() + width * height,
+                    [noDataValue](float value) { return value == noDataValue; })) {
+      continue;
+    }
+
+    std::lock_guard<std::mutex> lock(job->mutex);
+    if (job->band->RasterIO(GF_Write, x, y, width, height,
+                            (void *) buffer.data(), width, height, GDT_Float32,
+                            0, 0) != CE_None) {
+      job->failed = true;
+    }
+  }
+
+  GDALClose(hVRTDS);
+  GDALDestroyGenImgProjTransformer(transformerArg);
+  GDALClose(hSrcDS);
+}
+
+int
+main(int argc, char *argv[]) {
+  TerrainPrepare command = TerrainPrepare(argv[0], version.cstr);
+  command.setUsage("-o OUTPUT_FILE GDAL_DATASET");
+  command.option("-o", "--output-file <file>", "specify the GeoTIFF file to create", TerrainPrepare::setOutputFilename);
+  command.option("-p", "--profile <profile>", "specify the TMS profile of the tiles that will be created from the file. This is either `geodetic` (the default) or `mercator`", TerrainPrepare::setProfile);
+  command.option("-t", "--tile-size <size>", "specify the size of the tiles in height samples, as given to `ctb-tile`. This defaults to 65", TerrainPrepare::setTileSize);
+  command.option("-s", "--start-zoom <zoom>", "specify the deepest zoom level whose height samples are the pixels of the file. Defaults to the maximum zoom level of the dataset", TerrainPrepare::setStartZoom);
+  command.option("-r", "--resampling-method <algorithm>", "specify the raster resampling algorithm.  One of: nearest; bilinear; cubic; cubicspline; lanczos; average; max; min; med. Defaults to average.", TerrainPrepare::setResampleAlg);
+  command.option("-B", "--height-band <band>", "specify the band of the source dataset holding the heights. Defaults to 1", TerrainPrepare::setHeightBand);
+  command.option("-c", "--thread-count <count>", "specify the number of threads to use for warping. By default this is the number of CPUs.", TerrainPrepare::setThreadCount);
+  command.option("-q", "--quiet", "only output errors", TerrainPrepare::setQuiet);
+
+  // Parse and check the arguments
+  command.parse(argc, argv);
+  command.check();
+
+  GDALAllRegister();
+
+  const int tileSize = (command.tileSize < 1) ? 65 : command.tileSize;
+  if (tileSize < 2) {
+    cerr << "Error: The tile size must be at least 2" << endl;
+    return 1;
+  }
+
+  Grid grid;
+  if (strcmp(command.profile, "geodetic") == 0) {
+    grid = GlobalGeodetic(tileSize);
+  } else if (strcmp(command.profile, "mercator") == 0) {
+    grid = GlobalMercator(tileSize);
+  } else {
+    cerr << "Error: Unknown profile: " << command.profile << endl;
+    return 1;
+  }
+
+  GDALDataset *poDataset = (GDALDataset *) GDALOpen(command.getInputFilename(), GA_ReadOnly);
+  if (poDataset == NULL) {
+    cerr << "Error: could not open GDAL dataset" << endl;
+    return 1;
+  }
+
+  GDALRasterBand *heightsBand = poDataset->GetRasterBand(command.heightBand);
+  if (heightsBand == NULL) {
+    cerr << "Error: The height band is not present in the GDAL dataset" << endl;
+    GDALClose(poDataset);
+    return 1;
+  }
+
+  PrepareJob job;
+  int bGotNoData = FALSE;
+  job.noDataValue = heightsBand->GetNoDataValue(&bGotNoData);
+  if (!bGotNoData) job.noDataValue = -32768;
+
+  // The zoom levels of the pixels and of the coarsest overview, whose tiles
+  // the output is aligned to
+  i_zoom maxZoom, alignZoom;
+  TileBounds tileBounds;
+  try {
+    const TerrainTiler tiler(poDataset, grid);
+
+    maxZoom = (command.startZoom < 0) ? tiler.maxZoomLevel() : command.startZoom;
+    alignZoom = maxZoom;
+    tileBounds = tiler.tileBoundsForZoom(alignZoom);
+
+    while (alignZoom > 0 && (tileBounds.getWidth() > 1 || tileBounds.getHeight() > 1)) {
+      tileBounds = tiler.tileBoundsForZoom(--alignZoom);
+    }
+  } catch (CTBException &e) {
+    cerr << "Error: " << e.what() << endl;
+    GDALClose(poDataset);
+    return 1;
+  }
+  GDALClose(poDataset);
+
+  // The pixels of the output are the height samples of the tiles at the
+  // maximum zoom level, which share their edges
+  const int levels = maxZoom - alignZoom;
+  const double xSize = (double) (tileBounds.getWidth() + 1) * (tileSize - 1) * (1 << levels),
+    ySize = (double) (tileBounds.getHeight() + 1) * (tileSize - 1) * (1 << levels);
+
+  if (xSize > INT_MAX || ySize > INT_MAX) {
+    cerr << "Error: The output would be too large, try a lower start zoom level" << endl;
+    return 1;
+  }
+  job.xSize = (int) xSize;
+  job.ySize = (int) ySize;
+
+  const CRSBounds upperLeft = grid.tileBounds(TileCoordinate(alignZoom, tileBounds.getMinX(), tileBounds.getMaxY()));
+  const double resolution = upperLeft.getWidth() / (job.xSize / (tileBounds.getWidth() + 1));
+  job.geoTransform[0] = upperLeft.getMinX();
+  job.geoTransform[1] = resolution;
+  job.geoTransform[2] = 0;
+  job.geoTransform[3] = upperLeft.getMaxY();
+  job.geoTransform[4] = 0;
+  job.geoTransform[5] = -resolution;
+
+  char *gridWKT = NULL;
+  grid.getSRS().exportToWkt(&gridWKT);
+  job.gridWKT = gridWKT;
+  CPLFree(gridWKT);
+
+  // Create the output
+  GDALDriver *poDriver = GetGDALDriverManager()->GetDriverByName("GTiff");
+  if (poDriver == NULL) {
+    cerr << "Error: The GTiff driver is not available" << endl;
+    return 1;
+  }
+
+  CPLStringList creationOptions;
+  creationOptions.SetNameValue("TILED", "YES");
+  creationOptions.SetNameValue("BLOCKXSIZE", CPLSPrintf("%d", BLOCK_SIZE));
+  creationOptions.SetNameValue("BLOCKYSIZE", CPLSPrintf("%d", BLOCK_SIZE));
+  creationOptions.SetNameValue("COMPRESS", "NONE");
+  creationOptions.SetNameValue("SPARSE_OK", "TRUE");
+  creationOptions.SetNameValue("BIGTIFF", "IF_SAFER");
+
+  GDALDataset *poOutput = poDriver->Create(command.outputFilename, job.xSize, job.ySize, 1, GDT_Float32, creationOptions.List());
+  if (poOutput == NULL) {
+    cerr << "Error: Could not create " << command.outputFilename << endl;
+    return 1;
+  }
+  poOutput->SetGeoTransform(job.geoTransform);
+  poOutput->SetProjection(job.gridWKT.c_str());
+  job.band = poOutput->GetRasterBand(1);
+  job.band->SetNoDataValue(job.noDataValue);
+
+  if (command.verbosity > 0) {
+    cout << "Preparing " << job.xSize << "x" << job.ySize << " pixels for zoom levels "
+         << maxZoom << " to " << alignZoom << endl;
+  }
+
+  // Warp the heights in parallel
+  const int threadCount = (command.threadCount > 0) ? command.threadCount : CPLGetNumCPUs();
+  std::vector<std::thread> threads;
+  job.nextBlock = 0;
+  job.failed = false;
+
+  for (int i = 0; i < threadCount; ++i) {
+    threads.push_back(std::thread(warpBlocks, &command, &job));
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+
+  if (job.failed) {
+    cerr << "Error: Could not warp the GDAL dataset" << endl;
+    GDALClose(poOutput);
+    return 1;
+  }
+
+  // Add an overview for each coarser zoom level
+  if (levels > 0) {
+    std::vector<int> factors(levels);
+    for (int i = 0; i < levels; i++) factors[i] = 2 << i;
+
+    CPLSetConfigOption("GDAL_NUM_THREADS", CPLSPrintf("%d", threadCount));
+    if (poOutput->BuildOverviews("AVERAGE", levels, factors.data(), 0, NULL,
+                                 (command.verbosity > 0) ? GDALTermProgress : GDALDummyProgress, NULL) != CE_None) {
+      cerr << "Error: Could not build the overviews" << endl;
+      GDALClose(poOutput);
+      return 1;
+    }
+  }
+
+  GDALClose(poOutput);
+  return 0;
+}
@@ -22,17 +22,22 @@
  * terrain tiles which are written to an output directory on the filesystem.
  *
  * In the case of a multiband raster, only the first band is used to create the
- * terrain heights.  No water mask is currently set and all tiles are flagged
- * as being 'all land'.
+ * terrain heights unless another one is selected with `--height-band`.  Using
+ * the `--water-mask` flag another band can be used as the water mask,
+ * otherwise all tiles are flagged as being 'all land'.  Only those bands are
+ * warped.
  *
  * It is recommended that the input raster is in the EPSG 4326 spatial
  * reference system. If this is not the case then the tiles will be reprojected
  * to EPSG 4326 as required by the terrain tile format.
  *
  * Using the `--output-format` flag this tool can also be used to create tiles
- * in other raster formats that are supported by GDAL.
+ * in other raster formats that are supported by GDAL, or elevation images in
+ * the Terrain-RGB and Terrarium encodings of the heights.
  */
 
+#include <algorithm>
+#include <deque>
 #include <iostream>
 #include <fstream>
 #include <sstream>
@@ -41,9 +46,9 @@
 #include <stdlib.h>             // for atoi
 #include <thread>
 #include <mutex>
-#include <future>
+#include <atomic>
+#include <condition_variable>
 
-#include "cpl_multiproc.h"      // for CPLGetNumCPUs
 #include "cpl_vsi.h"            // for virtual filesystem
 #include "gdal_priv.h"
 #include "commander.hpp"        // for cli parsing
@@ -56,6 +61,15 @@
 #include "GDALDatasetReader.hpp"
 #include "CTBFileTileSerializer.hpp"
 #include "CTBMBTileSerializer.hpp"
+#include "GDALTileEncoder.hpp"
+#include "ImageTiler.hpp"
+#include "TileAvailability.hpp"
+#include "CoverageIndex.hpp"
+#include "OverviewCache.hpp"
+#include "PngHeightEncoder.hpp"
+#include "SourceMosaic.hpp"
+#include "TileArena.hpp"
+#include "TilingEngine.hpp"
 
 using namespace std;
 using namespace ctb;
@@ -82,8 +96,17 @@ public:
 	std::shared_ptr<TerrainSerializer> terrainSerializer;
   std::shared_ptr<MeshSerializer>  meshSerializer;
   std::shared_ptr<GDALSerializer> gdalSerializer;
+  std::shared_ptr<ImageSerializer> imageSerializer;
 };
 
+/// Is an output format one of the PNG encodings of the heights?
+static bool
+isImageFormat(const char *format) {
+  return strcmp(format, "TerrainRGB") == 0 || strcmp(format, "Terrarium") == 0;
+}
+
+class TileAvailabilityRecorder;
+
 /// Handle the terrain build CLI options
 class TerrainBuild : public Command {
 public:
@@ -103,6 +126,16 @@ public:
     metadata(false),
     cesiumFriendly(false),
     vertexNormals(false),
+    availabilityLevels(0),
+    skipEmpty(false),
+    stream(false),
+    useMosaic(false),
+    fillDistance(0),
+    pngFilter(PngHeightEncoder::FilterUp),
+    pngCompression(6),
+    deduplicate(false),
+    duplicate(CTBFileTileSerializer::DuplicateHardLink),
+    duplicateLinks(false),
     fileFormat(TilerFileFormat::File)
   {}
 
@@ -223,6 +256,11 @@ public:
     static_cast<TerrainBuild *>(Command::self(command))->tilerOptions.warpMemoryLimit = atof(command->arg);
   }
 
+  static void
+  setMaskBand(command_t *command) {
+    static_cast<TerrainBuild *>(Command::self(command))->tilerOptions.maskBand = atoi(command->arg);
+  }
+
   const char *
   getInputFilename() const {
     return  (command->argc == 1) ? command->argv[0] : NULL;
@@ -254,6 +292,100 @@ public:
     static_cast<TerrainBuild *>(Command::self(command))->vertexNormals = true;
   }
 
+  static void
+    setAvailabilityLevels(command_t *command) {
+    static_cast<TerrainBuild *>(Command::self(command))->availabilityLevels = atoi(command->arg);
+  }
+
+  static void
+    setHeightBand(command_t *command) {
+    static_cast<TerrainBuild *>(Command::self(command))->tilerOptions.heightBand = atoi(command->arg);
+  }
+
+  static void
+    setSkipEmpty(command_t *command) {
+    static_cast<TerrainBuild *>(Command::self(command))->skipEmpty = true;
+  }
+
+  static void
+    setFlatTolerance(command_t *command) {
+    static_cast<TerrainBuild *>(Command::self(command))->tilerOptions.flatTolerance = atof(command->arg);
+  }
+
+  static void
+    setStream(command_t *command) {
+    static_cast<TerrainBuild *>(Command::self(command))->stream = true;
+  }
+
+  static void
+    setFillDistance(command_t *command) {
+    static_cast<TerrainBuild *>(Command::self(command))->fillDistance = atoi(command->arg);
+  }
+
+  static void
+    setMosaic(command_t *command) {
+    static_cast<TerrainBuild *>(Command::self(command))->useMosaic = true;
+  }
+
+  static void
+    setPngFilter(command_t *command) {
+    PngHeightEncoder::Filter filter;
+
+    if (strcmp(command->arg, "none") == 0)
+      filter = PngHeightEncoder::FilterNone;
+    else if (strcmp(command->arg, "sub") == 0)
+      filter = PngHeightEncoder::FilterSub;
+    else if (strcmp(command->arg, "up") == 0)
+      filter = PngHeightEncoder::FilterUp;
+    else if (strcmp(command->arg, "average") == 0)
+      filter = PngHeightEncoder::FilterAverage;
+    else if (strcmp(command->arg, "paeth") == 0)
+      filter = PngHeightEncoder::FilterPaeth;
+    else if (strcmp(command->arg, "adaptive") == 0)
+      filter = PngHeightEncoder::FilterAdaptive;
+    else {
+      cerr << "Error: Unknown PNG filter: " << command->arg << endl;
+      static_cast<TerrainBuild *>(Command::self(command))->help(); // exit
+    }
+
+    static_cast<TerrainBuild *>(Command::self(command))->pngFilter = filter;
+  }
+
+  static void
+    setPngCompression(command_t *command) {
+    static_cast<TerrainBuild *>(Command::self(command))->pngCompression = atoi(command->arg);
+  }
+
+  static void
+    setDeduplicate(command_t *command) {
+    static_cast<TerrainBuild *>(Command::self(command))->deduplicate = true;
+  }
+
+  static void
+    setDuplicateLinks(command_t *command) {
+    CTBFileTileSerializer::Duplicate duplicate;
+
+    if (strcmp(command->arg, "hard") == 0)
+      duplicate = CTBFileTileSerializer::DuplicateHardLink;
+    else if (strcmp(command->arg, "symbolic") == 0)
+      duplicate = CTBFileTileSerializer::DuplicateSymbolicLink;
+    else if (strcmp(command->arg, "copy") == 0)
+      duplicate = CTBFileTileSerializer::DuplicateCopy;
+    else {
+      cerr << "Error: Unknown type of duplicate link: " << command->arg << endl;
+      static_cast<TerrainBuild *>(Command::self(command))->help(); // exit
+    }
+
+    static_cast<TerrainBuild *>(Command::self(command))->duplicate = duplicate;
+    static_cast<TerrainBuild *>(Command::self(command))->duplicateLinks = true;
+  }
+
+  /// Is a format among the output formats?
+  bool
+  hasOutputFormat(const char *format) const {
+    return std::find(outputFormats.begin(), outputFormats.end(), format) != outputFormats.end();
+  }
+
   const char *outputDir,
     *outputFormat,
     *profile,
@@ -274,11 +406,69 @@ public:
   bool metadata;
   bool cesiumFriendly;
   bool vertexNormals;
+  int availabilityLevels;
+  bool skipEmpty;
+  bool stream;
+  bool useMosaic;
+  int fillDistance;
+  PngHeightEncoder::Filter pngFilter;
+  int pngCompression;
+  bool deduplicate;
+  CTBFileTileSerializer::Duplicate duplicate;
+  bool duplicateLinks;
+
+  /// The sources of the heights when the input is a mosaic
+  std::shared_ptr<SourceMosaic> mosaic;
+
+  /// The availability of the tiles created, when mesh tiles carry it
+  std::shared_ptr<TileAvailabilityRecorder> availabilityRecorder;
+
+  /// The formats listed by `--output-format`, the first being `outputFormat`
+  std::vector<std::string> outputFormats;
+
+  /// The profiles listed by `--profile`, the first being `profile`
+  std::vector<std::string> profiles;
 
   TilerFileFormat fileFormat;
 
 };
 
+/**
+ * Get the directory of the tiles of a profile and output format
+ *
+ * When several profiles or formats are written to files each is given a
+ * subdirectory of the output directory named after it, such as `geodetic` or
+ * `mercator` for profiles, and `terrain` or `mesh` for formats.
+ */
+static string
+getOutputDirname(const TerrainBuild *command, const string &profile, const string &format) {
+  string dirname = string(command->outputDir) + osDirSep;
+
+  if (command->fileFormat == TilerFileFormat::File) {
+    if (command->profiles.size() > 1) {
+      dirname += profile + osDirSep;
+    }
+    if (command->outputFormats.size() > 1) {
+      dirname += CPLString(format).tolower() + osDirSep;
+    }
+  }
+  return dirname;
+}
+
+/// Get the name of the MBTiles file of a profile and output format, suffixed with those there are several of
+static string
+getMBTilesName(const TerrainBuild *command, const string &profile, const string &format) {
+  string name = command->mbTilesName;
+
+  if (command->profiles.size() > 1) {
+    name += "-" + profile;
+  }
+  if (command->outputFormats.size() > 1) {
+    name += "-" + CPLString(format).tolower();
+  }
+  return name;
+}
+
 /**
  * Create a filename for a tile coordinate
  *
@@ -328,40 +518,99 @@ getTileFilename(const TileCoordinate *coord, const string dirname, const char *e
 /**
  * Increment a TilerIterator whilst cooperating between threads
  *
- * This function maintains an global index on an iterator and when called
- * ensures the iterator is incremented to point to the next global index.  This
- * can therefore be called with different tiler iterators by different threads
- * to ensure all tiles are iterated over consecutively.  It assumes individual
- * tile iterators point to the same source GDAL dataset.
+ * This claims the next tile of the job and increments the iterator to point
+ * to it.  This can therefore be called with different tiler iterators by the
+ * different workers of a job to ensure all tiles are iterated over
+ * consecutively.  It assumes individual tile iterators point to the same
+ * source GDAL dataset.
  */
-static int globalIteratorIndex = 0; // keep track of where we are globally
 template<typename T> int
-incrementIterator(T &iter, int currentIndex) {
-  static mutex mutex;        // ensure iterations occur serially between threads
-
-  lock_guard<std::mutex> lock(mutex);
+incrementIterator(T &iter, int currentIndex, TilingJob &job) {
+  const int index = (int) job.claim();
 
-  while (currentIndex < globalIteratorIndex) {
+  while (currentIndex < index) {
     ++iter;
     ++currentIndex;
   }
-  ++globalIteratorIndex;
 
   return currentIndex;
 }
 
-/// Get a handle on the total number of tiles to be created
-static int iteratorSize = 0;    // the total number of tiles
-template<typename T> void
-setIteratorSize(T &iter) {
-  static mutex mutex;
+/**
+ * Record the availability of the tiles created by all threads
+ *
+ * Tiles are iterated from the maximum zoom level downwards, so when a tile
+ * carrying the availability of the tiles below it is created every tile of the
+ * deeper zoom levels has already been handed out to a thread.  The tile only
+ * has to wait for those threads to record them.
+ *
+ * A recorder is created for each tileset and shared by the jobs creating its
+ * tiles.  It is cancelled along with a job, as the tiles the job leaves would
+ * never be recorded, which makes the threads waiting for them throw.
+ */
+class TileAvailabilityRecorder {
+public:
+  /// Set the number of tiles expected at each zoom level, only once
+  void
+  setLevels(const GDALTiler &tiler, i_zoom startZoom, i_zoom endZoom) {
+    lock_guard<std::mutex> lock(mutex);
 
-  lock_guard<std::mutex> lock(mutex);
+    if (expected.size() > 0) return;
 
-  if (iteratorSize == 0) {
-    iteratorSize = iter.getSize();
+    expected.resize(startZoom + 1, 0);
+    recorded.resize(startZoom + 1, 0);
+    for (i_zoom zoom = endZoom; zoom <= startZoom; zoom++) {
+      TileBounds bounds = tiler.tileBoundsForZoom(zoom);
+      expected[zoom] = (bounds.getWidth() + 1) * (bounds.getHeight() + 1);
+    }
   }
-}
+
+  /// Record a tile as handed out to a thread, and available unless it was skipped
+  void
+  add(const TileCoordinate &coord, bool available = true) {
+    lock_guard<std::mutex> lock(mutex);
+
+    if (available) availability.add(coord);
+    if (coord.zoom < recorded.size() && ++recorded[coord.zoom] == expected[coord.zoom]) {
+      completed.notify_all();
+    }
+  }
+
+  /// Stop recording, waking the threads waiting for the availability of tiles
+  void
+  cancel() {
+    lock_guard<std::mutex> lock(mutex);
+
+    cancelled = true;
+    completed.notify_all();
+  }
+
+  /// Get the availability of the tiles below a tile once they are all recorded
+  std::string
+  metadataJson(const TileCoordinate &coord, i_zoom levels) {
+    unique_lock<std::mutex> lock(mutex);
+
+    completed.wait(lock, [&]() {
+      if (cancelled) return true;
+      for (size_t zoom = coord.zoom + 1; zoom <= coord.zoom + levels && zoom < recorded.size(); zoom++) {
+        if (recorded[zoom] < expected[zoom]) return false;
+      }
+      return true;
+    });
+
+    if (cancelled) {
+      throw CTBException("The availability of the tiles was not recorded as the tiling was cancelled");
+    }
+    return availability.metadataJson(coord, levels);
+  }
+
+private:
+  bool cancelled = false;
+  std::mutex mutex;
+  std::condition_variable completed;
+  TileAvailability availability;
+  std::vector<i_tile> expected, recorded;
+};
 
 /// A thread safe wrapper around `GDALTermProgress`
 static int
@@ -388,18 +637,18 @@ CPL_STDCALL verboseProgress(double dfComplete, const char *pszMessage, void *pPr
 // Default to outputting using the GDAL progress meter
 static GDALProgressFunc progressFunc = termProgress;
 
-/// Output the progress of the tiling operation
+/// Output the progress of the tiling operation out of a number of tiles
 int
-showProgress(int currentIndex, string filename) {
+showProgress(int currentIndex, size_t size, string filename) {
   stringstream stream;
   stream << "created " << filename << " in thread " << this_thread::get_id();
   string message = stream.str();
 
-  return progressFunc(currentIndex / (double) iteratorSize, message.c_str(), NULL);
+  return progressFunc(currentIndex / (double) size, message.c_str(), NULL);
 }
 int
-showProgress(int currentIndex) {
-  return progressFunc(currentIndex / (double) iteratorSize, NULL, NULL);
+showProgress(int currentIndex, size_t size) {
+  return progressFunc(currentIndex / (double) size, NULL, NULL);
 }
 
 static bool
@@ -436,85 +685,68 @@ fileCopy(const std::string& sourceFilename, const std::string& targetFilename) {
 /// Handle the terrain metadata
 class TerrainMetadata {
 public:
-  TerrainMetadata() {
-  }
-
-  // Defines the valid tile indexes of a level in a Tileset
-  struct LevelInfo {
-  public:
-    LevelInfo() {
-      startX = startY = std::numeric_limits<int>::max();
-      finalX = finalY = std::numeric_limits<int>::min();
-    }
-    int startX, startY;
-    int finalX, finalY;
-
-    inline void add(const TileCoordinate *coordinate) {
-      startX = std::min(startX, (int)coordinate->x);
-      startY = std::min(startY, (int)coordinate->y);
-      finalX = std::max(finalX, (int)coordinate->x);
-      finalY = std::max(finalY, (int)coordinate->y);
-    }
-    inline void add(const LevelInfo &level) {
-      startX = std::min(startX, level.startX);
-      startY = std::min(startY, level.startY);
-      finalX = std::max(finalX, level.finalX);
-      finalY = std::max(finalY, level.finalY);
-    }
-  };
-  std::vector<LevelInfo> levels;
+  TerrainMetadata():
+    mFixedBounds(false)
+  {}
 
-  // Defines the bounding box covered by the Terrain
-  CRSBounds bounds;
+  // Defines the valid tile indexes of every level in a Tileset
+  TileAvailability availability;
 
   // Add metadata of the specified Coordinate
-  void add(const Grid &grid, const TileCoordinate *coordinate) {
-    CRSBounds tileBounds = grid.tileBounds(*coordinate);
-    i_zoom zoom = coordinate->zoom;
-
-    if ((1 + zoom) > levels.size()) {
-      for (size_t i = 0; i <= zoom; i++) {
-        levels.push_back(LevelInfo());
-      }
-    }
-    LevelInfo &level = levels[zoom];
-    level.add(coordinate);
-
-    if (bounds.getMaxX() == bounds.getMinX()) {
-      bounds = tileBounds;
-    }
-    else {
-      bounds.setMinX(std::min(bounds.getMinX(), tileBounds.getMinX()));
-      bounds.setMinY(std::min(bounds.getMinY(), tileBounds.getMinY()));
-      bounds.setMaxX(std::max(bounds.getMaxX(), tileBounds.getMaxX()));
-      bounds.setMaxY(std::max(bounds.getMaxY(), tileBounds.getMaxY()));
-    }
+  inline void add(const TileCoordinate *coordinate) {
+    availability.add(*coordinate);
   }
 
   // Add metadata info
   void add(const TerrainMetadata &otherMetadata) {
-    if (otherMetadata.levels.size() > 0) {
-      const CRSBounds &otherBounds = otherMetadata.bounds;
+    availability.add(otherMetadata.availability);
+  }
 
-      for (size_t i = 0; i < (otherMetadata.levels.size() - this->levels.size()); i++) {
-        levels.push_back(LevelInfo());
-      }
-      for (size_t i = 0; i < levels.size(); i++) {
-        levels[i].add(otherMetadata.levels[i]);
-      }
+  // Add the missing root tiles of a CesiumJS friendly tileset, which do not widen the bounds
+  void addRootTiles(const Grid &grid) {
+    if (!mFixedBounds) {
+      mBounds = bounds(grid);
+      mFixedBounds = true;
+    }
+    availability.add(TileCoordinate(0, 0, 0));
+    availability.add(TileCoordinate(0, 1, 0));
+  }
 
-      bounds.setMinX(std::min(bounds.getMinX(), otherBounds.getMinX()));
-      bounds.setMinY(std::min(bounds.getMinY(), otherBounds.getMinY()));
-      bounds.setMaxX(std::max(bounds.getMaxX(), otherBounds.getMaxX()));
-      bounds.setMaxY(std::max(bounds.getMaxY(), otherBounds.getMaxY()));
+  // Get the bounding box covered by the Terrain
+  CRSBounds bounds(const Grid &grid) const {
+    if (mFixedBounds) return mBounds;
+
+    CRSBounds bounds;
+    bool empty = true;
+
+    for (i_zoom zoom = 0; zoom < availability.levelCount(); zoom++) {
+      const std::vector<TileBounds> rectangles = availability.rectangles(zoom);
+
+      for (size_t i = 0; i < rectangles.size(); i++) {
+        const TileBounds &rect = rectangles[i];
+        CRSBounds lowerLeft = grid.tileBounds(TileCoordinate(zoom, rect.getMinX(), rect.getMinY())),
+          upperRight = grid.tileBounds(TileCoordinate(zoom, rect.getMaxX(), rect.getMaxY()));
+
+        if (empty) {
+          bounds = CRSBounds(lowerLeft.getMinX(), lowerLeft.getMinY(), upperRight.getMaxX(), upperRight.getMaxY());
+          empty = false;
+        }
+        else {
+          bounds = CRSBounds(std::min(bounds.getMinX(), lowerLeft.getMinX()),
+                             std::min(bounds.getMinY(), lowerLeft.getMinY()),
+                             std::max(bounds.getMaxX(), upperRight.getMaxX()),
+                             std::max(bounds.getMaxY(), upperRight.getMaxY()));
+        }
+      }
     }
+    return bounds;
   }
 
   /// Output the layer.json metadata file
   /// http://help.agi.com/TerrainServer/RESTAPIGuide.html
   /// Example:
   /// https://assets.agi.com/stk-terrain/v1/tilesets/world/tiles/layer.json
-  void writeJsonFile(const std::string &filename, const std::string &datasetName, const std::string &outputFormat = "Terrain", const std::string &profile = "geodetic", bool writeVertexNormals = false) const {
+  void writeJsonFile(const std::string &filename, const Grid &grid, const std::string &datasetName, const std::string &outputFormat = "Terrain", const std::string &profile = "geodetic", bool writeVertexNormals = false, bool writeWaterMask = false, int availabilityLevels = 0) const {
     FILE *fp = fopen(filename.c_str(), "w");
 
     if (fp == NULL) {
@@ -533,15 +765,27 @@ public:
     else if (strcmp(outputFormat.c_str(), "Mesh") == 0) {
       fprintf(fp, "  \"format\": \"quantized-mesh-1.0\",\n");
     }
+    else if (isImageFormat(outputFormat.c_str())) {
+      fprintf(fp, "  \"format\": \"png\",\n");
+      fprintf(fp, "  \"encoding\": \"%s\",\n", strcmp(outputFormat.c_str(), "Terrarium") == 0 ? "terrarium" : "mapbox");
+    }
     else {
       fprintf(fp, "  \"format\": \"GDAL\",\n");
     }
     fprintf(fp, "  \"attribution\": \"\",\n");
     fprintf(fp, "  \"schema\": \"tms\",\n");
-    if (writeVertexNormals) {
-      fprintf(fp, "  \"extensions\": [ \"octvertexnormals\" ],\n");
+    std::vector<std::string> extensions;
+    if (writeVertexNormals) extensions.push_back("octvertexnormals");
+    if (writeWaterMask) extensions.push_back("watermask");
+    if (availabilityLevels > 0) extensions.push_back("metadata");
+    if (extensions.size() > 0) {
+      fprintf(fp, "  \"extensions\": [ ");
+      for (size_t i = 0; i < extensions.size(); i++) {
+        fprintf(fp, i > 0 ? ", \"%s\"" : "\"%s\"", extensions[i].c_str());
+      }
+      fprintf(fp, " ],\n");
     }
-    fprintf(fp, "  \"tiles\": [ \"{z}/{x}/{y}.terrain?v={version}\" ],\n");
+    fprintf(fp, "  \"tiles\": [ \"{z}/{x}/{y}.%s?v={version}\" ],\n", isImageFormat(outputFormat.c_str()) ? "png" : "terrain");
 
     if (strcmp(profile.c_str(), "geodetic") == 0) {
       fprintf(fp, "  \"projection\": \"EPSG:4326\",\n");
@@ -549,27 +793,38 @@ public:
     else {
       fprintf(fp, "  \"projection\": \"EPSG:3857\",\n");
     }
+    const CRSBounds bounds = this->bounds(grid);
     fprintf(fp, "  \"bounds\": [ %.2f, %.2f, %.2f, %.2f ],\n",
       bounds.getMinX(),
       bounds.getMinY(),
       bounds.getMaxX(),
       bounds.getMaxY());
 
+    // With the metadata extension the tiles list the availability of deeper levels
+    size_t levelCount = availability.levelCount();
+    if (availabilityLevels > 0) {
+      levelCount = std::min(levelCount, (size_t)availabilityLevels + 1);
+      fprintf(fp, "  \"metadataAvailability\": %i,\n", availabilityLevels);
+    }
+
     fprintf(fp, "  \"available\": [\n");
-    for (size_t i = 0, icount = levels.size(); i < icount; i++) {
-      const LevelInfo &level = levels[i];
+    for (size_t i = 0, icount = levelCount; i < icount; i++) {
+      const std::vector<TileBounds> rectangles = availability.rectangles(i);
 
       if (i > 0)
         fprintf(fp, "   ,[ ");
       else
         fprintf(fp, "    [ ");
 
-      if (level.finalX >= level.startX) {
-        fprintf(fp, "{ \"startX\": %li, \"startY\": %li, \"endX\": %li, \"endY\": %li }",
-          level.startX,
-          level.startY,
-          level.finalX,
-          level.finalY);
+      for (size_t j = 0; j < rectangles.size(); j++) {
+        const TileBounds &rect = rectangles[j];
+
+        fprintf(fp, "%s{ \"startX\": %u, \"startY\": %u, \"endX\": %u, \"endY\": %u }",
+          j > 0 ? ", " : "",
+          rect.getMinX(),
+          rect.getMinY(),
+          rect.getMaxX(),
+          rect.getMaxY());
       }
       fprintf(fp, " ]\n");
     }
@@ -578,6 +833,11 @@ public:
     fprintf(fp, "}\n");
     fclose(fp);
   }
+
+private:
+  // The bounds of the iterated tiles, fixed before the root tiles are added
+  CRSBounds mBounds;
+  bool mFixedBounds;
 };
 
 /// Create an empty root temporary elevation file (GTiff)
@@ -645,9 +905,44 @@ createEmptyRootElevationFile(std::string &fileName, const Grid &grid, const Tile
   return fileName;
 }
 
-/// Output GDAL tiles represented by a tiler to a directory
-static void
-buildGDAL(std::shared_ptr<GDALSerializer> &serializer, const RasterTiler &tiler, TerrainBuild *command, std::shared_ptr<TerrainMetadata> &metadata) {
+/**
+ * Should a tile be skipped?
+ *
+ * Tiles of a mosaic are skipped beyond the maximum zoom level of the sources
+ * in their region.  With a coverage index, tiles without data are skipped if
+ * requested and so are the tiles below a flat tile, as that tile advertises no
+ * children.  Only the ancestors down to the end zoom level are considered
+ * since no tiles are created above it.
+ */
+static bool
+skipTile(const GDALTiler &tiler, const TerrainBuild *command, const TileCoordinate &coord, i_zoom endZoom) {
+  const SourceMosaic *mosaic = tiler.tilerOptions().mosaic.get();
+  const CoverageIndex *coverage = tiler.tilerOptions().coverage.get();
+
+  if (mosaic && coord.zoom > mosaic->maxZoom(tiler.grid().tileBounds(coord))) {
+    return true;
+  }
+
+  if (coverage == NULL) {
+    return false;
+  }
+  if (command->skipEmpty && !coverage->hasData(coord)) {
+    return true;
+  }
+
+  for (i_zoom zoom = endZoom; zoom < coord.zoom; zoom++) {
+    const i_zoom shift = coord.zoom - zoom;
+
+    if (tiler.isFlat(TileCoordinate(zoom, coord.x >> shift, coord.y >> shift))) {
+      return true;
+    }
+  }
+  return false;
+}
+
+/// Get the GDAL driver of the output format
+static GDALDriver *
+getOutputDriver(const TerrainBuild *command) {
   GDALDriver *poDriver = GetGDALDriverManager()->GetDriverByName(command->outputFormat);
 
   if (poDriver == NULL) {
@@ -657,60 +952,202 @@ buildGDAL(std::shared_ptr<GDALSerializer> &serializer, const RasterTiler &tiler,
   if (poDriver->pfnCreateCopy == NULL) {
     throw CTBException("The GDAL driver must be write enabled, specifically supporting 'CreateCopy'");
   }
+  return poDriver;
+}
+
+/// Create the in-memory encoder of GDAL tiles, or none if the driver can only write files or writes sidecar files
+static std::unique_ptr<GDALTileEncoder>
+createGDALEncoder(GDALDriver *poDriver, const TerrainBuild *command) {
+  return std::unique_ptr<GDALTileEncoder>(GDALTileEncoder::canEncode(poDriver, command->creationOptions)
+                                          ? new GDALTileEncoder(poDriver, command->creationOptions)
+                                          : NULL);
+}
+
+/**
+ * Serialize a GDAL tile
+ *
+ * The tile is encoded in memory and stored as an image when the driver
+ * allows, otherwise the driver creates the tile file itself.
+ */
+static void
+serializeGDALTile(const GDALTile *tile, GDALDriver *poDriver, const char *extension, GDALTileEncoder *encoder, TerrainSerialize &serializer, TerrainBuild *command) {
+  if (encoder) {
+    encoder->encode(*tile);
+    serializer.imageSerializer->serializeImage(*tile, encoder->data(), encoder->size(), extension);
+  } else {
+    serializer.gdalSerializer->serializeTile(tile, poDriver, extension, command->creationOptions);
+  }
+}
 
+/// Output GDAL tiles represented by a tiler to a directory
+static void
+buildGDAL(TerrainSerialize &serializer, const RasterTiler &tiler, TerrainBuild *command, std::shared_ptr<TerrainMetadata> &metadata, TilingJob &job) {
+  GDALDriver *poDriver = getOutputDriver(command);
   const char *extension = poDriver->GetMetadataItem(GDAL_DMD_EXTENSION);
-  const string dirname = string(command->outputDir) + osDirSep;
+  const std::unique_ptr<GDALTileEncoder> encoder = createGDALEncoder(poDriver, command);
   i_zoom startZoom = (command->startZoom < 0) ? tiler.maxZoomLevel() : command->startZoom,
     endZoom = (command->endZoom < 0) ? 0 : command->endZoom;
 
   RasterIterator iter(tiler, startZoom, endZoom);
-  int currentIndex = incrementIterator(iter, 0);
-  setIteratorSize(iter);
+  int currentIndex = incrementIterator(iter, 0, job);
+  job.setSize(iter.getSize());
 
-  while (!iter.exhausted()) {
+  while (!iter.exhausted() && !job.isCancelled()) {
     const TileCoordinate *coordinate = iter.GridIterator::operator*();
-    if (metadata) metadata->add(tiler.grid(), coordinate);
 
-    if (serializer->mustSerializeCoordinate(coordinate)) {
+    if (skipTile(tiler, command, *coordinate, endZoom)) {
+      currentIndex = incrementIterator(iter, currentIndex, job);
+      showProgress(currentIndex, job.size());
+      continue;
+    }
+    if (metadata) metadata->add(coordinate);
+
+    if (serializer.imageSerializer->mustSerializeCoordinate(coordinate)) {
       GDALTile *tile = *iter;
-      serializer->serializeTile(tile, poDriver, extension, command->creationOptions);
+      serializeGDALTile(tile, poDriver, extension, encoder.get(), serializer, command);
       delete tile;
     }
 
-    currentIndex = incrementIterator(iter, currentIndex);
-    showProgress(currentIndex);
+    currentIndex = incrementIterator(iter, currentIndex, job);
+    showProgress(currentIndex, job.size());
+  }
+}
+
+/// Create the readers of the heights of terrain and mesh tiles, returning the one to read from
+static GDALDatasetReader *
+createReaders(const TerrainTiler &tiler, TerrainBuild *command, std::vector<std::unique_ptr<GDALDatasetReader>> &readers) {
+  if (command->mosaic) {
+    readers.emplace_back(new GDALDatasetReaderMosaic(tiler, *command->mosaic));
+  } else {
+    readers.emplace_back(new GDALDatasetReaderAligned(tiler));
+  }
+
+  // Fill the nodata holes of the heights read
+  if (command->fillDistance > 0) {
+    readers.emplace_back(new GDALDatasetReaderFilled(tiler, *readers.back(), command->fillDistance));
   }
+  return readers.back().get();
 }
 
 /// Output terrain tiles represented by a tiler to a directory
 static void
-buildTerrain(std::shared_ptr<TerrainSerializer> &serializer, const TerrainTiler &tiler, TerrainBuild *command, std::shared_ptr<TerrainMetadata> &metadata) {
+buildTerrain(std::shared_ptr<TerrainSerializer> &serializer, const TerrainTiler &tiler, TerrainBuild *command, std::shared_ptr<TerrainMetadata> &metadata, TilingJob &job) {
   i_zoom startZoom = (command->startZoom < 0) ? tiler.maxZoomLevel() : command->startZoom,
     endZoom = (command->endZoom < 0) ? 0 : command->endZoom;
 
   TerrainIterator iter(tiler, startZoom, endZoom);
-  int currentIndex = incrementIterator(iter, 0);
-  setIteratorSize(iter);
-  GDALDatasetReaderWithOverviews reader(tiler);
-
-  while (!iter.exhausted()) {
+  int currentIndex = incrementIterator(iter, 0, job);
+  job.setSize(iter.getSize());
+  std::vector<std::unique_ptr<GDALDatasetReader>> readers;
+  GDALDatasetReader *reader = createReaders(tiler, command, readers);
+  TileArena arena;              // the tile and buffers reused by this thread
+  while (!iter.exhausted() && !job.isCancelled()) {
     const TileCoordinate *coordinate = iter.GridIterator::operator*();
-    if (metadata) metadata->add(tiler.grid(), coordinate);
+
+    if (skipTile(tiler, command, *coordinate, endZoom)) {
+      currentIndex = incrementIterator(iter, currentIndex, job);
+      showProgress(currentIndex, job.size());
+      continue;
+    }
+    if (metadata) metadata->add(coordinate);
 
     if (serializer->mustSerializeCoordinate(coordinate)) {
-      TerrainTile *tile = iter.operator*(&reader);
+      TerrainTile *tile = tiler.createTile(tiler.dataset(), *coordinate, reader, arena);
       serializer->serializeTile(tile);
-      delete tile;
     }
 
-    currentIndex = incrementIterator(iter, currentIndex);
-    showProgress(currentIndex);
+    currentIndex = incrementIterator(iter, currentIndex, job);
+    showProgress(currentIndex, job.size());
+  }
+}
+
+/// Create a PNG encoder of the heights in the output format
+static std::unique_ptr<PngHeightEncoder>
+createImageEncoder(const TerrainBuild *command) {
+  const PngHeightEncoder::Encoding encoding = (strcmp(command->outputFormat, "Terrarium") == 0)
+    ? PngHeightEncoder::Terrarium
+    : PngHeightEncoder::TerrainRGB;
+
+  return std::unique_ptr<PngHeightEncoder>(new PngHeightEncoder(encoding, command->pngFilter, command->pngCompression));
+}
+
+/**
+ * Output elevation images represented by a tiler to a directory
+ *
+ * The heights are sampled at the pixel centres of each image by an
+ * `ImageTiler` and encoded as PNG images in memory, without going through a
+ * GDAL driver.
+ */
+static void
+buildImage(std::shared_ptr<ImageSerializer> &serializer, const TerrainTiler &tiler, TerrainBuild *command, std::shared_ptr<TerrainMetadata> &metadata, TilingJob &job) {
+  i_zoom startZoom = (command->startZoom < 0) ? tiler.maxZoomLevel() : command->startZoom,
+    endZoom = (command->endZoom < 0) ? 0 : command->endZoom;
+
+  TerrainIterator iter(tiler, startZoom, endZoom);
+  int currentIndex = incrementIterator(iter, 0, job);
+  job.setSize(iter.getSize());
+  std::vector<std::unique_ptr<GDALDatasetReader>> readers;
+  GDALDatasetReader *reader = createReaders(tiler, command, readers);
+  TileArena arena;              // the buffers reused by this thread
+  const std::unique_ptr<PngHeightEncoder> encoder = createImageEncoder(command);
+  while (!iter.exhausted() && !job.isCancelled()) {
+    const TileCoordinate *coordinate = iter.GridIterator::operator*();
+
+    if (skipTile(tiler, command, *coordinate, endZoom)) {
+      currentIndex = incrementIterator(iter, currentIndex, job);
+      showProgress(currentIndex, job.size());
+      continue;
+    }
+    if (metadata) metadata->add(coordinate);
+
+    if (serializer->mustSerializeCoordinate(coordinate)) {
+      tiler.readTileHeights(tiler.dataset(), *coordinate, reader, arena);
+      tiler.encodeHeights(arena, *encoder);
+      serializer->serializeImage(*coordinate, encoder->data(), encoder->size(), "png");
+    }
+
+    currentIndex = incrementIterator(iter, currentIndex, job);
+    showProgress(currentIndex, job.size());
+  }
+}
+
+/// Create and serialize the mesh and the terrain tile of a coordinate from the heights read into an arena
+static void
+encodeMeshTiles(const MeshTiler &tiler, const TileCoordinate &coordinate, TileArena &arena, bool createMesh, bool createTerrain, std::shared_ptr<MeshSerializer> &serializer, const std::shared_ptr<TerrainSerializer> &terrainSerializer, TileAvailabilityRecorder *recorder, i_zoom availabilityLevels, bool writeVertexNormals) {
+  if (createMesh) {
+    MeshTile *tile = tiler.createMesh(coordinate, arena);
+    if (availabilityLevels > 0 && (coordinate.zoom % availabilityLevels) == 0) {
+      tile->setMetadata(recorder->metadataJson(coordinate, availabilityLevels));
+    }
+    serializer->serializeTile(tile, writeVertexNormals);
+  }
+  if (createTerrain) {
+    TerrainTile *tile = tiler.createTile(coordinate, arena);
+    terrainSerializer->serializeTile(tile);
+  }
+}
+
+/**
+ * Create and serialize the mesh of a coordinate
+ *
+ * Given a terrain serializer, the terrain tile of the coordinate is also
+ * created from the heights read for the mesh, which requires a tile size of
+ * 65.  The tiles of both formats then share the zoom levels of the mesh tiler.
+ */
+static void
+createMeshTiles(const MeshTiler &tiler, const TileCoordinate &coordinate, GDALDatasetReader *reader, TileArena &arena, std::shared_ptr<MeshSerializer> &serializer, const std::shared_ptr<TerrainSerializer> &terrainSerializer, TileAvailabilityRecorder *recorder, i_zoom availabilityLevels, bool writeVertexNormals) {
+  const bool createMesh = serializer->mustSerializeCoordinate(&coordinate),
+    createTerrain = terrainSerializer && terrainSerializer->mustSerializeCoordinate(&coordinate);
+
+  if (createMesh || createTerrain) {
+    tiler.readTileHeights(tiler.dataset(), coordinate, reader, arena);
   }
+  encodeMeshTiles(tiler, coordinate, arena, createMesh, createTerrain, serializer, terrainSerializer, recorder, availabilityLevels, writeVertexNormals);
 }
 
-/// Output mesh tiles represented by a tiler to a directory
+/// Output mesh tiles, and terrain tiles given a terrain serializer, represented by a tiler to a directory
 static void
-buildMesh(std::shared_ptr<MeshSerializer> &serializer, const MeshTiler &tiler, TerrainBuild *command, std::shared_ptr<TerrainMetadata> &metadata, bool writeVertexNormals = false) {
+buildMesh(std::shared_ptr<MeshSerializer> &serializer, const MeshTiler &tiler, TerrainBuild *command, std::shared_ptr<TerrainMetadata> &metadata, TilingJob &job, bool writeVertexNormals = false, const std::shared_ptr<TerrainSerializer> &terrainSerializer = nullptr) {
   i_zoom startZoom = (command->startZoom < 0) ? tiler.maxZoomLevel() : command->startZoom,
     endZoom = (command->endZoom < 0) ? 0 : command->endZoom;
 
@@ -737,99 +1174,466 @@ buildMesh(std::shared_ptr<MeshSerializer> &serializer, const MeshTiler &tiler, T
   #endif
 
   MeshIterator iter(tiler, startZoom, endZoom);
-  int currentIndex = incrementIterator(iter, 0);
-  setIteratorSize(iter);
-  GDALDatasetReaderWithOverviews reader(tiler);
-
-  while (!iter.exhausted()) {
+  int currentIndex = incrementIterator(iter, 0, job);
+  job.setSize(iter.getSize());
+  std::vector<std::unique_ptr<GDALDatasetReader>> readers;
+  GDALDatasetReader *reader = createReaders(tiler, command, readers);
+  TileArena arena;              // the tile and buffers reused by this thread
+
+  const i_zoom availabilityLevels = command->availabilityLevels;
+  TileAvailabilityRecorder *recorder = command->availabilityRecorder.get();
+  if (availabilityLevels > 0) recorder->setLevels(tiler, startZoom, endZoom);
+  while (!iter.exhausted() && !job.isCancelled()) {
     const TileCoordinate *coordinate = iter.GridIterator::operator*();
-    if (metadata) metadata->add(tiler.grid(), coordinate);
 
-    if (serializer->mustSerializeCoordinate(coordinate)) {
-      MeshTile *tile = iter.operator*(&reader);
-      serializer->serializeTile(tile, writeVertexNormals);
-      delete tile;
+    if (skipTile(tiler, command, *coordinate, endZoom)) {
+      if (availabilityLevels > 0) recorder->add(*coordinate, false);
+      currentIndex = incrementIterator(iter, currentIndex, job);
+      showProgress(currentIndex, job.size());
+      continue;
     }
+    if (metadata) metadata->add(coordinate);
+    if (availabilityLevels > 0) recorder->add(*coordinate);
 
-    currentIndex = incrementIterator(iter, currentIndex);
-    showProgress(currentIndex);
-  }
-}
-
-static void
-buildMetadata(const RasterTiler &tiler, TerrainBuild *command, std::shared_ptr<TerrainMetadata> &metadata) {
-  const string dirname = string(command->outputDir) + osDirSep;
-  i_zoom startZoom = (command->startZoom < 0) ? tiler.maxZoomLevel() : command->startZoom,
-    endZoom = (command->endZoom < 0) ? 0 : command->endZoom;
-
-  const std::string filename = concat(dirname, "layer.json"); 
-
-  RasterIterator iter(tiler, startZoom, endZoom);
-  int currentIndex = incrementIterator(iter, 0);
-  setIteratorSize(iter);
-
-  while (!iter.exhausted()) {
-    const TileCoordinate *coordinate = iter.GridIterator::operator*();
-    if (metadata) metadata->add(tiler.grid(), coordinate);
+    createMeshTiles(tiler, *coordinate, reader, arena, serializer, terrainSerializer, recorder, availabilityLevels, writeVertexNormals);
 
-    currentIndex = incrementIterator(iter, currentIndex);
-    showProgress(currentIndex, filename);
+    currentIndex = incrementIterator(iter, currentIndex, job);
+    showProgress(currentIndex, job.size());
   }
 }
 
+/// The tiles read ahead for each worker encoding a streamed zoom level
+static const size_t STREAMED_TILES_PER_WORKER = 4;
+
 /**
- * Perform a tile building operation
+ * The tiles of a streamed zoom level, read on one thread and encoded on others
  *
- * This function is designed to be run in a separate thread.
+ * The reading thread fills the arena of a tile with its heights and queues
+ * the tile, and an encoding worker serializes it and hands the tile back.
+ * There are only a few tiles, so the reading waits for the workers rather
+ * than running ahead of them.
  */
-static int
-runTiler(const char *inputFilename, TerrainBuild *command, const Grid &grid, std::shared_ptr<TerrainMetadata> &metadata, std::shared_ptr<TerrainSerialize> &serializer) {
+class StreamedTiles {
+public:
+  /// A tile read from the source, with the formats to create from it
+  struct Tile {
+    TileCoordinate coordinate;
+    bool createMesh = false;
+    bool createTerrain = false;
+    TileArena arena;
+  };
 
-  char **optionStrArray = NULL;
+  StreamedTiles(size_t count):
+    tiles(count)
+  {
+    for (Tile &tile : tiles) idle.push_back(&tile);
+  }
 
-  // Quick check to see if this is a TIFF file
-  if (string(inputFilename).find(".tif") != std::string::npos) {
-	  optionStrArray = CSLSetNameValue(optionStrArray, "SPARSE_OK", "TRUE");
-  } 
+  /// Take a tile to read, `NULL` once cancelled
+  Tile *
+  acquire() {
+    unique_lock<std::mutex> lock(mutex);
 
-  GDALDataset  *poDataset = (GDALDataset *) GDALOpenEx(inputFilename, GA_ReadOnly, nullptr, optionStrArray, nullptr);
-  if (poDataset == NULL) {
-    cerr << "Error: could not open GDAL dataset" << endl;
-    return 1;
+    changed.wait(lock, [&]() { return cancelled || !idle.empty(); });
+    if (cancelled) return NULL;
+
+    Tile *tile = idle.back();
+    idle.pop_back();
+    return tile;
   }
 
-  // Metadata of only this thread, it will be joined to global later
-  std::shared_ptr<TerrainMetadata>threadMetadata = metadata ? std::shared_ptr<TerrainMetadata>(new TerrainMetadata()) : std::shared_ptr<TerrainMetadata>(NULL);
-  
-  try {
+  /// Hand back a tile that has been read, queueing it to be encoded if it has to be
+  void
+  release(Tile *tile, bool encode) {
+    lock_guard<std::mutex> lock(mutex);
 
-    if (command->metadata) {
-      const RasterTiler tiler(poDataset, grid, command->tilerOptions);
-      buildMetadata(tiler, command, threadMetadata);
-    } else if (strcmp(command->outputFormat, "Terrain") == 0) {
+    if (encode) {
+      queued.push_back(tile);
+    } else {
+      idle.push_back(tile);
+    }
+    changed.notify_all();
+  }
 
-      serializer->terrainSerializer->startSerialization();
-      const TerrainTiler tiler(poDataset, grid);
-      buildTerrain(serializer->terrainSerializer, tiler, command, threadMetadata);
-      serializer->terrainSerializer->endSerialization();
+  /// Take the next tile to encode, `NULL` once all the tiles are encoded or cancelled
+  Tile *
+  next() {
+    unique_lock<std::mutex> lock(mutex);
 
-    } else if (strcmp(command->outputFormat, "Mesh") == 0) {
-      
-      serializer->meshSerializer->startSerialization();
-      const MeshTiler tiler(poDataset, grid, command->tilerOptions, command->meshQualityFactor);
-      buildMesh(serializer->meshSerializer, tiler, command, threadMetadata, command->vertexNormals);
-      serializer->meshSerializer->endSerialization();
+    changed.wait(lock, [&]() { return cancelled || finished || !queued.empty(); });
+    if (cancelled || queued.empty()) return NULL;
 
-    } else {                    // it's a GDAL format
+    Tile *tile = queued.front();
+    queued.pop_front();
+    return tile;
+  }
 
-      serializer->gdalSerializer->startSerialization();
-      const RasterTiler tiler(poDataset, grid, command->tilerOptions);
-      buildGDAL(serializer->gdalSerializer, tiler, command, threadMetadata);
-      serializer->gdalSerializer->endSerialization();
+  /// Hand back a tile that has been encoded
+  void
+  done(Tile *tile) {
+    lock_guard<std::mutex> lock(mutex);
+
+    idle.push_back(tile);
+    changed.notify_all();
+  }
+
+  /// Signal that no more tiles will be read
+  void
+  finish() {
+    lock_guard<std::mutex> lock(mutex);
+
+    finished = true;
+    changed.notify_all();
+  }
+
+  /// Stop reading and encoding the tiles, waking the threads waiting for them
+  void
+  cancel() {
+    lock_guard<std::mutex> lock(mutex);
+
+    cancelled = true;
+    changed.notify_all();
+  }
+
+private:
+  bool finished = false, cancelled = false;
+  std::mutex mutex;
+  std::condition_variable changed;
+  std::vector<Tile> tiles;
+  std::vector<Tile *> idle;
+  std::deque<Tile *> queued;
+};
+
+/**
+ * Read the tiles of a zoom level a row at a time, from the north
+ *
+ * Each row of tiles is warped in strips by a streaming reader, so the source
+ * is read from top to bottom and the memory used is bounded by a strip.
+ * `readTile` reads the heights of a tile and returns whether it is to be
+ * encoded, which is left to the workers taking the tiles.
+ */
+template<typename T, typename F> static void
+streamZoom(const T &tiler, TerrainBuild *command, i_zoom zoom, i_zoom endZoom, std::shared_ptr<TerrainMetadata> &metadata, StreamedTiles &tiles, F readTile) {
+  const TileBounds bounds = tiler.tileBoundsForZoom(zoom);
+  GDALDatasetReaderStreaming reader(tiler, zoom);
+  const size_t size = (size_t) (bounds.getWidth() + 1) * (bounds.getHeight() + 1);
+  int currentIndex = 0;
+
+  for (i_tile y = bounds.getMaxY() + 1; y-- > bounds.getMinY(); ) {
+    for (i_tile x = bounds.getMinX(); x <= bounds.getMaxX(); x++) {
+      const TileCoordinate coordinate(zoom, x, y);
+      showProgress(++currentIndex, size);
+
+      if (skipTile(tiler, command, coordinate, endZoom)) {
+        if (command->availabilityLevels > 0) command->availabilityRecorder->add(coordinate, false);
+        continue;
+      }
+      if (metadata) metadata->add(&coordinate);
+      if (command->availabilityLevels > 0) command->availabilityRecorder->add(coordinate);
+
+      StreamedTiles::Tile *tile = tiles.acquire();
+      if (tile == NULL) return; // a worker failed
+
+      tile->coordinate = coordinate;
+      tiles.release(tile, readTile(tiler, &reader, *tile));
+    }
+  }
+}
+
+/**
+ * Encode the tiles of a streamed zoom level as they are read
+ *
+ * Each worker has its own handle on the dataset and its own tiler, as the
+ * workers of the other zoom levels do.
+ */
+static int
+encodeStreamedTiles(TerrainBuild *command, const Grid &grid, StreamedTiles &tiles, std::shared_ptr<TerrainSerialize> &serializer, TilingJob &job) {
+  GDALDataset *poDataset = (GDALDataset *) GDALOpen(command->getInputFilename(), GA_ReadOnly);
+  if (poDataset == NULL) {
+    cerr << "Error: could not open GDAL dataset" << endl;
+    job.cancel();
+    return 1;
+  }
+
+  try {
+    if (!command->hasOutputFormat("Mesh")) {
+      const TerrainTiler tiler(poDataset, grid, command->tilerOptions);
+
+      serializer->terrainSerializer->startSerialization();
+      while (StreamedTiles::Tile *tile = tiles.next()) {
+        serializer->terrainSerializer->serializeTile(tiler.createTile(tile->coordinate, tile->arena));
+        tiles.done(tile);
+      }
+      serializer->terrainSerializer->endSerialization();
+    } else {
+      const MeshTiler tiler(poDataset, grid, command->tilerOptions, command->meshQualityFactor);
+
+      // Terrain tiles requested alongside are created from the same heights
+      const std::shared_ptr<TerrainSerializer> terrainSerializer = command->hasOutputFormat("Terrain") ? serializer->terrainSerializer : nullptr;
+
+      serializer->meshSerializer->startSerialization();
+      if (terrainSerializer) terrainSerializer->startSerialization();
+      while (StreamedTiles::Tile *tile = tiles.next()) {
+        encodeMeshTiles(tiler, tile->coordinate, tile->arena, tile->createMesh, tile->createTerrain, serializer->meshSerializer, terrainSerializer, command->availabilityRecorder.get(), command->availabilityLevels, command->vertexNormals);
+        tiles.done(tile);
+      }
+      if (terrainSerializer) terrainSerializer->endSerialization();
+      serializer->meshSerializer->endSerialization();
     }
+  } catch (CTBException &e) {
+    // Only the first error is reported, not those of the workers it stopped
+    if (!job.isCancelled()) cerr << "Error: " << e.what() << endl;
+    job.cancel();               // stop the reading and the other workers
+    GDALClose(poDataset);
+    return 1;
+  }
+  GDALClose(poDataset);
+  return 0;
+}
+
+/**
+ * Stream the start zoom level of a terrain or mesh tileset
+ *
+ * The source is read on this thread while the tiles are encoded by the
+ * workers of the engine.  This sets the start zoom level of the command to
+ * the next coarser level, which is left to the regular tilers, and returns
+ * `-1` if there is none.
+ */
+static int
+streamStartZoom(TilingEngine &engine, int threadCount, TerrainBuild *command, const Grid &grid, std::shared_ptr<TerrainMetadata> &metadata, std::shared_ptr<TerrainSerialize> &serializer) {
+  GDALDataset *poDataset = (GDALDataset *) GDALOpen(command->getInputFilename(), GA_ReadOnly);
+  if (poDataset == NULL) {
+    cerr << "Error: could not open GDAL dataset" << endl;
+    return 1;
+  }
+
+  const i_zoom endZoom = (command->endZoom < 0) ? 0 : command->endZoom;
+  i_zoom zoom = 0;
 
+  StreamedTiles tiles(STREAMED_TILES_PER_WORKER * threadCount);
+  std::atomic<int> workerRetval(0);
+
+  const std::shared_ptr<TilingJob> job = engine.submit([&](TilingJob &job) {
+      const int retval = encodeStreamedTiles(command, grid, tiles, serializer, job);
+      if (retval) workerRetval = retval;
+    }, threadCount);
+  job->onCancel([&tiles]() { tiles.cancel(); });
+  if (command->availabilityRecorder) {
+    const std::shared_ptr<TileAvailabilityRecorder> recorder = command->availabilityRecorder;
+    job->onCancel([recorder]() { recorder->cancel(); });
+  }
+
+  int retval = 0;
+  try {
+    if (!command->hasOutputFormat("Mesh")) {
+      const TerrainTiler tiler(poDataset, grid, command->tilerOptions);
+      zoom = (command->startZoom < 0) ? tiler.maxZoomLevel() : command->startZoom;
+
+      streamZoom(tiler, command, zoom, endZoom, metadata, tiles,
+        [&](const TerrainTiler &tiler, GDALDatasetReader *reader, StreamedTiles::Tile &tile) {
+          if (!serializer->terrainSerializer->mustSerializeCoordinate(&tile.coordinate)) return false;
+
+          tiler.readTileHeights(tiler.dataset(), tile.coordinate, reader, tile.arena);
+          return true;
+        });
+    } else {
+      const MeshTiler tiler(poDataset, grid, command->tilerOptions, command->meshQualityFactor);
+      zoom = (command->startZoom < 0) ? tiler.maxZoomLevel() : command->startZoom;
+
+      if (command->availabilityLevels > 0) command->availabilityRecorder->setLevels(tiler, zoom, endZoom);
+
+      const std::shared_ptr<TerrainSerializer> terrainSerializer = command->hasOutputFormat("Terrain") ? serializer->terrainSerializer : nullptr;
+
+      streamZoom(tiler, command, zoom, endZoom, metadata, tiles,
+        [&](const MeshTiler &tiler, GDALDatasetReader *reader, StreamedTiles::Tile &tile) {
+          tile.createMesh = serializer->meshSerializer->mustSerializeCoordinate(&tile.coordinate);
+          tile.createTerrain = terrainSerializer && terrainSerializer->mustSerializeCoordinate(&tile.coordinate);
+          if (!tile.createMesh && !tile.createTerrain) return false;
+
+          tiler.readTileHeights(tiler.dataset(), tile.coordinate, reader, tile.arena);
+          return true;
+        });
+    }
   } catch (CTBException &e) {
     cerr << "Error: " << e.what() << endl;
+    job->cancel();              // stop the workers
+    retval = 1;
+  }
+
+  // Let the workers encode the tiles left in the queue
+  tiles.finish();
+  job->wait();
+  GDALClose(poDataset);
+
+  if (retval) {
+    return retval;
+  }
+  if (!job->error().empty()) {
+    cerr << "Error: " << job->error() << endl;
+    return 1;
+  }
+  if (workerRetval) {
+    return workerRetval;
+  }
+
+  if (zoom <= endZoom) {
+    return -1;
+  }
+  command->startZoom = zoom - 1;
+  return 0;
+}
+
+/**
+ * Build the metadata of the tileset
+ *
+ * The tiles of a zoom level cover the rectangle given by the tiler for that
+ * level, or the part of it with data when tiles without data are skipped, so
+ * the availability is recorded a level at a time rather than by iterating over
+ * every tile.  A mosaic limiting the zoom levels of its regions, or a flat
+ * tolerance pruning subtrees, makes the tiles of a level depend on their
+ * ancestors, so the tiles are then walked from the end zoom level down the
+ * children of those kept, skipping the same tiles as when they are created.
+ */
+static void
+buildMetadata(const RasterTiler &tiler, TerrainBuild *command, std::shared_ptr<TerrainMetadata> &metadata) {
+  i_zoom startZoom = (command->startZoom < 0) ? tiler.maxZoomLevel() : command->startZoom,
+    endZoom = (command->endZoom < 0) ? 0 : command->endZoom;
+
+  if (!metadata) return;
+
+  const CoverageIndex *coverage = tiler.tilerOptions().coverage.get();
+  TileAvailability &availability = metadata->availability;
+
+  if (!tiler.tilerOptions().mosaic && !(coverage && tiler.tilerOptions().flatTolerance > 0)) {
+    for (i_zoom zoom = endZoom; zoom <= startZoom; zoom++) {
+      if (coverage && command->skipEmpty) {
+        coverage->addAvailability(availability, zoom);
+      } else {
+        availability.add(zoom, tiler.tileBoundsForZoom(zoom));
+      }
+    }
+    return;
+  }
+
+  // The tiles kept at the current zoom level, in the order of a `GridIterator`
+  std::vector<TileCoordinate> tiles, children;
+  const TileBounds endBounds = tiler.tileBoundsForZoom(endZoom);
+  for (i_tile x = endBounds.getMinX(); x <= endBounds.getMaxX(); x++) {
+    for (i_tile y = endBounds.getMinY(); y <= endBounds.getMaxY(); y++) {
+      const TileCoordinate coord(endZoom, x, y);
+      if (!skipTile(tiler, command, coord, endZoom)) tiles.push_back(coord);
+    }
+  }
+
+  for (i_zoom zoom = endZoom; zoom <= startZoom; zoom++) {
+    for (const TileCoordinate &coord : tiles) {
+      availability.add(coord);
+    }
+    if (zoom == startZoom) break;
+
+    // The children of a kept tile are skipped below a flat tile, or for
+    // themselves as their ancestors are known to be kept
+    const TileBounds bounds = tiler.tileBoundsForZoom(zoom + 1);
+    children.clear();
+    for (const TileCoordinate &coord : tiles) {
+      if (tiler.isFlat(coord)) continue;
+
+      for (i_tile x = std::max(coord.x * 2, bounds.getMinX()); x <= std::min(coord.x * 2 + 1, bounds.getMaxX()); x++) {
+        for (i_tile y = std::max(coord.y * 2, bounds.getMinY()); y <= std::min(coord.y * 2 + 1, bounds.getMaxY()); y++) {
+          const TileCoordinate child(zoom + 1, x, y);
+          if (!skipTile(tiler, command, child, zoom + 1)) {
+            children.push_back(child);
+          }
+        }
+      }
+    }
+    std::sort(children.begin(), children.end(), [](const TileCoordinate &a, const TileCoordinate &b) {
+        return (a.x == b.x) ? a.y < b.y : a.x < b.x;
+      });
+    tiles.swap(children);
+  }
+}
+
+/**
+ * Perform a tile building operation
+ *
+ * This function is designed to be run by each worker of a tiling job.
+ */
+static int
+runTiler(const char *inputFilename, TerrainBuild *command, const Grid &grid, std::shared_ptr<TerrainMetadata> &metadata, std::shared_ptr<TerrainSerialize> &serializer, TilingJob &job) {
+
+  char **optionStrArray = NULL;
+
+  // Quick check to see if this is a TIFF file
+  if (string(inputFilename).find(".tif") != std::string::npos) {
+	  optionStrArray = CSLSetNameValue(optionStrArray, "SPARSE_OK", "TRUE");
+  } 
+
+  // A mosaic is tiled from a dataset covering its sources
+  GDALDataset *poDataset = NULL;
+  if (command->mosaic) {
+    try {
+      poDataset = command->mosaic->createFootprint();
+    } catch (CTBException &e) {
+      cerr << "Error: " << e.what() << endl;
+      return 1;
+    }
+  } else {
+    poDataset = (GDALDataset *) GDALOpenEx(inputFilename, GA_ReadOnly, nullptr, optionStrArray, nullptr);
+  }
+  if (poDataset == NULL) {
+    cerr << "Error: could not open GDAL dataset" << endl;
+    return 1;
+  }
+
+  // Metadata of only this thread, it will be joined to global later
+  std::shared_ptr<TerrainMetadata>threadMetadata = metadata ? std::shared_ptr<TerrainMetadata>(new TerrainMetadata()) : std::shared_ptr<TerrainMetadata>(NULL);
+  
+  try {
+
+    if (command->metadata) {
+      const RasterTiler tiler(poDataset, grid, command->tilerOptions);
+      buildMetadata(tiler, command, threadMetadata);
+    } else if (command->hasOutputFormat("Mesh")) {
+
+      // Terrain tiles requested alongside are created from the same heights
+      const std::shared_ptr<TerrainSerializer> terrainSerializer = command->hasOutputFormat("Terrain") ? serializer->terrainSerializer : nullptr;
+
+      serializer->meshSerializer->startSerialization();
+      if (terrainSerializer) terrainSerializer->startSerialization();
+      const MeshTiler tiler(poDataset, grid, command->tilerOptions, command->meshQualityFactor);
+      buildMesh(serializer->meshSerializer, tiler, command, threadMetadata, job, command->vertexNormals, terrainSerializer);
+      if (terrainSerializer) terrainSerializer->endSerialization();
+      serializer->meshSerializer->endSerialization();
+
+    } else if (isImageFormat(command->outputFormat)) {
+
+      serializer->imageSerializer->startSerialization();
+      const ImageTiler tiler(poDataset, grid, command->tilerOptions);
+      buildImage(serializer->imageSerializer, tiler, command, threadMetadata, job);
+      serializer->imageSerializer->endSerialization();
+
+    } else if (strcmp(command->outputFormat, "Terrain") == 0) {
+
+      serializer->terrainSerializer->startSerialization();
+      const TerrainTiler tiler(poDataset, grid, command->tilerOptions);
+      buildTerrain(serializer->terrainSerializer, tiler, command, threadMetadata, job);
+      serializer->terrainSerializer->endSerialization();
+
+    } else {                    // it's a GDAL format
+
+      serializer->imageSerializer->startSerialization();
+      const RasterTiler tiler(poDataset, grid, command->tilerOptions);
+      buildGDAL(*serializer, tiler, command, threadMetadata, job);
+      serializer->imageSerializer->endSerialization();
+    }
+
+  } catch (CTBException &e) {
+    // Only the first error is reported, not those of the workers it stopped
+    if (!job.isCancelled()) cerr << "Error: " << e.what() << endl;
+    job.cancel();               // stop the other workers
+    GDALClose(poDataset);
+    return 1;
   }
 
   GDALClose(poDataset);
@@ -844,16 +1648,244 @@ runTiler(const char *inputFilename, TerrainBuild *command, const Grid &grid, std
   return 0;
 }
 
+/// The tileset of one of several profiles tiled together
+struct ProfileTileset {
+  std::string profile;
+  Grid grid;
+  TilerOptions tilerOptions;    ///< The options with the coverage index of the grid
+  std::shared_ptr<TerrainSerialize> serializer;
+  std::shared_ptr<TerrainMetadata> metadata;
+};
+
+/// A row of the tiles of a profile, in the tiles of a job
+struct ProfileRow {
+  size_t tileset;               ///< The index of the tileset of the row
+  i_zoom zoom;
+  i_tile y, minX, maxX;
+  size_t first;                 ///< The index of the first tile of the row
+};
+
+/// The tiler of a profile used by a worker, with its readers and reused tile
+struct ProfileTiler {
+  std::unique_ptr<MeshTiler> meshTiler;
+  std::unique_ptr<TerrainTiler> terrainTiler;
+  std::unique_ptr<RasterTiler> rasterTiler;
+  const GDALTiler *tiler;       ///< Whichever of the tilers is set
+
+  std::vector<std::unique_ptr<GDALDatasetReader>> readers;
+  GDALDatasetReader *reader;
+  TileArena arena;
+  std::unique_ptr<PngHeightEncoder> encoder;  ///< The encoder of elevation images
+
+  /// The metadata of only this worker
+  std::shared_ptr<TerrainMetadata> metadata;
+};
+
+/// Create the tiler of the output format for a profile
+static std::unique_ptr<ProfileTiler>
+createProfileTiler(GDALDataset *poDataset, const ProfileTileset &tileset, TerrainBuild *command) {
+  std::unique_ptr<ProfileTiler> profile(new ProfileTiler());
+  profile->reader = NULL;
+
+  if (command->hasOutputFormat("Mesh")) {
+    profile->meshTiler.reset(new MeshTiler(poDataset, tileset.grid, tileset.tilerOptions, command->meshQualityFactor));
+    profile->tiler = profile->meshTiler.get();
+    profile->reader = createReaders(*profile->meshTiler, command, profile->readers);
+  } else if (strcmp(command->outputFormat, "Terrain") == 0 || isImageFormat(command->outputFormat)) {
+    profile->terrainTiler.reset(isImageFormat(command->outputFormat)
+                                ? new ImageTiler(poDataset, tileset.grid, tileset.tilerOptions)
+                                : new TerrainTiler(poDataset, tileset.grid, tileset.tilerOptions));
+    profile->tiler = profile->terrainTiler.get();
+    profile->reader = createReaders(*profile->terrainTiler, command, profile->readers);
+    if (isImageFormat(command->outputFormat)) profile->encoder = createImageEncoder(command);
+  } else {
+    profile->rasterTiler.reset(new RasterTiler(poDataset, tileset.grid, tileset.tilerOptions));
+    profile->tiler = profile->rasterTiler.get();
+  }
+  return profile;
+}
+
+/**
+ * Schedule the tiles of several profiles, returning their number
+ *
+ * The rows of tiles of the profiles are interleaved a zoom level at a time
+ * counting from the start zoom level of each profile, which has about the
+ * resolution of the source, and from the north by their position in the
+ * extent of the dataset.  The workers of a job therefore read the same part
+ * of the source for every profile at about the same time.
+ */
+static size_t
+scheduleProfiles(GDALDataset *poDataset, const std::vector<ProfileTileset> &tilesets, TerrainBuild *command, std::vector<ProfileRow> &rows) {
+  struct ScheduledRow {
+    ProfileRow row;
+    i_zoom level;               ///< The number of zoom levels from the start
+    double north;               ///< The position of the row from the north
+  };
+  std::vector<ScheduledRow> scheduled;
+
+  for (size_t i = 0; i < tilesets.size(); i++) {
+    const std::unique_ptr<ProfileTiler> profile = createProfileTiler(poDataset, tilesets[i], command);
+    const i_zoom startZoom = (command->startZoom < 0) ? profile->tiler->maxZoomLevel() : command->startZoom,
+      endZoom = (command->endZoom < 0) ? 0 : command->endZoom;
+
+    for (i_zoom zoom = startZoom + 1; zoom-- > endZoom; ) {
+      const TileBounds bounds = profile->tiler->tileBoundsForZoom(zoom);
+      const i_tile height = bounds.getHeight() + 1;
+
+      for (i_tile y = bounds.getMaxY() + 1; y-- > bounds.getMinY(); ) {
+        const ProfileRow row = { i, zoom, y, bounds.getMinX(), bounds.getMaxX(), 0 };
+        const ScheduledRow entry = { row, (i_zoom) (startZoom - zoom), (bounds.getMaxY() - y + 0.5) / height };
+        scheduled.push_back(entry);
+      }
+    }
+  }
+
+  std::stable_sort(scheduled.begin(), scheduled.end(), [](const ScheduledRow &a, const ScheduledRow &b) {
+      return (a.level != b.level) ? a.level < b.level : a.north < b.north;
+    });
+
+  size_t size = 0;
+  rows.clear();
+  for (ScheduledRow &entry : scheduled) {
+    entry.row.first = size;
+    size += entry.row.maxX - entry.row.minX + 1;
+    rows.push_back(entry.row);
+  }
+  return size;
+}
+
+/**
+ * Perform the tile building operation of several profiles
+ *
+ * This function is designed to be run by each worker of a tiling job.  The
+ * tilers of all the profiles read the source through the dataset handle of
+ * the worker, so they share the blocks it caches, and the tiles of the
+ * profiles are claimed in the order scheduled by `scheduleProfiles`.
+ */
+static int
+runProfiles(const char *inputFilename, TerrainBuild *command, std::vector<ProfileTileset> &tilesets, const std::vector<ProfileRow> &rows, size_t size, TilingJob &job) {
+  GDALDataset *poDataset = (GDALDataset *) GDALOpen(inputFilename, GA_ReadOnly);
+  if (poDataset == NULL) {
+    cerr << "Error: could not open GDAL dataset" << endl;
+    return 1;
+  }
+
+  std::vector<std::unique_ptr<ProfileTiler>> profiles;
+  int retval = 0;
+  try {
+    for (const ProfileTileset &tileset : tilesets) {
+      profiles.push_back(createProfileTiler(poDataset, tileset, command));
+      if (tileset.metadata) profiles.back()->metadata = std::make_shared<TerrainMetadata>();
+    }
+
+    if (command->metadata) {
+      for (size_t i = 0; i < tilesets.size(); i++) {
+        const RasterTiler tiler(poDataset, tilesets[i].grid, tilesets[i].tilerOptions);
+        buildMetadata(tiler, command, profiles[i]->metadata);
+      }
+    } else {
+      const bool isMesh = command->hasOutputFormat("Mesh"),
+        isTerrain = command->hasOutputFormat("Terrain"),
+        isImage = isImageFormat(command->outputFormat);
+      GDALDriver *poDriver = (isMesh || isTerrain || isImage) ? NULL : getOutputDriver(command);
+      const char *extension = poDriver ? poDriver->GetMetadataItem(GDAL_DMD_EXTENSION) : NULL;
+      const std::unique_ptr<GDALTileEncoder> encoder = poDriver ? createGDALEncoder(poDriver, command) : nullptr;
+      const i_zoom endZoom = (command->endZoom < 0) ? 0 : command->endZoom;
+
+      for (ProfileTileset &tileset : tilesets) {
+        if (isMesh) tileset.serializer->meshSerializer->startSerialization();
+        if (isTerrain) tileset.serializer->terrainSerializer->startSerialization();
+        if (isImage || poDriver) tileset.serializer->imageSerializer->startSerialization();
+      }
+
+      job.setSize(size);
+      for (size_t index = job.claim(); index < size && !job.isCancelled(); index = job.claim()) {
+        const ProfileRow &row = *(std::upper_bound(rows.begin(), rows.end(), index, [](size_t index, const ProfileRow &row) {
+            return index < row.first;
+          }) - 1);
+        const TileCoordinate coordinate(row.zoom, row.minX + (i_tile) (index - row.first), row.y);
+        ProfileTiler &profile = *profiles[row.tileset];
+        TerrainSerialize &serializer = *tilesets[row.tileset].serializer;
+
+        if (!skipTile(*profile.tiler, command, coordinate, endZoom)) {
+          if (profile.metadata) profile.metadata->add(&coordinate);
+
+          if (profile.meshTiler) {
+            createMeshTiles(*profile.meshTiler, coordinate, profile.reader, profile.arena, serializer.meshSerializer, isTerrain ? serializer.terrainSerializer : nullptr, NULL, 0, command->vertexNormals);
+          } else if (profile.encoder) {
+            if (serializer.imageSerializer->mustSerializeCoordinate(&coordinate)) {
+              profile.terrainTiler->readTileHeights(poDataset, coordinate, profile.reader, profile.arena);
+              profile.terrainTiler->encodeHeights(profile.arena, *profile.encoder);
+              serializer.imageSerializer->serializeImage(coordinate, profile.encoder->data(), profile.encoder->size(), "png");
+            }
+          } else if (profile.terrainTiler) {
+            if (serializer.terrainSerializer->mustSerializeCoordinate(&coordinate)) {
+              TerrainTile *tile = profile.terrainTiler->createTile(poDataset, coordinate, profile.reader, profile.arena);
+              serializer.terrainSerializer->serializeTile(tile);
+            }
+          } else if (serializer.imageSerializer->mustSerializeCoordinate(&coordinate)) {
+            GDALTile *tile = profile.rasterTiler->createTile(poDataset, coordinate);
+            serializeGDALTile(tile, poDriver, extension, encoder.get(), serializer, command);
+            delete tile;
+          }
+        }
+        showProgress(index + 1, size);
+      }
+
+      for (ProfileTileset &tileset : tilesets) {
+        if (isMesh) tileset.serializer->meshSerializer->endSerialization();
+        if (isTerrain) tileset.serializer->terrainSerializer->endSerialization();
+        if (isImage || poDriver) tileset.serializer->imageSerializer->endSerialization();
+      }
+    }
+  } catch (CTBException &e) {
+    // Only the first error is reported, not those of the workers it stopped
+    if (!job.isCancelled()) cerr << "Error: " << e.what() << endl;
+    job.cancel();               // stop the other workers
+    retval = 1;
+  }
+
+  // Pass the metadata of the profiles to their tilesets, and release the
+  // tilers before the dataset they read
+  {
+    static std::mutex mutex;
+    std::lock_guard<std::mutex> lock(mutex);
+
+    for (size_t i = 0; i < profiles.size(); i++) {
+      if (profiles[i]->metadata) tilesets[i].metadata->add(*profiles[i]->metadata);
+    }
+  }
+  profiles.clear();
+  GDALClose(poDataset);
+
+  return retval;
+}
+
+/// Get the extension of the tile files of an output format
+static string
+getTileExtension(const string &format) {
+  if (isImageFormat(format.c_str())) return "png";
+  if (format == "Terrain" || format == "Mesh") return "terrain";
+
+  GDALDriver *poDriver = GetGDALDriverManager()->GetDriverByName(format.c_str());
+  const char *extension = poDriver ? poDriver->GetMetadataItem(GDAL_DMD_EXTENSION) : NULL;
+  return extension ? extension : "";
+}
+
+/// Does the root tile of an output format exist, looked up by its own serializer?
 static bool
-tileExists(TerrainBuild *command, std::shared_ptr<TerrainSerialize> &serializer, ctb::i_tile x, const std::string& dirName, const std::string& tileName) {
+tileExists(std::shared_ptr<TerrainSerialize> &serializer, const string &format, ctb::i_tile x, const std::string& tileName) {
   
   if (serializer->fileFormat == TilerFileFormat::File) {
    
     return fileExists(tileName);
   }
   else if (serializer->fileFormat == TilerFileFormat::MBTiles) {
-    std::shared_ptr<CTBMBTileSerializer> mbTileSerializer =
-      std::static_pointer_cast<CTBMBTileSerializer>(serializer->meshSerializer); // mesh or terrain doesn't matter
+    std::shared_ptr<CTBMBTileSerializer> mbTileSerializer = (format == "Mesh")
+      ? std::static_pointer_cast<CTBMBTileSerializer>(serializer->meshSerializer)
+      : (format == "Terrain")
+      ? std::static_pointer_cast<CTBMBTileSerializer>(serializer->terrainSerializer)
+      : std::static_pointer_cast<CTBMBTileSerializer>(serializer->imageSerializer);
 
     ctb::TileCoordinate missingTileCoord(0, x, 0);
     return mbTileSerializer->hasCoordinate(missingTileCoord);
@@ -861,27 +1893,75 @@ tileExists(TerrainBuild *command, std::shared_ptr<TerrainSerialize> &serializer,
   return false;
 }
 
-static void
-checkCreateBaseTiles(TerrainBuild *command, std::shared_ptr<TerrainSerialize> &serializer, Grid &grid) {
+/**
+ * Create the root tiles of the geodetic profile which the source does not cover
+ *
+ * The root tiles of each output format are checked in its own directory or
+ * MBTiles file, and only the formats missing a root tile are created for it.
+ */
+static int
+checkCreateBaseTiles(TilingEngine &engine, TerrainBuild *command, std::shared_ptr<TerrainSerialize> &serializer, Grid &grid) {
   
   for (ctb::i_tile x = 0; x < 2; x++) {
 
     std::string strT = std::to_string(x);
-    std::string dirNameT = string(command->outputDir) + osDirSep + "0" + osDirSep + strT;
-    std::string missingTileName = dirNameT + osDirSep + "0.terrain";
+    std::vector<std::string> missingFormats;
+    std::string dirNameT, missingTileName;
+
+    for (const string &format : command->outputFormats) {
+      const std::string dirName = getOutputDirname(command, "geodetic", format) + "0" + osDirSep + strT;
+      const std::string tileName = dirName + osDirSep + "0." + getTileExtension(format);
+
+      if (!tileExists(serializer, format, x, tileName)) {
+        if (missingFormats.empty()) {
+          dirNameT = dirName;
+          missingTileName = tileName;
+        }
+        missingFormats.push_back(format);
+      }
+    }
 
-    if (!tileExists(command, serializer, x, dirNameT, missingTileName)) {    
+    if (!missingFormats.empty()) {
 
       VSIMkdirRecursive(dirNameT.c_str(), 0755);
       ctb::TileCoordinate missingTileCoord = ctb::TileCoordinate(0, x, 0);
 
-      globalIteratorIndex = 0; // reset global iterator index
       command->startZoom = 0;
       command->endZoom = 0;
       missingTileName = createEmptyRootElevationFile(missingTileName, grid, missingTileCoord);
-      runTiler(missingTileName.c_str(), command, grid, std::shared_ptr<TerrainMetadata>(NULL), serializer);
+
+      // Only the missing formats are created, each by its own serializer
+      command->outputFormats.swap(missingFormats);
+      command->outputFormat = command->outputFormats[0].c_str();
+
+      // The empty elevation file has a single band and no water mask: the tile
+      // is all land, it is not covered by the coverage index of the source,
+      // and it is read as a single dataset rather than a mosaic
+      const TilerOptions tilerOptions = command->tilerOptions;
+      const std::shared_ptr<SourceMosaic> mosaic = command->mosaic;
+      command->tilerOptions.heightBand = 1;
+      command->tilerOptions.maskBand = 0;
+      command->tilerOptions.coverage.reset();
+      command->tilerOptions.mosaic.reset();
+      command->mosaic.reset();
+      std::shared_ptr<TerrainMetadata> noMetadata;
+      int retval = 0;
+      const std::shared_ptr<TilingJob> job = engine.submit([&](TilingJob &job) {
+          retval = runTiler(missingTileName.c_str(), command, grid, noMetadata, serializer, job);
+        }, 1);
+      job->wait();
+      command->tilerOptions = tilerOptions;
+      command->mosaic = mosaic;
+      command->outputFormats.swap(missingFormats);
+      command->outputFormat = command->outputFormats[0].c_str();
       VSIUnlink(missingTileName.c_str());
 
+      if (!job->error().empty()) {
+        cerr << "Error: " << job->error() << endl;
+        return 1;
+      }
+      if (retval) return retval;
+
       if (command->fileFormat == TilerFileFormat::MBTiles) {
         std::string tempDir = string(command->outputDir) + osDirSep + "0";
         VSIRmdirRecursive(tempDir.c_str());
@@ -889,6 +1969,7 @@ checkCreateBaseTiles(TerrainBuild *command, std::shared_ptr<TerrainSerialize> &s
       }
     }
   }
+  return 0;
 }
 
 int
@@ -898,10 +1979,10 @@ main(int argc, char *argv[]) {
   command.setUsage("[options] GDAL_DATASOURCE");
   command.option("-o", "--output-dir <dir>", "specify the output directory for the tiles (defaults to working directory)", TerrainBuild::setOutputDir);
   command.option("-b", "--mbtiles <name>", "specify the mbtiles output format and a name for the output file. Do not use a directory", TerrainBuild::setFileFormat);
-  command.option("-f", "--output-format <format>", "specify the output format for the tiles. This is either `Terrain` (the default), `Mesh` (Chunked LOD mesh), or any format listed by `gdalinfo --formats`", TerrainBuild::setOutputFormat);
-  command.option("-p", "--profile <profile>", "specify the TMS profile for the tiles. This is either `geodetic` (the default) or `mercator`", TerrainBuild::setProfile);
+  command.option("-f", "--output-format <format>", "specify the output format for the tiles. This is either `Terrain` (the default), `Mesh` (Chunked LOD mesh), `TerrainRGB` or `Terrarium` (PNG elevation images), or any format listed by `gdalinfo --formats`. `Terrain,Mesh` writes both from a single read of the heights of each tile, each to a subdirectory named after the format, or an MBTiles file suffixed with it", TerrainBuild::setOutputFormat);
+  command.option("-p", "--profile <profile>", "specify the TMS profile for the tiles. This is either `geodetic` (the default) or `mercator`. `geodetic,mercator` tiles both from shared reads of the source, each to a subdirectory named after the profile, or an MBTiles file suffixed with it. Several profiles are tiled over all their zoom levels, without `--start-zoom` or `--end-zoom`", TerrainBuild::setProfile);
   command.option("-c", "--thread-count <count>", "specify the number of threads to use for tile generation. On multicore machines this defaults to the number of CPUs", TerrainBuild::setThreadCount);
-  command.option("-t", "--tile-size <size>", "specify the size of the tiles in pixels. This defaults to 65 for terrain tiles and 256 for other GDAL formats", TerrainBuild::setTileSize);
+  command.option("-t", "--tile-size <size>", "specify the size of the tiles in pixels. This defaults to 65 for terrain tiles and 256 for elevation images and other GDAL formats. Mesh tiles also accept 129, 257 or 513 for fewer, denser tiles", TerrainBuild::setTileSize);
   command.option("-s", "--start-zoom <zoom>", "specify the zoom level to start at. This should be greater than the end zoom level", TerrainBuild::setStartZoom);
   command.option("-e", "--end-zoom <zoom>", "specify the zoom level to end at. This should be less than the start zoom level and >= 0", TerrainBuild::setEndZoom);
   command.option("-r", "--resampling-method <algorithm>", "specify the raster resampling algorithm.  One of: nearest; bilinear; cubic; cubicspline; lanczos; average; mode; max; min; med; q1; q3. Defaults to average.", TerrainBuild::setResampleAlg);
@@ -913,6 +1994,18 @@ main(int argc, char *argv[]) {
   command.option("-l", "--layer", "only output the layer.json metadata file", TerrainBuild::setMetadata);
   command.option("-C", "--cesium-friendly", "Force the creation of missing root tiles to be CesiumJS-friendly", TerrainBuild::setCesiumFriendly);
   command.option("-N", "--vertex-normals", "Write 'Oct-Encoded Per-Vertex Normals' for Terrain Lighting, only for `Mesh` format", TerrainBuild::setVertexNormals);
+  command.option("-B", "--height-band <band>", "specify the band of the source dataset holding the heights. Defaults to 1. Only the height and water mask bands are warped for `Terrain` and `Mesh` tiles", TerrainBuild::setHeightBand);
+  command.option("-w", "--water-mask <band>", "specify the band of the source dataset holding the water mask, where any non-zero value is water. A separate mask raster can be stacked as a band using a VRT", TerrainBuild::setMaskBand);
+  command.option("-a", "--availability-levels <levels>", "Write the availability of the tiles below every <levels> zoom levels in the 'Metadata' extension of the tiles, so layer.json only lists the first levels. Only for `Mesh` format", TerrainBuild::setAvailabilityLevels);
+  command.option("-k", "--skip-empty", "Skip the tiles without any valid data. The coverage of the source is indexed from a coarse warp of the whole dataset before tiling", TerrainBuild::setSkipEmpty);
+  command.option("-S", "--stream", "Create the tiles of the start zoom level a row at a time from the north, reading the source from top to bottom while the threads encode the tiles, before the coarser levels. Suits sources that are slow to read in any other order, such as striped or compressed rasters. Only for `Terrain` and `Mesh` formats", TerrainBuild::setStream);
+  command.option("-M", "--mosaic", "Treat GDAL_DATASOURCE as a directory of rasters, or a text file listing one raster per line, to tile as a mosaic. Only the rasters overlapping a tile are opened. Each tile is read from the coarsest raster at least as fine as its zoom level, falling back to the others where it has no data, and each region only goes as deep as its finest raster. Rasters of the same resolution take priority in the order listed, and all must share their band count, data type and nodata value. Only for `Terrain`, `Mesh`, `TerrainRGB` and `Terrarium` formats", TerrainBuild::setMosaic);
+  command.option("-d", "--fill-nodata <distance>", "Fill the nodata holes of the heights by inverse distance weighting of the valid heights within <distance> samples, which must be less than the tile size. Only for `Terrain`, `Mesh`, `TerrainRGB` and `Terrarium` formats", TerrainBuild::setFillDistance);
+  command.option("-F", "--flat-tolerance <height>", "Do not create the children of tiles whose source heights span less than <height>, as the tile already represents them within that tolerance. Only for `Terrain`, `Mesh`, `TerrainRGB` and `Terrarium` formats", TerrainBuild::setFlatTolerance);
+  command.option("-P", "--png-filter <filter>", "specify the row filter of `TerrainRGB` and `Terrarium` images. One of: none; sub; up; average; paeth; adaptive, which tries each filter on every row. Defaults to up", TerrainBuild::setPngFilter);
+  command.option("-Z", "--png-compression <level>", "specify the zlib compression level of `TerrainRGB` and `Terrarium` images, from 0 (fastest) to 9 (smallest). Defaults to 6", TerrainBuild::setPngCompression);
+  command.option("-D", "--deduplicate", "Store identical tiles once, such as the flat tiles of the sea. An MBTiles file then maps each tile to a table of distinct images, read through a `tiles` view. In a directory a tile identical to one recently written is linked to its file as set by `--duplicate-links`", TerrainBuild::setDeduplicate);
+  command.option("-L", "--duplicate-links <type>", "specify how `--deduplicate` stores identical tiles in a directory. One of: hard, a hard link to the file of the first tile; symbolic, a relative symbolic link to it; copy, a copy of the file, which saves compressing the tile again. Defaults to hard", TerrainBuild::setDuplicateLinks);
   command.option("-q", "--quiet", "only output errors", TerrainBuild::setQuiet);
   command.option("-v", "--verbose", "be more noisy", TerrainBuild::setVerbose);
 
@@ -922,6 +2015,12 @@ main(int argc, char *argv[]) {
 
   GDALAllRegister();
 
+  // Read uncompressed GeoTIFFs, such as those of `ctb-prepare`, through a
+  // memory map unless told otherwise
+  if (CPLGetConfigOption("GTIFF_VIRTUAL_MEM_IO", NULL) == NULL) {
+    CPLSetConfigOption("GTIFF_VIRTUAL_MEM_IO", "IF_ENOUGH_RAM");
+  }
+
   // Set the output type
   if (command.verbosity > 1) {
     progressFunc = verboseProgress; // noisy
@@ -929,13 +2028,59 @@ main(int argc, char *argv[]) {
     progressFunc = GDALDummyProgress; // quiet
   }
 
+  // Split the output formats, of which only `Terrain` and `Mesh` can be
+  // combined as they are created from the same heights
+  const CPLStringList formats(CSLTokenizeString2(command.outputFormat, ",", CSLT_STRIPLEADSPACES | CSLT_STRIPENDSPACES), TRUE);
+  for (int i = 0; i < formats.size(); i++) {
+    if (!command.hasOutputFormat(formats[i])) command.outputFormats.push_back(formats[i]);
+  }
+  if (command.outputFormats.empty()) {
+    cerr << "Error: An output format must be specified" << endl;
+    return 1;
+  }
+  command.outputFormat = command.outputFormats[0].c_str();
+
+  const bool isMesh = command.hasOutputFormat("Mesh"),
+    isTerrain = command.hasOutputFormat("Terrain"),
+    isImage = isImageFormat(command.outputFormat),
+    isHeights = isMesh || isTerrain || isImage;
+  if (command.outputFormats.size() > 1 && (command.outputFormats.size() > 2 || !isMesh || !isTerrain)) {
+    cerr << "Error: Several output formats can only be the `Terrain` and `Mesh` formats together" << endl;
+    return 1;
+  }
+
+  // Split the profiles, each tiled to its own tileset
+  const CPLStringList profiles(CSLTokenizeString2(command.profile, ",", CSLT_STRIPLEADSPACES | CSLT_STRIPENDSPACES), TRUE);
+  for (int i = 0; i < profiles.size(); i++) {
+    if (strcmp(profiles[i], "geodetic") != 0 && strcmp(profiles[i], "mercator") != 0) {
+      cerr << "Error: Unknown profile: " << profiles[i] << endl;
+      return 1;
+    }
+    if (std::find(command.profiles.begin(), command.profiles.end(), profiles[i]) == command.profiles.end()) {
+      command.profiles.push_back(profiles[i]);
+    }
+  }
+  if (command.profiles.empty()) {
+    cerr << "Error: A profile must be specified" << endl;
+    return 1;
+  }
+  command.profile = command.profiles[0].c_str();
+
+  if (command.profiles.size() > 1 && (command.stream || command.useMosaic || command.availabilityLevels > 0)) {
+    cerr << "Error: Several profiles are not valid with `--stream`, `--mosaic` or `--availability-levels`" << endl;
+    return 1;
+  }
+
+  // The zoom levels of a resolution differ between the profiles
+  if (command.profiles.size() > 1 && (command.startZoom >= 0 || command.endZoom >= 0)) {
+    cerr << "Error: Several profiles are not valid with `--start-zoom` or `--end-zoom`, as each profile is tiled over its own zoom levels" << endl;
+    return 1;
+  }
+
   // Check whether or not the output directory exists
   VSIStatBufL stat;
   
   const string outputDirname = string(command.outputDir) + osDirSep;
-  string metadataFilename = concat(outputDirname, "layer.json");
-
-  std::shared_ptr<TerrainSerialize>serializer(new TerrainSerialize(command.fileFormat));
 
   if (command.fileFormat == TilerFileFormat::File) {
 	  if (VSIStatExL(command.outputDir, &stat, VSI_STAT_EXISTS_FLAG | VSI_STAT_NATURE_FLAG)) {
@@ -946,103 +2091,289 @@ main(int argc, char *argv[]) {
 		  cerr << "Error: The output filepath is not a directory: " << command.outputDir << endl;
 		  return 1;
 	  }
-	  
-    std::shared_ptr<CTBFileTileSerializer> fts =
-      std::shared_ptr<CTBFileTileSerializer>(new CTBFileTileSerializer(outputDirname, command.resume));
-	  serializer->gdalSerializer = std::static_pointer_cast<GDALSerializer>(fts);
-	  serializer->meshSerializer = std::static_pointer_cast<MeshSerializer>(fts);
-	  serializer->terrainSerializer = std::static_pointer_cast<TerrainSerializer>(fts);
-  }
-  else if(command.fileFormat == TilerFileFormat::MBTiles) {
-	  
-    std::shared_ptr<CTBMBTileSerializer> mbtiles =
-      std::shared_ptr<CTBMBTileSerializer>(new CTBMBTileSerializer(outputDirname, command.mbTilesName, command.resume));
-	  serializer->meshSerializer = std::static_pointer_cast<MeshSerializer> (mbtiles);
-	  serializer->terrainSerializer = std::static_pointer_cast<TerrainSerializer>(mbtiles);
-  }
-
-  // Define the grid we are going to use
-  Grid grid;
-  if (strcmp(command.profile, "geodetic") == 0) {
-    int tileSize = (command.tileSize < 1) ? 65 : command.tileSize;
-    grid = GlobalGeodetic(tileSize);
-  } else if (strcmp(command.profile, "mercator") == 0) {
-    int tileSize = (command.tileSize < 1) ? 256 : command.tileSize;
-    grid = GlobalMercator(tileSize);
-  } else {
-    cerr << "Error: Unknown profile: " << command.profile << endl;
+  }
+
+  std::vector<ProfileTileset> tilesets(command.profiles.size());
+  for (size_t i = 0; i < tilesets.size(); i++) {
+    ProfileTileset &tileset = tilesets[i];
+    tileset.profile = command.profiles[i];
+    tileset.serializer = std::make_shared<TerrainSerialize>(command.fileFormat);
+
+    // Define the grid we are going to use
+    if (tileset.profile == "geodetic") {
+      int tileSize = (command.tileSize < 1) ? (isImage ? 256 : 65) : command.tileSize;
+      tileset.grid = GlobalGeodetic(tileSize);
+    } else {
+      int tileSize = (command.tileSize < 1) ? (isMesh ? 65 : 256) : command.tileSize;
+      tileset.grid = GlobalMercator(tileSize);
+    }
+
+    // Each output format has its own serializer, which a single format also
+    // uses for the serializers of the other formats
+    for (const string &format : command.outputFormats) {
+      const bool all = command.outputFormats.size() == 1;
+      std::shared_ptr<TerrainSerialize> &serializer = tileset.serializer;
+
+      if (command.fileFormat == TilerFileFormat::File) {
+        const string dirname = getOutputDirname(&command, tileset.profile, format);
+        if (dirname != outputDirname && VSIStatExL(dirname.c_str(), &stat, VSI_STAT_EXISTS_FLAG) && VSIMkdirRecursive(dirname.c_str(), 0755)) {
+          cerr << "Error: Could not create the output directory: " << dirname << endl;
+          return 1;
+        }
+
+        std::shared_ptr<CTBFileTileSerializer> fts =
+          std::shared_ptr<CTBFileTileSerializer>(new CTBFileTileSerializer(dirname, command.resume, command.deduplicate ? command.duplicate : CTBFileTileSerializer::DuplicateWrite));
+        if (all) serializer->gdalSerializer = std::static_pointer_cast<GDALSerializer>(fts);
+        if (all) serializer->imageSerializer = std::static_pointer_cast<ImageSerializer>(fts);
+        if (all || format == "Mesh") serializer->meshSerializer = std::static_pointer_cast<MeshSerializer>(fts);
+        if (all || format == "Terrain") serializer->terrainSerializer = std::static_pointer_cast<TerrainSerializer>(fts);
+      }
+      else if(command.fileFormat == TilerFileFormat::MBTiles) {
+
+        std::shared_ptr<CTBMBTileSerializer> mbtiles =
+          std::shared_ptr<CTBMBTileSerializer>(new CTBMBTileSerializer(outputDirname, getMBTilesName(&command, tileset.profile, format), command.resume, command.deduplicate));
+        if (all || format == "Mesh") serializer->meshSerializer = std::static_pointer_cast<MeshSerializer> (mbtiles);
+        if (all || format == "Terrain") serializer->terrainSerializer = std::static_pointer_cast<TerrainSerializer>(mbtiles);
+        if (all) serializer->imageSerializer = std::static_pointer_cast<ImageSerializer>(mbtiles);
+      }
+    }
+  }
+
+  // A single profile is tiled with the grid and serializers of its tileset
+  Grid &grid = tilesets[0].grid;
+  std::shared_ptr<TerrainSerialize> &serializer = tilesets[0].serializer;
+
+  // Terrain tiles created from the heights of mesh tiles share their grid
+  if (isMesh && isTerrain && grid.tileSize() != TILE_SIZE) {
+    cerr << "Error: The tile size must be " << TILE_SIZE << " to create `Terrain` and `Mesh` tiles together" << endl;
+    return 1;
+  }
+
+  if (command.tilerOptions.heightBand < 1) {
+    cerr << "Error: The height band must be greater than 0" << endl;
+    return 1;
+  }
+  if (command.tilerOptions.maskBand < 0 || (command.tilerOptions.maskBand > 0 && !isMesh && !isTerrain)) {
+    cerr << "Error: The water mask band must be positive and is only valid for the `Terrain` and `Mesh` formats" << endl;
+    return 1;
+  }
+  if (command.availabilityLevels < 0 || (command.availabilityLevels > 0 && !isMesh)) {
+    cerr << "Error: The availability levels must be positive and are only valid for the `Mesh` format" << endl;
+    return 1;
+  }
+  if (command.availabilityLevels > 0) {
+    command.availabilityRecorder = std::make_shared<TileAvailabilityRecorder>();
+  }
+
+  // Mesh tiles are chunked from a (2^n) + 1 heightfield
+  if (isMesh && !MeshTiler::isValidTileSize(grid.tileSize())) {
+    cerr << "Error: The tile size of Mesh tiles must be (2^n) + 1, e.g. 65, 129, 257 or 513" << endl;
+    return 1;
+  }
+
+  if (command.tilerOptions.flatTolerance < 0 || (command.tilerOptions.flatTolerance > 0 && !isHeights)) {
+    cerr << "Error: The flat tolerance must be positive and is only valid for the `Terrain`, `Mesh`, `TerrainRGB` and `Terrarium` formats" << endl;
+    return 1;
+  }
+
+  if (command.stream && ((!isMesh && !isTerrain) || command.metadata)) {
+    cerr << "Error: Streaming is only valid for the `Terrain` and `Mesh` formats, without `--layer`" << endl;
+    return 1;
+  }
+
+  if (command.fillDistance < 0 || (command.fillDistance > 0 && (!isHeights || command.stream || command.fillDistance >= (int) grid.tileSize()))) {
+    cerr << "Error: The nodata fill distance must be positive and less than the tile size, and is only valid for the `Terrain`, `Mesh`, `TerrainRGB` and `Terrarium` formats without `--stream`" << endl;
     return 1;
   }
 
-  // Run the tilers in separate threads
-  vector<future<int>> tasks;
-  int threadCount = (command.threadCount > 0) ? command.threadCount : CPLGetNumCPUs();
+  if (command.useMosaic && (!isHeights || command.skipEmpty || command.tilerOptions.flatTolerance > 0 || command.stream)) {
+    cerr << "Error: A mosaic is only valid for the `Terrain`, `Mesh`, `TerrainRGB` and `Terrarium` formats, without `--skip-empty`, `--flat-tolerance` or `--stream`" << endl;
+    return 1;
+  }
+
+  if (command.duplicateLinks && (!command.deduplicate || command.fileFormat == TilerFileFormat::MBTiles)) {
+    cerr << "Error: The duplicate links are only valid with `--deduplicate`, when writing to a directory" << endl;
+    return 1;
+  }
+
+  // GDAL tiles are only written to MBTiles once encoded in memory
+  if (!isHeights && command.fileFormat == TilerFileFormat::MBTiles && !command.metadata) {
+    GDALDriver *poDriver = GetGDALDriverManager()->GetDriverByName(command.outputFormat);
+
+    if (poDriver == NULL || !GDALTileEncoder::canEncode(poDriver, command.creationOptions)) {
+      cerr << "Error: Only the GDAL formats whose driver supports virtual IO and writes single files, without a world file or other sidecar file, can be written to MBTiles" << endl;
+      return 1;
+    }
+  }
+
+  if (command.pngCompression < 0 || command.pngCompression > 9) {
+    cerr << "Error: The PNG compression level must be between 0 and 9" << endl;
+    return 1;
+  }
+
+  // Index the footprints of the sources of a mosaic
+  if (command.useMosaic) {
+    try {
+      command.mosaic = std::make_shared<SourceMosaic>(SourceMosaic::listSources(command.getInputFilename()), grid, command.hasOutputFormat("Mesh"));
+      command.tilerOptions.mosaic = command.mosaic;
+    } catch (CTBException &e) {
+      cerr << "Error: " << e.what() << endl;
+      return 1;
+    }
+  }
+
+  // Index the coverage of the source to skip the tiles without data or below
+  // flat tiles, for the grid of each profile.  The layer alone ignores flat
+  // tiles.
+  for (ProfileTileset &tileset : tilesets) {
+    tileset.tilerOptions = command.tilerOptions;
+    if (!command.skipEmpty && (command.tilerOptions.flatTolerance <= 0 || command.metadata)) continue;
+
+    GDALDataset *poDataset = (GDALDataset *) GDALOpen(command.getInputFilename(), GA_ReadOnly);
+    if (poDataset == NULL) {
+      cerr << "Error: could not open GDAL dataset" << endl;
+      return 1;
+    }
+
+    try {
+      if (isMesh) {
+        const MeshTiler tiler(poDataset, tileset.grid, command.tilerOptions, command.meshQualityFactor);
+        tileset.tilerOptions.coverage = std::make_shared<const CoverageIndex>(tiler);
+      } else {
+        const RasterTiler tiler(poDataset, tileset.grid, command.tilerOptions);
+        tileset.tilerOptions.coverage = std::make_shared<const CoverageIndex>(tiler);
+      }
+    } catch (CTBException &e) {
+      cerr << "Error: " << e.what() << endl;
+    }
+    GDALClose(poDataset);
+
+    if (!tileset.tilerOptions.coverage) return 1;
+  }
+  command.tilerOptions = tilesets[0].tilerOptions;
+
+  // Run the tilers on the threads of an engine
+  TilingEngine engine(command.threadCount);
+  int threadCount = engine.threadCount();
+
+  // The metadata is computed per zoom level so a single thread is enough
+  if (command.metadata) threadCount = 1;
 
   // Calculate metadata?  
-  std::shared_ptr<TerrainMetadata> metadata = command.metadata || !fileExists(metadataFilename) || (command.fileFormat == TilerFileFormat::MBTiles) ? 
-    std::shared_ptr<TerrainMetadata>(new TerrainMetadata()) : 
-    std::shared_ptr<TerrainMetadata>(NULL);
+  for (ProfileTileset &tileset : tilesets) {
+    bool metadataExists = true;
+    for (const string &format : command.outputFormats) {
+      metadataExists = metadataExists && fileExists(concat(getOutputDirname(&command, tileset.profile, format), "layer.json"));
+    }
+    tileset.metadata = command.metadata || !metadataExists || (command.fileFormat == TilerFileFormat::MBTiles) ? 
+      std::shared_ptr<TerrainMetadata>(new TerrainMetadata()) : 
+      std::shared_ptr<TerrainMetadata>(NULL);
+  }
+  std::shared_ptr<TerrainMetadata> &metadata = tilesets[0].metadata;
 
-  // Instantiate the threads using futures from a packaged_task
-  for (int i = 0; i < threadCount ; ++i) {
-    packaged_task<int(const char *, TerrainBuild*, const Grid&, std::shared_ptr<TerrainMetadata>&, std::shared_ptr<TerrainSerialize>&)> task(runTiler); // wrap the function
-    tasks.push_back(task.get_future()); // get a future
-    thread(move(task), command.getInputFilename(), &command, grid, metadata, serializer).detach(); // launch on a thread
+  // Stream the start zoom level, leaving the coarser levels to the threads
+  if (command.stream) {
+    const int retval = streamStartZoom(engine, threadCount, &command, grid, metadata, serializer);
+
+    if (retval > 0) return retval;
+    if (retval < 0) threadCount = 0;
   }
 
-  // Synchronise the completion of the threads
-  for (auto &task : tasks) {
-    task.wait();
+  // Several profiles share a job whose tiles interleave the profiles
+  std::vector<ProfileRow> rows;
+  size_t size = 0;
+  if (tilesets.size() > 1) {
+    GDALDataset *poDataset = (GDALDataset *) GDALOpen(command.getInputFilename(), GA_ReadOnly);
+    if (poDataset == NULL) {
+      cerr << "Error: could not open GDAL dataset" << endl;
+      return 1;
+    }
+
+    try {
+      size = scheduleProfiles(poDataset, tilesets, &command, rows);
+    } catch (CTBException &e) {
+      cerr << "Error: " << e.what() << endl;
+      GDALClose(poDataset);
+      return 1;
+    }
+    GDALClose(poDataset);
   }
 
-  // Get the value from the futures
-  for (auto &task : tasks) {
-    int retval = task.get();
+  // Run a worker of the tiling job on each thread, returning on the first
+  // encountered problem
+  if (threadCount > 0) {
+    std::atomic<int> retval(0);
+
+    const std::shared_ptr<TilingJob> job = engine.submit([&](TilingJob &job) {
+        const int workerRetval = (tilesets.size() > 1)
+          ? runProfiles(command.getInputFilename(), &command, tilesets, rows, size, job)
+          : runTiler(command.getInputFilename(), &command, grid, metadata, serializer, job);
+        if (workerRetval) retval = workerRetval;
+      }, threadCount);
+    if (command.availabilityRecorder) {
+      const std::shared_ptr<TileAvailabilityRecorder> recorder = command.availabilityRecorder;
+      job->onCancel([recorder]() { recorder->cancel(); });
+    }
+    job->wait();
 
-    // return on the first encountered problem
+    // Any other exception of a worker is recorded as the error of the job
+    if (!job->error().empty()) {
+      cerr << "Error: " << job->error() << endl;
+      return 1;
+    }
     if (retval) {
       return retval;
     }
-  }  
+  }
 
   // CesiumJS friendly?
-  if ( command.cesiumFriendly && (strcmp(command.profile, "geodetic") == 0) && 
-       command.endZoom <= 0) {
+  for (ProfileTileset &tileset : tilesets) {
+    if (!command.cesiumFriendly || tileset.profile != "geodetic" || command.endZoom > 0) continue;
 
     // Create missing root tiles if it is necessary
     if (!command.metadata) {
-      checkCreateBaseTiles(&command, serializer, grid);
+      const int retval = checkCreateBaseTiles(engine, &command, tileset.serializer, tileset.grid);
+      if (retval) return retval;
     }
 
     // Fix available indexes.
-    if (metadata && metadata->levels.size() > 0) {
-      TerrainMetadata::LevelInfo &level = metadata->levels.at(0);
-      level.startX = 0;
-      level.startY = 0;
-      level.finalX = 1;
-      level.finalY = 0;
+    if (tileset.metadata && tileset.metadata->availability.levelCount() > 0) {
+      tileset.metadata->addRootTiles(tileset.grid);
     }
   }
 
+  // Release the in-memory overviews shared by the threads
+  OverviewCache::clear();
+
   // Write Json metadata file?
-  if ( metadata ) {
-    std::string datasetName(command.getInputFilename());
-    datasetName = datasetName.substr(datasetName.find_last_of("/\\") + 1);
-    const size_t rfindpos = datasetName.rfind('.');
-    if (std::string::npos != rfindpos) datasetName = datasetName.erase(rfindpos);
-
-    metadata->writeJsonFile(metadataFilename, datasetName, std::string(command.outputFormat), std::string(command.profile), command.vertexNormals);
-    
-    if (command.fileFormat == TilerFileFormat::MBTiles) {
-
-      std::shared_ptr<CTBMBTileSerializer> mbTileSerializer = 
-        std::static_pointer_cast<CTBMBTileSerializer>(serializer->meshSerializer); // mesh or terrain doesn't matter
-
-      std::ifstream t(metadataFilename);
-      std::stringstream buffer;
-      buffer << t.rdbuf();
-      mbTileSerializer->saveMetadata(buffer);
-      VSIUnlink(metadataFilename.c_str());
+  std::string datasetName(command.getInputFilename());
+  datasetName = datasetName.substr(datasetName.find_last_of("/\\") + 1);
+  const size_t rfindpos = datasetName.rfind('.');
+  if (std::string::npos != rfindpos) datasetName = datasetName.erase(rfindpos);
+
+  for (ProfileTileset &tileset : tilesets) {
+    if (!tileset.metadata) continue;
+
+    // Each output format has its own metadata, but only mesh tiles have extensions
+    for (const string &format : command.outputFormats) {
+      const bool formatIsMesh = format == "Mesh";
+      const string metadataFilename = concat(getOutputDirname(&command, tileset.profile, format), "layer.json");
+
+      tileset.metadata->writeJsonFile(metadataFilename, tileset.grid, datasetName, format, tileset.profile, command.vertexNormals && (formatIsMesh || command.outputFormats.size() == 1), command.tilerOptions.maskBand > 0 && formatIsMesh, formatIsMesh ? command.availabilityLevels : 0);
+
+      if (command.fileFormat == TilerFileFormat::MBTiles) {
+
+        std::shared_ptr<CTBMBTileSerializer> mbTileSerializer =
+          formatIsMesh
+          ? std::static_pointer_cast<CTBMBTileSerializer>(tileset.serializer->meshSerializer)
+          : std::static_pointer_cast<CTBMBTileSerializer>(tileset.serializer->terrainSerializer);
+
+        std::ifstream t(metadataFilename);
+        std::stringstream buffer;
+        buffer << t.rdbuf();
+        mbTileSerializer->saveMetadata(buffer);
+        VSIUnlink(metadataFilename.c_str());
+      }
     }
   }
 